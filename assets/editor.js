@@ -1,31 +1,507 @@
 window.addEventListener('load', function() {
-  // Initialize the editor
-  window.editor = new toastui.Editor({
-    el: document.querySelector('#editor'),
-    height: '100%',
-    initialEditType: 'markdown',
-    previewStyle: 'vertical',
-    hideModeSwitch: false,
-    hideToolbar: false,
-    usageStatistics: false
-  });
+  // One editor per hot tab, keyed by the native tab id; only the active one
+  // is shown. Each keeps its own undo history, cursor and scroll position,
+  // so switching back to it is instant. Id 0 is the editor used without tabs.
+  const instances = new Map();
+  let active = null;
+  // Cursor and scroll changes are reported this long after they settle
+  const VIEW_DELAY_MS = 300;
+  // Preview scroll offset to restore once enough of the preview is rendered
+  let pendingPreviewTop = 0;
+
+  function createInstance(id) {
+    const element = document.createElement('div');
+    element.className = 'editor-instance';
+    document.getElementById('editor').appendChild(element);
+    const instance = {
+      id: id,
+      element: element,
+      documentSeq: 0,
+      loading: false,
+      lastBytes: 0,
+      resetFrame: 0,
+      viewTimer: 0
+    };
+    instance.editor = new toastui.Editor({
+      el: element,
+      height: '100%',
+      initialEditType: 'markdown',
+      // The live side-by-side preview is rendered natively, see patchPreview()
+      previewStyle: 'tab',
+      hideModeSwitch: false,
+      hideToolbar: false,
+      usageStatistics: false,
+      plugins: [deltaPlugin(instance)]
+    });
+    // The WYSIWYG editor has no markdown offsets; its text is sent whole
+    instance.editor.on('change', () => {
+      if (instance.loading || instance.editor.isMarkdownMode()) return;
+      if (!instance.resetFrame) {
+        instance.resetFrame = requestAnimationFrame(() => window.sendDocument(instance.documentSeq));
+      }
+    });
+    instance.editor.on('caretChange', () => scheduleView(instance));
+    // Scroll events do not bubble; catch the editor's own scrollers
+    element.addEventListener('scroll', () => scheduleView(instance), true);
+    instances.set(id, instance);
+    return instance;
+  }
+
+  function activate(instance) {
+    document.getElementById('editor-area').classList.remove('large-file-mode');
+    if (active && active !== instance) {
+      flushDelta(active);
+      flushView(active);
+      active.element.style.display = 'none';
+    }
+    active = instance;
+    instance.element.style.display = '';
+    window.editor = instance.editor;
+  }
+
+  activate(createInstance(0));
+
+  window.showTab = function(id) {
+    const instance = instances.get(id);
+    if (!instance) return false;
+    activate(instance);
+    instance.editor.focus();
+    return true;
+  };
+
+  // Drop a tab's editor; its pending edits are sent first
+  window.closeTab = function(id) {
+    const instance = instances.get(id);
+    if (!instance || id === 0) return;
+    flushDelta(instance);
+    if (instance === active) flushView(instance);
+    clearTimeout(instance.viewTimer);
+    instance.editor.destroy();
+    instance.element.remove();
+    instances.delete(id);
+    if (active === instance) activate(instances.get(0));
+  };
 
   // Define all window functions
   window.togglePreview = function(show) {
-    const previewEl = document.querySelector('.toastui-editor-md-preview');
-    if (previewEl) {
-      previewEl.style.display = show ? 'block' : 'none';
-    }
+    document.getElementById('native-preview').style.display = show ? 'block' : 'none';
   };
 
   window.showEditor = function() {
     document.getElementById('start-page').style.display = 'none';
-    document.getElementById('editor').style.display = 'block';
+    document.getElementById('editor-area').style.display = 'flex';
   };
 
   window.showStartPage = function() {
     document.getElementById('start-page').style.display = 'flex';
-    document.getElementById('editor').style.display = 'none';
+    document.getElementById('editor-area').style.display = 'none';
+  };
+
+  // The native side renders preview blocks with cmark and sends only the
+  // ones that changed: deleteCount blocks at start are replaced by blocks
+  window.patchPreview = function(start, deleteCount, blocks) {
+    const preview = document.getElementById('native-preview');
+    const children = preview.children;
+    for (let i = 0; i < deleteCount && start < children.length; i++) {
+      preview.removeChild(children[start]);
+    }
+    const fragment = document.createDocumentFragment();
+    blocks.forEach(html => {
+      const block = document.createElement('div');
+      block.className = 'preview-block';
+      block.innerHTML = html;
+      fragment.appendChild(block);
+    });
+    preview.insertBefore(fragment, children[start] || null);
+    applyPreviewTop();
+  };
+
+  document.getElementById('native-preview').addEventListener('scroll', () => {
+    if (active) scheduleView(active);
+  });
+
+  // Fetch note content served by the native side into the editor of tab id,
+  // creating it if the tab is cold. Only the newest request per editor is
+  // applied, and loading it is not an edit. A saved view, if given, is
+  // applied before the text is first drawn.
+  window.loadDocument = function(seq, id, view) {
+    const instance = instances.get(id || 0) || createInstance(id);
+    activate(instance);
+    // Deltas were sent as the edits happened; the old text is being replaced
+    cancelAnimationFrame(instance.resetFrame);
+    instance.resetFrame = 0;
+    instance.documentSeq = seq;
+    pendingPreviewTop = 0;
+    fetch('envelope://app/document/' + seq)
+      .then(response => {
+        if (!response.ok) throw new Error('HTTP ' + response.status);
+        return response.text();
+      })
+      .then(text => {
+        if (seq !== instance.documentSeq || instances.get(instance.id) !== instance) return;
+        instance.loading = true;
+        instance.editor.setMarkdown(text, false);
+        instance.loading = false;
+        const loaded = instance.editor.getMarkdown();
+        instance.lastBytes = utf8Length(loaded, 0, loaded.length);
+        if (view) restoreView(instance, view);
+        // The native mirror starts from the fetched text; only send the
+        // document back if the editor normalized it on the way in
+        if (loaded !== text) window.sendDocument(seq);
+        window.webkit.messageHandlers.documentLoaded.postMessage(seq);
+      })
+      .catch(error => {
+        instance.loading = false;
+        if (seq === instance.documentSeq) console.error('Failed to load document', error);
+      });
+  };
+
+  // Edits go to the native side as deltas, one per changed range, taken from
+  // the markdown editor's ProseMirror transactions as they are applied, so
+  // nothing is pending when the native side switches documents. Offsets and
+  // lengths are in UTF-8 bytes to match the native mirror of the document.
+
+  function utf8Length(text, start, end) {
+    let bytes = 0;
+    for (let i = start; i < end; i++) {
+      const code = text.charCodeAt(i);
+      if (code < 0x80) bytes += 1;
+      else if (code < 0x800) bytes += 2;
+      else if (code >= 0xd800 && code <= 0xdbff && i + 1 < end) { bytes += 4; i++; }
+      else bytes += 3;
+    }
+    return bytes;
+  }
+
+  // Line nodes are immutable and shared between versions of the document,
+  // so their byte lengths are measured once
+  const lineBytesCache = new WeakMap();
+
+  function lineBytes(line) {
+    let bytes = lineBytesCache.get(line);
+    if (bytes === undefined) {
+      const text = line.textContent;
+      bytes = utf8Length(text, 0, text.length);
+      lineBytesCache.set(line, bytes);
+    }
+    return bytes;
+  }
+
+  // The markdown editor's document has one top-level node per line of text.
+  // A position maps to a line and a character in it, and to a UTF-8 offset
+  // in the markdown; just before or after a line node is its start or end.
+  function markdownPoint(doc, pos) {
+    let start = 0, bytes = 0;
+    for (let i = 0; i < doc.childCount; i++) {
+      const line = doc.child(i);
+      const end = start + line.nodeSize;
+      if (pos < end || i === doc.childCount - 1) {
+        const ch = Math.max(0, Math.min(pos - start - 1, line.content.size));
+        const text = line.textContent;
+        return { line: i, ch: ch, bytes: bytes + utf8Length(text, 0, ch) };
+      }
+      bytes += lineBytes(line) + 1;
+      start = end;
+    }
+    return { line: 0, ch: 0, bytes: 0 };
+  }
+
+  function markdownText(doc, from, to) {
+    const lines = [];
+    for (let i = from.line; i <= to.line; i++) {
+      const text = doc.child(i).textContent;
+      lines.push(text.substring(i === from.line ? from.ch : 0, i === to.line ? to.ch : text.length));
+    }
+    return lines.join('\n');
+  }
+
+  // Toast UI plugin that watches the markdown editor's transactions. Each
+  // step's ranges become deltas; the later ranges of a step are already in
+  // the coordinates left by the earlier ones on the new side.
+  function deltaPlugin(instance) {
+    return context => ({
+      markdownPlugins: [() => new context.pmState.Plugin({
+        state: {
+          init: () => null,
+          apply: (tr, value) => {
+            if (tr.docChanged && !instance.loading && instance.editor) sendSteps(instance, tr);
+            return null;
+          }
+        }
+      })]
+    });
+  }
+
+  function sendSteps(instance, tr) {
+    if (!window.webkit || !window.webkit.messageHandlers.contentDelta) return;
+    tr.steps.forEach((step, i) => {
+      const oldDoc = tr.docs[i];
+      const newDoc = i + 1 < tr.docs.length ? tr.docs[i + 1] : tr.doc;
+      step.getMap().forEach((oldStart, oldEnd, newStart, newEnd) => {
+        const deleteLength = markdownPoint(oldDoc, oldEnd).bytes - markdownPoint(oldDoc, oldStart).bytes;
+        const from = markdownPoint(newDoc, newStart);
+        const insert = markdownText(newDoc, from, markdownPoint(newDoc, newEnd));
+        instance.lastBytes += utf8Length(insert, 0, insert.length) - deleteLength;
+        // length lets the native side notice if its mirror drifted
+        window.webkit.messageHandlers.contentDelta.postMessage({
+          seq: instance.documentSeq,
+          offset: from.bytes,
+          deleteLength: deleteLength,
+          insert: insert,
+          length: instance.lastBytes
+        });
+      });
+    });
+  }
+
+  // Send a WYSIWYG edit still waiting for the next frame
+  function flushDelta(instance) {
+    if (!instance.resetFrame) return;
+    cancelAnimationFrame(instance.resetFrame);
+    window.sendDocument(instance.documentSeq);
+  }
+
+  // Each tab's cursor and scroll positions go to the native side, which keeps
+  // them in the session snapshot and hands them back when the note is loaded
+  function scheduleView(instance) {
+    if (instance.loading || instance.viewTimer || !instance.id) return;
+    instance.viewTimer = setTimeout(() => sendView(instance), VIEW_DELAY_MS);
+  }
+
+  // Send a pending report now; hidden editors read as scrolled to the top
+  function flushView(instance) {
+    if (!instance.viewTimer) return;
+    clearTimeout(instance.viewTimer);
+    sendView(instance);
+  }
+
+  function sendView(instance) {
+    instance.viewTimer = 0;
+    if (!window.webkit || !window.webkit.messageHandlers.viewState) return;
+    const editor = instance.editor;
+    const selection = editor.isMarkdownMode() ? editor.getSelection() : null;
+    const preview = document.getElementById('native-preview');
+    window.webkit.messageHandlers.viewState.postMessage({
+      id: instance.id,
+      anchorLine: selection ? selection[0][0] : 0,
+      anchorCh: selection ? selection[0][1] : 0,
+      headLine: selection ? selection[1][0] : 0,
+      headCh: selection ? selection[1][1] : 0,
+      scrollTop: Math.round(editor.getScrollTop()),
+      previewTop: instance === active ? Math.round(preview.scrollTop) : 0
+    });
+  }
+
+  function restoreView(instance, view) {
+    const editor = instance.editor;
+    if (view.anchorLine > 0 && editor.isMarkdownMode()) {
+      try {
+        editor.setSelection([view.anchorLine, view.anchorCh], [view.headLine, view.headCh]);
+      } catch (error) {
+        // The note changed since and the position is gone
+      }
+    }
+    // After the selection, which scrolls it into view
+    editor.setScrollTop(view.scrollTop);
+    pendingPreviewTop = view.previewTop;
+    applyPreviewTop();
+  }
+
+  function applyPreviewTop() {
+    if (!pendingPreviewTop) return;
+    const preview = document.getElementById('native-preview');
+    if (preview.scrollHeight - preview.clientHeight < pendingPreviewTop) return;
+    preview.scrollTop = pendingPreviewTop;
+    pendingPreviewTop = 0;
+  }
+
+  // Full text, for when the native mirror has lost track
+  window.sendDocument = function(seq) {
+    const instance = Array.from(instances.values()).find(i => i.documentSeq === seq);
+    if (!instance) return;
+    cancelAnimationFrame(instance.resetFrame);
+    instance.resetFrame = 0;
+    const text = instance.editor.getMarkdown();
+    instance.lastBytes = utf8Length(text, 0, text.length);
+    window.webkit.messageHandlers.contentReset.postMessage({ seq: seq, text: text });
+  };
+
+  // Large-file mode: the native side keeps the note mapped and serves
+  // windows of lines from envelope://app/lines/<seq>/<first>/<count>. Only
+  // the lines in view are in the page. The loaded window can be edited as a
+  // whole, and is sent back in full on every change.
+  const LARGE_LINE_HEIGHT = 18;
+  const LARGE_WINDOW_LINES = 400;
+  // Tall spacers are scaled down, WebKit caps element heights
+  const LARGE_MAX_SCROLL_PX = 8000000;
+  const large = {
+    seq: 0, lineCount: 0, exact: false, first: 0, lines: [], truncated: false,
+    fetching: false, frame: 0, editing: false, dirty: false, editFrame: 0
+  };
+  const largeScroll = document.getElementById('large-file-scroll');
+  const largeText = document.getElementById('large-file-text');
+
+  function largeScale() {
+    return Math.max(1, large.lineCount * LARGE_LINE_HEIGHT / LARGE_MAX_SCROLL_PX);
+  }
+
+  function largeTopLine() {
+    return Math.floor(largeScroll.scrollTop * largeScale() / LARGE_LINE_HEIGHT);
+  }
+
+  function largeStatus(text) {
+    document.getElementById('large-file-status').textContent = text;
+    document.getElementById('large-file-edit').style.display =
+      large.editing ? 'none' : '';
+    document.getElementById('large-file-edit').disabled = large.truncated || !large.lines.length;
+    document.getElementById('large-file-done').style.display = large.editing ? '' : 'none';
+  }
+
+  function largeRender() {
+    large.frame = 0;
+    const top = largeTopLine();
+    const visible = Math.ceil(largeScroll.clientHeight / LARGE_LINE_HEIGHT) + 1;
+    const from = top - large.first;
+    document.getElementById('large-file-lines').textContent =
+      large.lines.slice(Math.max(0, from), Math.max(0, from + visible)).join('\n');
+    if (!large.editing) {
+      largeStatus('Large note, lines ' + (top + 1) + '\u2013' + (top + visible) +
+                  ' of ' + large.lineCount.toLocaleString() + (large.exact ? '' : '+'));
+    }
+    const missingAfter = from + visible > large.lines.length &&
+                         large.first + large.lines.length < large.lineCount;
+    if (!large.editing && (from < 0 || missingAfter)) {
+      largeFetch(Math.max(0, top - LARGE_WINDOW_LINES / 4));
+    }
+  }
+
+  function largeFetch(first) {
+    if (large.fetching) return;
+    large.fetching = true;
+    const seq = large.seq;
+    fetch('envelope://app/lines/' + seq + '/' + first + '/' + LARGE_WINDOW_LINES)
+      .then(response => {
+        if (!response.ok) throw new Error('HTTP ' + response.status);
+        return response.json();
+      })
+      .then(result => {
+        large.fetching = false;
+        if (seq !== large.seq || large.editing) return;
+        const loaded = large.lines.length > 0;
+        large.first = result.first;
+        large.lines = result.lines;
+        large.truncated = result.truncated;
+        // A short window ends the note, which settles an estimated count
+        const end = large.first + large.lines.length;
+        if (!large.exact && (end > large.lineCount || large.lines.length < LARGE_WINDOW_LINES)) {
+          large.lineCount = end;
+          large.exact = large.lines.length < LARGE_WINDOW_LINES;
+          largeResize();
+        }
+        largeRender();
+        if (!loaded) window.webkit.messageHandlers.documentLoaded.postMessage(seq);
+      })
+      .catch(error => {
+        large.fetching = false;
+        if (seq === large.seq) console.error('Failed to load lines', error);
+      });
+  }
+
+  function largeResize() {
+    document.getElementById('large-file-spacer').style.height =
+      Math.ceil(large.lineCount * LARGE_LINE_HEIGHT / largeScale()) + 'px';
+  }
+
+  function largeSendEdit() {
+    large.editFrame = 0;
+    window.webkit.messageHandlers.largeFileEdit.postMessage({
+      seq: large.seq,
+      first: large.first,
+      count: large.lines.length,
+      text: largeText.value
+    });
+  }
+
+  function largeFlushEdit() {
+    if (!large.editFrame) return;
+    cancelAnimationFrame(large.editFrame);
+    largeSendEdit();
+  }
+
+  largeScroll.addEventListener('scroll', () => {
+    if (!large.frame) large.frame = requestAnimationFrame(largeRender);
+  });
+
+  largeText.addEventListener('input', () => {
+    large.dirty = true;
+    if (!large.editFrame) large.editFrame = requestAnimationFrame(largeSendEdit);
+  });
+
+  document.getElementById('large-file-edit').addEventListener('click', () => {
+    if (large.truncated || !large.lines.length) return;
+    large.editing = true;
+    large.dirty = false;
+    largeText.value = large.lines.join('\n');
+    document.getElementById('editor-area').classList.add('large-file-editing');
+    largeText.scrollTop = (largeTopLine() - large.first) * LARGE_LINE_HEIGHT;
+    largeText.focus();
+    largeStatus('Editing lines ' + (large.first + 1) + '\u2013' +
+                (large.first + large.lines.length));
+  });
+
+  // Unchanged windows just go back to viewing; edited ones come back
+  // through openLargeFile() once saved and mapped again
+  document.getElementById('large-file-done').addEventListener('click', () => {
+    largeFlushEdit();
+    if (large.dirty) {
+      largeStatus('Saving\u2026');
+      window.webkit.messageHandlers.largeFileDone.postMessage(large.seq);
+      return;
+    }
+    large.editing = false;
+    document.getElementById('editor-area').classList.remove('large-file-editing');
+    largeRender();
+  });
+
+  // lineCount is an estimate until largeFileIndexed() reports the exact one
+  window.openLargeFile = function(seq, lineCount, exact, keepPosition) {
+    const area = document.getElementById('editor-area');
+    if (active) flushDelta(active);
+    area.classList.add('large-file-mode');
+    area.classList.remove('large-file-editing');
+    const top = keepPosition ? largeTopLine() : 0;
+    Object.assign(large, {
+      seq: seq, lineCount: lineCount, exact: exact, first: 0, lines: [],
+      truncated: false, fetching: false, editing: false, dirty: false
+    });
+    largeResize();
+    largeScroll.scrollTop = top * LARGE_LINE_HEIGHT / largeScale();
+    largeRender();
+  };
+
+  window.largeFileIndexed = function(seq, lineCount) {
+    if (seq !== large.seq) return;
+    const top = largeTopLine();
+    large.lineCount = lineCount;
+    large.exact = true;
+    largeResize();
+    largeScroll.scrollTop = top * LARGE_LINE_HEIGHT / largeScale();
+    largeRender();
+  };
+
+  // The edit is kept; Done saves it again
+  window.largeFileSaveFailed = function(seq) {
+    if (seq !== large.seq || !large.editing) return;
+    largeStatus('Not saved \u2013 edits kept, press Done to try again');
+  };
+
+  window.closeLargeFile = function() {
+    largeFlushEdit();
+    large.seq = 0;
+    large.lines = [];
+    const area = document.getElementById('editor-area');
+    area.classList.remove('large-file-mode');
+    area.classList.remove('large-file-editing');
   };
 
   window.updateRecentFiles = function(files) {
@@ -35,16 +511,45 @@ window.addEventListener('load', function() {
       const div = document.createElement('div');
       div.className = 'recent-file';
       div.textContent = file.name;
+      div.title = file.path;
       div.onclick = () => window.webkit.messageHandlers.openFile.postMessage(file.path);
       list.appendChild(div);
     });
   };
 
-  // Setup event listeners
-  editor.on('change', () => {
-    if (window.webkit && window.webkit.messageHandlers.contentChanged) {
-      window.webkit.messageHandlers.contentChanged.postMessage('');
+  window.updateSearchResults = function(results) {
+    const list = document.getElementById('search-results');
+    list.innerHTML = '';
+    results.forEach(result => {
+      const div = document.createElement('div');
+      div.className = 'search-result';
+      const name = document.createElement('div');
+      name.className = 'search-result-name';
+      name.textContent = result.name;
+      // Snippets arrive HTML-escaped with matches wrapped in <mark>
+      const snippet = document.createElement('div');
+      snippet.className = 'search-result-snippet';
+      snippet.innerHTML = result.snippet;
+      div.appendChild(name);
+      div.appendChild(snippet);
+      div.onclick = () => window.webkit.messageHandlers.openFile.postMessage(result.path);
+      list.appendChild(div);
+    });
+  };
+
+  // Search as the user types, once typing pauses
+  let searchTimer = null;
+  document.getElementById('search-input').addEventListener('input', event => {
+    clearTimeout(searchTimer);
+    const query = event.target.value.trim();
+    document.getElementById('recent-files').style.display = query ? 'none' : 'block';
+    if (!query) {
+      window.updateSearchResults([]);
+      return;
     }
+    searchTimer = setTimeout(() => {
+      window.webkit.messageHandlers.search.postMessage(query);
+    }, 120);
   });
 
   // Let the native code know we're ready
@@ -52,19 +557,3 @@ window.addEventListener('load', function() {
     window.webkit.messageHandlers.editorInitialized.postMessage('');
   }
 });
-
-
-window.togglePreview = function(show) {
-    const editorContainer = document.querySelector('.toastui-editor-defaultUI');
-    if (editorContainer) {
-        if (show) {
-            editorContainer.classList.remove('preview-hidden');
-        } else {
-            editorContainer.classList.add('preview-hidden');
-        }
-        // Refresh editor layout
-        if (window.editor) {
-            window.editor.focus();
-        }
-    }
-};
@@ -6,21 +6,719 @@
 #include <cmark.h>
 #include <glib.h>
 #include <glib/gstdio.h>
-
-#define MAX_NOTES 100
-#define MAX_LENGTH 10000
-
-struct Note {
-    char content[MAX_LENGTH];
-    int id;
-};
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <math.h>
+
+// Autosave waits for typing to pause, but never lets edits sit unsaved longer
+// than the maximum delay while typing continues
+#define AUTOSAVE_IDLE_MS 1500
+#define AUTOSAVE_MAX_DELAY_MS 10000
+// After a failed save the retry delay doubles up to this cap
+#define AUTOSAVE_RETRY_MAX_MS 60000
+
+// The editor mirror is flattened once edits have split it into this many pieces
+#define PIECE_TABLE_MAX_PIECES 2048
+
+// Vault scanner tuning: rows are handed to the UI in batches and inserted
+// within a per-frame time budget so the tree fills progressively.
+#define SCAN_BATCH_SIZE 512
+#define SCAN_BATCH_INTERVAL_US 8000
+#define SCAN_FRAME_BUDGET_US 8000
+
+// Filesystem events are coalesced for this long before touching the tree
+#define WATCH_COALESCE_MS 150
+#define WATCH_FRAME_BUDGET_US 8000
+
+// Vault metadata cache
+#define VAULT_META_MAGIC "ENVMETA1"
+#define VAULT_META_VERSION 1
+#define VAULT_META_TITLE_BYTES 4096
+
+// Recent notes on the start page, ranked by frecency
+#define RECENT_FILES_MAX 10
+#define RECENT_MAX_TRACKED 256
+#define RECENT_HALF_LIFE_S (7 * 24 * 60 * 60)
+#define RECENT_OPEN_WEIGHT 1.0
+#define RECENT_SAVE_WEIGHT 0.25
+#define RECENT_SAVE_DELAY_S 5
+
+// Tabs. An editor instance in the page is estimated at a fixed cost plus a
+// multiple of its document for the DOM, ProseMirror state and undo history.
+#define TAB_HOT_MAX 8
+#define TAB_MEMORY_BUDGET_MB 256
+#define TAB_INSTANCE_BYTES (2 * 1024 * 1024)
+#define TAB_DOCUMENT_FACTOR 8
+
+// Session snapshot
+#define SESSION_MAGIC "ENVSESS1"
+#define SESSION_VERSION 1
+#define SESSION_SAVE_DELAY_S 2
+
+// Large-file mode: notes from large_file_threshold_mb up are shown a window
+// of lines at a time, copied straight out of their mapping
+#define LARGE_FILE_THRESHOLD_MB 8
+#define LARGE_FILE_INDEX_STRIDE 64        // lines per line-index checkpoint
+#define LARGE_FILE_WINDOW_MAX_LINES 1000
+#define LARGE_FILE_LINE_MAX_BYTES (64 * 1024)
+#define LARGE_FILE_IO_BYTES (1024 * 1024)
+#define LARGE_FILE_ESTIMATE_BYTES (64 * 1024)
+
+// Toast UI Editor release pinned by the Makefile, for the CDN fallback
+#define TOASTUI_CDN "https://uicdn.toast.com/editor/3.2.2"
+
+// Full-text search index
+#define SEARCH_INDEX_MAGIC "ENVIDX01"
+#define SEARCH_INDEX_VERSION 2
+#define SEARCH_MAX_TOKEN_BYTES 64
+#define SEARCH_MAX_RESULTS 20
+#define SEARCH_SNIPPET_CHARS 160
+#define SEARCH_FRAME_BUDGET_US 8000
+#define SEARCH_SAVE_DELAY_S 60
+#define SEARCH_BM25_K1 1.2f
+#define SEARCH_BM25_B 0.75f
+
+// Link graph
+#define LINK_GRAPH_MAGIC "ENVLINK1"
+#define LINK_GRAPH_VERSION 2
+#define LINK_GRAPH_SAVE_DELAY_S 30
+#define LINK_FRAME_BUDGET_US 8000
+
+// Tags and front matter
+#define META_VALUE_MAX_BYTES 128
+#define META_FILTER_REFRESH_MS 300
+
+// Version history. Chunk boundaries fall where the top HISTORY_CHUNK_BITS
+// bits of the rolling hash are zero, about every 2 KiB past the minimum.
+#define HISTORY_PACK_MAGIC "ENVPACK1"
+#define HISTORY_LOG_MAGIC "ENVHIST1"
+#define HISTORY_ID_BYTES 16
+#define HISTORY_CHUNK_MIN 512
+#define HISTORY_CHUNK_MAX 8192
+#define HISTORY_CHUNK_BITS 11
+#define HISTORY_KEYFRAME_INTERVAL 32
+#define HISTORY_COLLECT_EVERY 200
+#define HISTORY_COLLECT_DELAY_S 120
+
+// Quick open (Ctrl+P)
+#define QUICK_OPEN_MAX_RESULTS 50
+#define QUICK_OPEN_MAX_QUERY 128
+#define QUICK_OPEN_RECENT_MAX 500      // opened notes kept in the config
+
+// One file or directory found by the vault scanner
+typedef struct {
+    char *name;
+    char *path;
+    char *parent;      // NULL for entries directly under the vault root
+    char *sort_key;
+    gboolean is_dir;
+    gint64 mtime;
+    guint64 size;
+} ScanEntry;
+
+typedef struct {
+    guint generation;
+    GPtrArray *entries;
+    gboolean subtree;
+    gboolean cached;      // rows from the vault cache, not yet checked against disk
+    gboolean reconcile;   // rows from disk that may already be in the tree from the cache
+    gboolean done;
+    GPtrArray *removed;   // cached paths the scan did not find, on the last batch
+} ScanBatch;
+
+typedef struct {
+    char *root;
+    guint generation;
+    gboolean subtree;  // rescan of one folder that appeared after the full scan
+    GMappedFile *cache;
+    char *meta_path;   // where the full scan writes the new cache
+} ScanJob;
+
+// Synthetic vault and sampling settings for --bench
+typedef struct {
+    guint notes;
+    guint size;          // mean note size in bytes
+    gdouble spread;      // sigma of the log-normal size distribution
+    guint depth;
+    guint fanout;
+    guint samples;       // notes opened, saved and ranked
+    guint runs;          // full scans of each kind
+    guint seed;
+    gboolean keep;
+} BenchOptions;
+
+// Frecency score of a note as of time (seconds)
+typedef struct {
+    char *path;
+    gdouble score;
+    gint64 time;
+} RecentNote;
+
+// Vault cache file: header, entries in the order the scanner emits rows,
+// then NUL-terminated strings. String offset 0 is the empty string.
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 entry_count;
+    guint64 strings_size;
+} VaultMetaHeader;
+
+typedef struct {
+    gint64 mtime;
+    guint64 size;
+    gint32 parent;       // index of the folder entry, -1 under the vault root
+    guint32 is_dir;
+    guint32 path;        // relative to the vault
+    guint32 name;
+    guint32 sort_key;
+    guint32 title;       // first heading of a note
+} VaultMetaEntry;
+
+typedef struct {
+    gsize vault_length;
+    GArray *entries;         // VaultMetaEntry
+    GByteArray *strings;
+    GHashTable *folders;     // full path -> entry index + 1
+} VaultMetaBuilder;
+
+// On-disk search index: header, doc table, term dictionary sorted by term,
+// postings, then NUL-terminated strings. Offsets are relative to their section.
+// Postings per term are varints: doc id delta, term frequency, byte offset of
+// the first occurrence, position deltas.
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 doc_count;
+    guint32 term_count;
+    guint32 reserved;
+    guint64 total_tokens;
+    guint64 docs_offset;
+    guint64 terms_offset;
+    guint64 postings_offset;
+    guint64 strings_offset;
+} SearchIndexHeader;
+
+typedef struct {
+    gint64 mtime;
+    guint64 size;
+    guint32 path_offset;
+    guint32 length;    // tokens in the note
+} SearchDiskDoc;
+
+typedef struct {
+    guint64 postings_offset;
+    guint32 postings_length;
+    guint32 term_offset;
+    guint32 doc_freq;
+    guint32 reserved;
+} SearchDiskTerm;
+
+// A note indexed since the base file was written
+typedef struct {
+    char *path;
+    gint64 mtime;
+    guint64 size;
+    guint32 length;
+    guint seen_generation;
+    gboolean live;
+} SearchDoc;
+
+typedef struct {
+    GByteArray *bytes;
+    guint32 last_doc;
+    guint32 doc_freq;
+} SearchTermPostings;
+
+typedef struct {
+    char *vault;
+    char *file_path;
+    guint generation;
+    guint sequence;
+
+    // Base segment, mapped from file_path
+    GMappedFile *mapped;
+    const SearchDiskDoc *base_docs;
+    const SearchDiskTerm *base_terms;
+    const guint8 *base_postings;
+    const char *base_strings;
+    guint32 base_count;
+    guint32 base_term_count;
+    guint8 *base_dead;
+    guint *base_seen;            // scan generation that last found each base doc
+    GHashTable *base_paths;      // path -> base doc id + 1
+
+    // Delta segment, doc ids continue after the base ones
+    GPtrArray *docs;             // SearchDoc*
+    GHashTable *doc_paths;       // path -> doc id + 1 of the live delta doc
+    GHashTable *terms;           // term -> SearchTermPostings*
+
+    GHashTable *pending;         // path -> sequence of the newest queued job
+    guint32 live_docs;
+    guint64 live_tokens;
+    gboolean dirty;
+    guint save_id;
+
+    // While a merge runs on a worker the delta is read-only: results wait in
+    // search_results and paths forgotten meanwhile are replayed afterwards
+    gboolean merging;
+    GHashTable *merge_forgotten; // path set
+} SearchIndex;
+
+// Tokenized note on its way from a worker thread to the index
+typedef struct {
+    char *path;
+    char *text;
+    guint generation;
+    guint sequence;
+    gboolean missing;
+    gint64 mtime;
+    guint64 size;
+    guint32 length;
+    GHashTable *terms;           // term -> SearchJobTerm*
+} SearchJob;
+
+// One term's occurrences in a note being indexed
+typedef struct {
+    guint32 offset;              // byte offset of the first occurrence
+    GArray *positions;           // guint32 token positions
+} SearchJobTerm;
+
+// The base file and the delta merged into a new base file. The doc table is
+// built on the main thread; the postings are merged and written on a worker.
+typedef struct {
+    SearchIndex *index;
+    guint32 *remap;              // old doc id -> new doc id, or G_MAXUINT32
+    GByteArray *docs;
+    GString *strings;
+    GPtrArray *delta_terms;      // keys of index->terms, sorted
+    guint32 doc_count;
+    guint64 total_tokens;
+} SearchMerge;
+
+// Result snippets of one query, read from the notes on a worker
+typedef struct {
+    guint sequence;
+    GPtrArray *groups;
+    GPtrArray *paths;
+    GArray *offsets;             // guint32 hit offsets
+} SearchSnippets;
+
+// Link graph file: header, LinkGraphNote records, guint32 target string
+// offsets for each note's edges, then NUL-terminated strings
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 note_count;
+    guint32 edge_count;
+    guint32 strings_size;
+} LinkGraphHeader;
+
+typedef struct {
+    gint64 mtime;
+    guint64 size;
+    guint32 path;
+    guint32 first_edge;
+    guint32 edge_count;
+    guint32 reserved;
+} LinkGraphNote;
+
+// A note path, or a wikilink name as "[[name"
+typedef struct {
+    char *key;
+    gboolean note;               // a note whose links have been extracted
+    gint64 mtime;
+    guint64 size;
+    guint seen_generation;
+    GArray *out;                 // guint32 vertices this note links to
+    GArray *in;                  // guint32 notes linking here
+} LinkVertex;
+
+typedef struct {
+    char *vault;
+    char *file_path;
+    GPtrArray *vertices;         // LinkVertex*, indexed by id
+    GHashTable *ids;             // key -> id + 1
+    GHashTable *pending;         // path -> sequence of the newest queued job
+    guint generation;
+    guint sequence;
+    gboolean dirty;
+    guint save_id;
+    // The saved graph is read on a worker; until it is in, scanner checks
+    // and the end-of-scan prune wait here and results stay queued
+    gboolean loading;
+    GArray *deferred_checks;     // LinkCheck
+    gboolean prune_deferred;
+} LinkGraph;
+
+typedef struct {
+    char *path;
+    gint64 mtime;
+    guint64 size;
+} LinkCheck;
+
+// Links of one note on their way from a worker thread to the graph
+typedef struct {
+    char *path;
+    char *text;
+    guint generation;
+    guint sequence;
+    gboolean missing;
+    gint64 mtime;
+    guint64 size;
+    guint64 size_limit;          // notes this large are not read for links
+    GPtrArray *targets;          // vertex keys, each once
+} LinkJob;
+
+// A tag query being evaluated: one bit per graph vertex
+typedef struct {
+    const char *cursor;
+    LinkGraph *graph;
+    guint words;
+    guint64 *notes;              // every note, what NOT is taken against
+    gboolean failed;
+} MetaQuery;
+
+// A rename whose links are being rewritten
+typedef struct {
+    char *old_path;
+    char *new_path;
+    gboolean is_dir;
+    char *old_key;               // "[[name" of a renamed note
+    char *new_name;              // its name for [[wikilinks]], NULL to leave them
+    GPtrArray *files;            // RenameFile*
+    guint done;
+    char *error;                 // first failure; the rename is then abandoned
+    gint64 started;
+} RenameOp;
+
+typedef struct {
+    RenameOp *op;
+    char *path;                  // where the note is before the rename
+    char *temp_path;             // its rewritten text, NULL when unchanged
+    char *error;
+} RenameFile;
+
+typedef struct {
+    const guint8 *next;
+    const guint8 *end;
+    const guint8 *positions;
+    guint32 doc;
+    guint32 tf;
+    guint32 offset;
+} SearchCursor;
+
+typedef struct {
+    guint32 doc;
+    gfloat score;
+    guint32 offset;    // of the first query word, for the snippet
+} SearchHit;
+
+// Native copy of the open note, kept current from the editor's edit deltas.
+// Text is the original buffer plus an append-only buffer of inserted text;
+// pieces list which spans of either make up the document, in order.
+typedef struct {
+    gboolean added;    // span is in added rather than original
+    gsize start;
+    gsize length;
+} Piece;
+
+typedef struct {
+    GBytes *original;
+    GString *added;
+    GArray *pieces;    // Piece
+    gsize length;
+} PieceTable;
+
+// Where a note's editor was: cursor and selection as 1-based line and
+// column (0 when unknown), scroll offsets in pixels
+typedef struct {
+    guint32 anchor_line;
+    guint32 anchor_ch;
+    guint32 head_line;
+    guint32 head_ch;
+    gint32 scroll_top;
+    gint32 preview_top;
+} SessionView;
+
+// A note open in the tab strip. A hot tab keeps its editor instance in the
+// page, with its own undo history and scroll position, and its mirror here
+// while another tab is active. A cold one is read from disk again when shown.
+typedef struct {
+    guint id;                // editor instance in the page
+    char *path;
+    GtkWidget *page;
+    GtkWidget *label;
+    gboolean hot;
+    gboolean saved;
+    guint edit_seq;
+    guint64 last_used;       // tab_clock when it was last activated
+    PieceTable mirror;       // the editor mirror while the tab is inactive
+    guint mirror_seq;
+    gboolean mirror_valid;
+    gsize bytes;             // document size, for the memory estimate
+    SessionView view;        // as last reported by the page
+    gboolean view_pending;   // apply view when the note is next loaded
+} EditorTab;
+
+// Session file: header, SessionTab records in tab order, guint32 string
+// offsets of the expanded folders, then NUL-terminated strings
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 tab_count;
+    guint32 active;          // index of the active tab, G_MAXUINT32 for none
+    guint32 expanded_count;
+    guint32 vault;
+    guint32 tree_anchor;     // top row of the file tree, G_MAXUINT32 for none
+    guint32 strings_size;
+    guint32 reserved;
+} SessionHeader;
+
+typedef struct {
+    guint32 path;
+    guint32 reserved;
+    SessionView view;
+} SessionTab;
+
+// Tabs of the saved session, until they are reopened
+typedef struct {
+    GPtrArray *paths;
+    GArray *views;           // SessionView
+    guint active;
+} SessionRestore;
+
+// A note open in large-file mode. Only windows of lines are copied out of
+// the mapping; the line index keeps every LARGE_FILE_INDEX_STRIDE-th line
+// start, filled in by the background scan as it goes.
+typedef struct {
+    char *path;
+    guint seq;                 // numbered along with editor_document_seq
+    GBytes *bytes;             // the mapped note
+    GArray *checkpoints;       // guint64 line starts, grown under large_file_index_lock
+    gboolean indexed;          // checkpoints cover the whole note
+    guint64 line_count;
+    GCancellable *index_cancellable;
+    GPtrArray *waiting;        // LargeFileWindow fetches past the checkpoints so far
+    // The one window being edited, as a byte range of bytes
+    gboolean editing;
+    gsize edit_start;
+    gsize edit_end;
+    char *edit_text;           // its newest text, NULL until changed
+    gboolean edit_pending;     // edit_text changed since its last save started
+    gboolean reopen;           // map the note again once the edit is saved
+} LargeFile;
+
+typedef struct {
+    GBytes *bytes;
+    GArray *checkpoints;       // the LargeFile's own, appended to a block at a time
+    guint64 line_count;
+} LargeFileIndex;
+
+typedef struct {
+    WebKitURISchemeRequest *request;
+    guint64 first;
+    guint count;
+} LargeFileWindow;
+
+// One top-level block of the native preview, keyed by a hash of its source
+typedef struct {
+    guint64 hash;
+    char *html;
+} PreviewBlock;
+
+typedef struct {
+    const char *text;  // preview_text, left alone while the job runs
+    gsize length;
+    GArray *known;     // guint64 hashes of the blocks in the preview
+    GArray *blocks;    // PreviewBlock; html is NULL for blocks already known
+    gint64 elapsed_us;
+} PreviewJob;
+
+// What a note looked like on disk when we last read or wrote it
+typedef struct {
+    guint64 hash;
+    gint64 mtime;
+    guint64 size;
+} NoteFileState;
+
+typedef struct {
+    char *path;
+    guint seq;
+    NoteFileState state;
+    gint64 trace_start;
+    gboolean large;    // mapped as is for large-file mode
+} NoteLoad;
+
+typedef struct {
+    char *path;
+    guint edit_seq;    // edit_seq when the content was taken from the editor
+    char *content;
+    gsize length;
+    // Large-file mode: content replaces base_start..base_end of base, and the
+    // rest is streamed from base
+    GBytes *base;
+    gsize base_start;
+    gsize base_end;
+    GFileSetContentsFlags flags;
+    gboolean have_known;
+    NoteFileState known;
+    // Filled in by the worker
+    gboolean skipped;
+    NoteFileState state;
+    gint64 elapsed_us;
+    gint64 trace_start;
+} NoteSave;
+
+// Note paths for quick open, relative to the vault
+typedef struct {
+    guint32 offset;      // into text
+    guint32 length;
+    guint32 name_start;  // where the file name begins
+    guint opened;        // quick_open_clock when last opened, 0 if never
+} QuickOpenEntry;
+
+typedef struct {
+    GString *text;          // lowercased paths, NUL separated
+    GArray *entries;        // QuickOpenEntry
+    GArray *masks;          // guint64 per entry, see quick_open_char_bit()
+    GPtrArray *full_paths;  // absolute paths in original case
+} QuickOpenPaths;
+
+typedef struct {
+    guint32 id;
+    gint score;
+} QuickOpenHit;
+
+// Version history: chunks are named by a truncated SHA-256 of their bytes
+typedef struct {
+    guint8 bytes[HISTORY_ID_BYTES];
+} HistoryId;
+
+typedef struct {
+    HistoryId id;
+    guint64 offset;          // of the stored bytes in the pack
+    guint32 length;
+    guint32 stored_length;
+    gboolean compressed;
+} HistoryChunk;
+
+// A keyframe lists every chunk of the note. Other versions keep the first
+// `prefix` and last `suffix` chunks of the version before and put ids between.
+typedef struct {
+    gint64 time;
+    guint64 size;
+    HistoryId content;       // hash of the whole note
+    gboolean keyframe;
+    guint32 prefix;
+    guint32 suffix;
+    GArray *ids;             // HistoryId
+} HistoryVersion;
+
+// Pack file: magic, then a record followed by its stored bytes per chunk
+typedef struct {
+    HistoryId id;
+    guint32 length;
+    guint32 stored_length;
+    guint8 compressed;
+    guint8 reserved[7];
+} HistoryPackRecord;
+
+// Version log: magic, then a record followed by the note path relative to
+// the vault and `count` chunk ids per version
+typedef struct {
+    guint32 record_length;
+    guint32 path_length;
+    gint64 time;
+    guint64 size;
+    HistoryId content;
+    guint32 prefix;
+    guint32 suffix;
+    guint32 count;
+    guint32 keyframe;
+} HistoryLogRecord;
+
+typedef struct {
+    char *vault;
+    char *pack_path;
+    char *log_path;
+    int pack_fd;
+    int log_fd;
+    guint64 pack_size;
+    guint64 log_size;
+    GHashTable *chunks;      // HistoryId* -> HistoryChunk*
+    GHashTable *notes;       // relative path -> GPtrArray of HistoryVersion*, oldest first
+    guint appends;           // versions added since the last collection
+} HistoryStore;
+
+// Work for the history thread. An open job switches the store to vault
+// (none closes it); otherwise no path means collect.
+typedef struct {
+    char *path;
+    char *content;
+    gsize length;
+    gint keep_days;
+    gint keep_versions;
+    gboolean open;
+    char *vault;
+} HistoryJob;
+
+// The versions of one note, listed for the browser on a worker
+typedef struct {
+    char *vault;
+    char *relative;
+    char *path;
+    GArray *versions;        // HistoryListed, newest first
+} HistoryList;
+
+typedef struct {
+    gint64 time;
+    guint64 size;
+    HistoryId content;
+} HistoryListed;
+
+typedef struct {
+    char *vault;
+    char *relative;
+    HistoryId content;
+    guint request;
+} HistoryRead;
+
+typedef struct {
+    char *vault;
+    char *relative;
+    GtkListStore *store;     // time, size, index into contents
+    GtkWidget *view;
+    GtkTextBuffer *buffer;
+    GtkWidget *restore_button;
+    GCancellable *cancellable;
+    GBytes *selected;        // content of the selected version once read
+    guint request;
+    GArray *contents;        // HistoryId per row
+} HistoryBrowser;
+
+// One --trace span, or an instant event when duration is -1
+typedef struct {
+    const char *category;    // static or interned strings
+    const char *name;
+    gint64 start;            // microseconds since trace_origin
+    gint64 duration;
+    guint thread;
+} TraceEvent;
+
+// Script evaluation being timed until its reply arrives
+typedef struct {
+    const char *name;
+    gint64 start;
+    GAsyncReadyCallback callback;
+    gpointer user_data;
+} TraceScript;
 
 // Global variables
-struct Note notes[MAX_NOTES];
-int noteCount = 0;
 GtkWidget *window;
 GtkWidget *web_view;
-GtkWidget *list_box;
 GtkWidget *file_tree;
 char *vault_directory = NULL;
 GtkTreeStore *tree_store;
@@ -38,23 +736,241 @@ gboolean dark_mode_enabled = FALSE;
 char *config_file_path = NULL;
 GSettings *settings;
 gboolean preview_hidden = TRUE;  // Default to hidden preview
+gboolean editor_cdn_fallback = FALSE;  // load Toast UI from its CDN if not bundled
 GtkWidget *preview_toggle_switch;
 GtkCssProvider *css_provider = NULL;
 
+// Background vault scan state
+GCancellable *scan_cancellable = NULL;
+guint scan_generation = 0;
+GAsyncQueue *scan_queue = NULL;
+gint scan_drain_scheduled = 0;
+ScanBatch *scan_current_batch = NULL;
+guint scan_current_index = 0;
+gboolean scan_in_progress = FALSE;
+char *pending_tree_selection = NULL;
+// path -> GtkTreeIter* for every row. GtkTreeStore iters stay valid until their
+// row is removed, and unlike GtkTreeRowReference they cost nothing per insert.
+GHashTable *file_tree_index = NULL;
+
+// Vault cache of the open vault, replaced after every full scan
+GMappedFile *vault_meta = NULL;
+char *vault_meta_path = NULL;
+
+// Recent notes, loaded on first use
+GPtrArray *recent_notes = NULL;   // RecentNote*, unordered
+char *recent_file_path = NULL;
+guint recent_save_id = 0;
+
+// Vault watcher state
+GHashTable *vault_monitors = NULL;  // directory path -> GFileMonitor*
+GHashTable *watch_pending = NULL;   // paths to reconcile with disk
+GHashTable *watch_renames = NULL;   // old path -> new path
+GPtrArray *watch_work = NULL;       // pending paths being applied, folders first
+guint watch_work_index = 0;
+guint watch_flush_id = 0;
+char *scroll_anchor_path = NULL;
+
+// Link graph of the open vault, and the backlinks panel showing it
+LinkGraph *link_graph = NULL;
+guint link_generation = 0;
+GThreadPool *link_pool = NULL;
+GAsyncQueue *link_results = NULL;
+gint link_drain_scheduled = 0;
+GtkWidget *backlinks_expander = NULL;
+GtkWidget *backlinks_list = NULL;
+guint backlinks_refresh_id = 0;
+
+// Tag filter: a second view of the file tree narrowed to a query's notes
+GtkWidget *file_tree_scroll = NULL;
+GtkWidget *meta_filter_entry = NULL;
+GtkWidget *meta_filter_scroll = NULL;
+GtkTreeView *meta_filter_view = NULL;
+GtkTreeModel *meta_filter_model = NULL;
+GHashTable *meta_filter_paths = NULL;   // matching notes and their folders; NULL when off
+guint meta_filter_refresh_id = 0;
+
+// Link-aware rename in progress, and the bar showing it
+RenameOp *rename_op = NULL;
+GThreadPool *rename_pool = NULL;
+GAsyncQueue *rename_results = NULL;
+gint rename_drain_scheduled = 0;
+GtkWidget *rename_progress = NULL;
+
+// Full-text search state
+SearchIndex *search_index = NULL;
+guint search_generation = 0;
+GThreadPool *search_pool = NULL;
+GAsyncQueue *search_results = NULL;
+gint search_drain_scheduled = 0;
+guint search_query_sequence = 0;
+
+// Note content waiting to be fetched by the editor from envelope://app/document/<seq>
+GBytes *editor_document = NULL;
+guint editor_document_seq = 0;
+gboolean editor_ready = FALSE;
+
+// Editor assets by name, from the compiled-in bundle or the assets directory
+GHashTable *asset_cache = NULL;
+
+// Mirror of the document with sequence editor_mirror_seq
+PieceTable editor_mirror = { 0 };
+guint editor_mirror_seq = 0;
+gboolean editor_mirror_valid = TRUE;
+
+// Open tabs; the notebook keeps their order in the strip
+GPtrArray *editor_tabs = NULL;     // EditorTab*
+EditorTab *tab_active = NULL;
+GtkWidget *tab_notebook = NULL;
+guint tab_next_id = 1;
+guint64 tab_clock = 0;
+gboolean tab_switching = FALSE;    // notebook changes made by the tab code itself
+gint tab_hot_max = TAB_HOT_MAX;
+gint tab_memory_budget_mb = TAB_MEMORY_BUDGET_MB;
+
+// Note open in large-file mode, and the one left last, whose final window
+// edits may still be on their way from the page
+LargeFile *large_file = NULL;
+LargeFile *large_file_closed = NULL;
+gint large_file_threshold_mb = LARGE_FILE_THRESHOLD_MB;
+GMutex large_file_index_lock;      // checkpoints while their scan is running
+
+// Native preview: blocks currently in the page, in order
+GArray *preview_blocks = NULL;     // PreviewBlock
+gboolean preview_running = FALSE;
+GString *preview_text = NULL;      // the mirror as last rendered, kept for its buffer
+gboolean preview_dirty = FALSE;    // the mirror changed during the running render
+
+// Note being read on a worker thread; it becomes current_file_path once loaded
+GCancellable *note_load_cancellable = NULL;
+char *note_load_path = NULL;
+guint note_load_seq = 0;
+
+// Save engine state
+GHashTable *note_file_states = NULL;   // path -> NoteFileState*
+char *save_durability = NULL;          // "fast", "consistent" or "durable"
+guint save_count = 0;
+guint save_skipped_count = 0;
+gint64 save_last_us = 0;
+gint64 save_max_us = 0;
+
+// Edits are numbered so a save only marks the note clean if nothing was typed
+// after its snapshot. Snapshots are written one at a time.
+guint edit_seq = 0;
+gint64 autosave_dirty_since = 0;
+guint autosave_failures = 0;           // failed saves since the last success
+guint save_snapshots_pending = 0;      // getMarkdown() replies not yet received
+NoteSave *save_running = NULL;
+GQueue save_queue = G_QUEUE_INIT;      // NoteSave* waiting for save_running
+
+// Quick open state
+QuickOpenPaths quick_open_paths = { 0 };
+gboolean quick_open_dirty = TRUE;
+GArray *quick_open_candidates = NULL;   // ids matching quick_open_last_query
+char *quick_open_last_query = NULL;
+GHashTable *quick_open_recent = NULL;   // path -> quick_open_clock when opened
+guint quick_open_clock = 0;
+gboolean quick_open_recent_changed = FALSE;   // since copied into the entries
+GtkWidget *quick_open_window = NULL;
+GtkWidget *quick_open_entry = NULL;
+GtkListStore *quick_open_store = NULL;
+GtkTreeView *quick_open_view = NULL;
+
+// Version history of the open vault. The store is loaded, appended to and
+// collected on history_pool's one thread, and only touched with history_lock
+// held; the main thread never takes the lock and knows only history_vault.
+HistoryStore *history = NULL;
+GMutex history_lock;
+GThreadPool *history_pool = NULL;
+char *history_vault = NULL;
+gint history_keep_days = 30;
+gint history_keep_versions = 50;
+guint64 history_gear[256];
+guint history_collect_id = 0;
+
+// Tracing, only active when started with --trace=FILE
+char *trace_path = NULL;
+GArray *trace_events = NULL;            // TraceEvent
+GHashTable *trace_threads = NULL;       // GThread* -> thread number
+GArray *trace_message_starts = NULL;    // gint64 per script message being handled
+GMutex trace_lock;
+gint64 trace_origin = 0;
+gint64 trace_scan_start = 0;
+gint64 trace_note_open_start = 0;       // note pick until the editor shows it
+
+// Startup: the window paints before the vault and last note are opened.
+// Milestones are printed with --measure-startup.
+gint64 startup_origin = 0;
+gboolean startup_measure = FALSE;
+gboolean startup_painted = FALSE;
+gboolean startup_done = FALSE;
+gboolean startup_waiting_for_note = FALSE;  // last note from the config not shown yet
+char *startup_last_file = NULL;
+
+// Session snapshot, and what of it is still to be put back
+char *session_file_path = NULL;
+guint session_save_id = 0;
+SessionRestore *session_restore = NULL;
+GHashTable *session_expand_pending = NULL;
+char *session_tree_anchor = NULL;
+
 // Function prototypes
 // Basic note operations
 void add_note(GtkWidget *widget, gpointer data);
-void delete_note(GtkWidget *widget, gpointer data);
-void note_selected(GtkListBox *box, GtkListBoxRow *row, gpointer data);
-void update_notes_list();
 
 // Editor operations
 void load_editor();
-void get_editor_content(GtkWidget *widget, gpointer data);
-void handle_editor_content(GObject *source_object, GAsyncResult *result, gpointer user_data);
 void show_editor();
 void show_start_page();
 void setup_css_provider(void);
+void editor_load_document(GBytes *bytes);
+void editor_request_document();
+void envelope_scheme_request(WebKitURISchemeRequest *request, gpointer user_data);
+
+// Editor mirror
+void piece_table_reset(PieceTable *table, GBytes *bytes);
+gboolean piece_table_replace(PieceTable *table, gsize offset, gsize delete_length,
+                             const char *insert, gsize insert_length);
+char* piece_table_to_string(PieceTable *table);
+void piece_table_copy_to(PieceTable *table, GString *buffer);
+void piece_table_clear(PieceTable *table);
+void editor_mirror_resync();
+void handle_content_delta(WebKitUserContentManager *manager,
+                          WebKitJavascriptResult *js_result,
+                          gpointer user_data);
+void handle_content_reset(WebKitUserContentManager *manager,
+                          WebKitJavascriptResult *js_result,
+                          gpointer user_data);
+
+// Native preview
+void preview_block_clear(gpointer data);
+void preview_schedule();
+void preview_start();
+void preview_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void preview_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void preview_job_free(PreviewJob *job);
+
+// Note loading
+void note_load_start(const char *path);
+void note_load_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+GBytes* note_normalize_text(GBytes *bytes);
+void note_load_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void note_load_free(NoteLoad *load);
+
+// Note saving
+guint64 content_hash64(const void *data, gsize length);
+gint64 stat_mtime_ns(const GStatBuf *st);
+void note_file_state_record(const char *path, const NoteFileState *state);
+gboolean note_file_changed_on_disk(const char *path);
+void note_load_cancel();
+GFileSetContentsFlags save_durability_flags();
+void note_save_start(const char *path, char *content, guint seq);
+void note_save_queue(NoteSave *save);
+void note_save_run(NoteSave *save);
+void note_save_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void note_save_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void note_save_free(NoteSave *save);
+void update_save_stats();
 
 
 // File operations
@@ -67,7 +983,9 @@ void delete_file(GtkWidget *menuitem, gpointer userdata);
 
 // Asset management
 char* get_asset_path(const char* filename);
-char* get_file_contents(const char* path);
+GBytes* asset_lookup(const char *name);
+gboolean asset_available(const char *name);
+const char* asset_content_type(const char *name);
 
 // UI handlers
 void show_error_dialog(const char *message);
@@ -79,8 +997,371 @@ gboolean on_tree_button_press(GtkWidget *widget, GdkEventButton *event, gpointer
 void update_vault_label();
 void update_recent_files();
 
+// Vault scanning
+void scan_start(const char *root, gboolean subtree);
+ScanBatch* scan_batch_new(ScanJob *job);
+void scan_vault_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void scan_flush_batch(ScanBatch *batch);
+gboolean scan_drain_batches(gpointer user_data);
+void scan_apply_entry(ScanBatch *batch, ScanEntry *entry);
+gint scan_entry_compare(gconstpointer a, gconstpointer b);
+void scan_entry_free(ScanEntry *entry);
+void scan_batch_free(ScanBatch *batch);
+void scan_job_free(ScanJob *job);
+void scan_emit_cached(ScanJob *job, const VaultMetaHeader *cache);
+
+// Recent notes
+void recent_note_free(RecentNote *note);
+gdouble recent_score(const RecentNote *note, gint64 now);
+void recent_load();
+gboolean recent_save(gpointer user_data);
+void recent_flush();
+void recent_schedule_save();
+void recent_touch(const char *path, gdouble weight);
+void recent_rename(const char *old_path, const char *new_path);
+gint recent_compare(gconstpointer a, gconstpointer b, gpointer user_data);
+char* recent_files_json(const char *vault, guint limit);
+
+// Benchmarks
+gdouble bench_gaussian(GRand *rand);
+char* bench_note_text(GRand *rand, guint number, const BenchOptions *options);
+GPtrArray* bench_generate_vault(const char *vault, const BenchOptions *options);
+void bench_remove_tree(const char *path);
+gint bench_compare_us(gconstpointer a, gconstpointer b);
+void bench_report(const char *name, GArray *latencies, guint64 items, const char *extra);
+guint bench_scan(const char *vault, gint64 *first_rows_us);
+void bench_scans(const char *vault, const BenchOptions *options, gboolean warm);
+void bench_open(GPtrArray *sample);
+void bench_save(GPtrArray *sample);
+void bench_listing(GPtrArray *sample, guint iterations);
+void bench_config(guint iterations);
+gboolean bench_parse_options(const char *spec, BenchOptions *options);
+int bench_run(const char *spec);
+
+// Vault metadata cache
+const VaultMetaHeader* vault_meta_validate(GMappedFile *mapped);
+const VaultMetaEntry* vault_meta_entries(const VaultMetaHeader *header);
+const char* vault_meta_strings(const VaultMetaHeader *header);
+void vault_meta_open(const char *vault);
+char* vault_meta_read_title(const char *path);
+guint32 vault_meta_builder_string(VaultMetaBuilder *builder, const char *text);
+VaultMetaBuilder* vault_meta_builder_new(const char *vault);
+void vault_meta_builder_add(VaultMetaBuilder *builder, ScanEntry *entry, const char *title);
+gboolean vault_meta_builder_write(VaultMetaBuilder *builder, const char *path);
+void vault_meta_builder_free(VaultMetaBuilder *builder);
+
+// File tree updates
+gboolean path_has_prefix(const char *path, const char *prefix);
+gboolean vault_path_is_listed(const char *path, gboolean *is_dir);
+gboolean file_tree_find_path(const char *path, GtkTreeIter *iter);
+gboolean file_tree_select_path(const char *path);
+gint file_tree_sorted_position(GtkTreeIter *parent, const char *sort_key, gboolean is_dir);
+void file_tree_insert_row(GtkTreeIter *iter, GtkTreeIter *parent, gint position,
+                          const char *name, const char *path, gboolean is_dir,
+                          const char *sort_key);
+void file_tree_select_iter(GtkTreeIter *iter);
+gboolean file_tree_add_path(const char *path);
+void file_tree_remove_iter(GtkTreeIter *iter);
+void file_tree_forget_rows(GtkTreeIter *iter);
+void file_tree_rebase_children(GtkTreeIter *parent, const char *old_prefix, const char *new_prefix);
+gboolean file_tree_move_path(const char *old_path, const char *new_path);
+void file_tree_rename_open_path(const char *old_path, const char *new_path);
+void file_tree_save_scroll_anchor();
+void file_tree_restore_scroll_anchor();
+
+// Vault watching
+void vault_monitor_free(gpointer monitor);
+void watch_directory(const char *dir_path);
+void watch_reset();
+void vault_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                           GFileMonitorEvent event_type, gpointer user_data);
+void watch_schedule_flush();
+void watch_queue_path(const char *path);
+void watch_queue_rename(const char *old_path, const char *new_path);
+void watch_flush_now();
+gint watch_path_compare(gconstpointer a, gconstpointer b);
+gboolean watch_flush(gpointer user_data);
+
+// Full-text search
+void varint_append(GByteArray *out, guint32 value);
+const guint8* varint_read(const guint8 *p, const guint8 *end, guint32 *value);
+gboolean search_next_token(const char **cursor, const char *end, GString *token,
+                           const char **token_start, const char **token_end);
+gboolean search_cursor_next(SearchCursor *cursor);
+guint32 search_term_cursors(SearchIndex *index, const char *term,
+                            SearchCursor *base, SearchCursor *delta);
+gboolean search_doc_live(SearchIndex *index, guint32 doc);
+guint32 search_doc_length(SearchIndex *index, guint32 doc);
+const char* search_doc_path(SearchIndex *index, guint32 doc);
+gboolean search_index_map(SearchIndex *index);
+void search_index_unmap(SearchIndex *index);
+void search_doc_free(SearchDoc *doc);
+void search_term_postings_free(SearchTermPostings *postings);
+void search_index_reset_delta(SearchIndex *index);
+void search_index_open(const char *vault);
+void search_index_close();
+void search_index_queue(const char *path, const char *text);
+void search_index_check(const char *path, gint64 mtime, guint64 size);
+void search_index_forget(SearchIndex *index, const char *path);
+void search_index_remove_path(const char *path);
+void search_index_prune_unseen();
+void search_job_free(SearchJob *job);
+void search_job_term_free(SearchJobTerm *term);
+void search_job_run(gpointer data, gpointer user_data);
+gboolean search_drain_results(gpointer user_data);
+void search_index_apply(SearchJob *job);
+void search_index_schedule_save(SearchIndex *index);
+gboolean search_index_save_timeout(gpointer user_data);
+guint32 search_merge_postings(SearchIndex *index, SearchCursor *cursor, const guint32 *remap,
+                              GByteArray *out, guint32 *last_doc);
+gint search_term_compare(gconstpointer a, gconstpointer b);
+SearchMerge* search_merge_prepare(SearchIndex *index);
+gboolean search_merge_write(SearchMerge *merge, GError **error);
+void search_merge_finish(SearchMerge *merge, gboolean saved);
+void search_merge_free(SearchMerge *merge);
+void search_merge_thread(GTask *task, gpointer source_object, gpointer task_data,
+                         GCancellable *cancellable);
+void search_merge_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void search_index_save_start(SearchIndex *index);
+gboolean search_index_save(SearchIndex *index);
+gint search_hit_compare(gconstpointer a, gconstpointer b);
+GPtrArray* search_parse_query(const char *query);
+gfloat search_bm25(gfloat idf, guint32 tf, guint32 length, gfloat avg_length);
+gfloat search_idf(SearchIndex *index, guint32 doc_freq);
+void search_read_positions(SearchCursor *cursor, GArray *out);
+GArray* search_index_query(SearchIndex *index, GPtrArray *groups, guint limit);
+void json_append_escaped(GString *out, const char *text);
+gboolean search_group_has_word(GPtrArray *groups, const char *word);
+char* search_build_snippet(const char *path, guint32 offset, GPtrArray *groups);
+void search_snippets_free(SearchSnippets *snippets);
+void search_snippets_thread(GTask *task, gpointer source_object, gpointer task_data,
+                            GCancellable *cancellable);
+void search_snippets_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+
+// Link graph
+char* link_name_key(const char *name);
+void link_add_target(GPtrArray *targets, GHashTable *seen, char *key);
+void link_scan_wikilinks(const char *text, GPtrArray *targets, GHashTable *seen);
+char* link_resolve_url(const char *dir, const char *url);
+GPtrArray* link_extract(const char *path, const char *text, gsize length);
+guint32 link_graph_vertex(LinkGraph *graph, const char *key);
+void link_vertex_free(LinkVertex *vertex);
+void link_graph_add_edge(LinkGraph *graph, guint32 from, guint32 to);
+void link_graph_clear_note(LinkGraph *graph, guint32 id);
+void link_graph_open(const char *vault);
+void link_graph_close();
+gboolean link_graph_load(LinkGraph *graph);
+void link_graph_load_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void link_graph_load_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void link_graph_free_loaded(LinkGraph *loaded);
+void link_check_clear(gpointer data);
+gboolean link_graph_save(LinkGraph *graph);
+void link_graph_schedule_save(LinkGraph *graph);
+gboolean link_graph_save_timeout(gpointer user_data);
+void link_graph_queue(const char *path, const char *text);
+void link_graph_check(const char *path, gint64 mtime, guint64 size);
+void link_graph_remove_path(const char *path);
+void link_graph_prune_unseen();
+void link_job_free(LinkJob *job);
+void link_job_run(gpointer data, gpointer user_data);
+gboolean link_drain_results(gpointer user_data);
+void link_graph_apply(LinkJob *job);
+GPtrArray* link_graph_backlinks(const char *path);
+void backlinks_schedule_refresh();
+gint backlinks_compare(gconstpointer a, gconstpointer b);
+gboolean backlinks_refresh(gpointer user_data);
+void backlinks_row_activated(GtkListBox *box, GtkListBoxRow *row, gpointer data);
+
+// Tags and front matter
+char* meta_term_key(const char *field, const char *value);
+void meta_add_term(GPtrArray *targets, GHashTable *seen, const char *field, const char *value);
+gsize meta_extract_front_matter(const char *text, gsize length, GPtrArray *targets, GHashTable *seen);
+void meta_scan_tags(const char *text, GPtrArray *targets, GHashTable *seen);
+char* meta_query_token(MetaQuery *query, gboolean *quoted);
+gboolean meta_query_accept(MetaQuery *query, const char *keyword);
+gboolean meta_query_chain_ends(MetaQuery *query);
+guint64* meta_query_operand(MetaQuery *query);
+guint64* meta_query_and(MetaQuery *query);
+guint64* meta_query_or(MetaQuery *query);
+GPtrArray* meta_query_run(const char *text);
+gboolean meta_filter_visible(GtkTreeModel *model, GtkTreeIter *iter, gpointer data);
+void meta_filter_apply();
+void meta_filter_changed(GtkSearchEntry *entry, gpointer data);
+void meta_filter_schedule_refresh();
+gboolean meta_filter_refresh_timeout(gpointer user_data);
+void meta_filter_selection_changed(GtkTreeSelection *selection, gpointer data);
+
+// Link-aware rename
+char* rename_map(const RenameOp *op, const char *path);
+char* rename_relative_path(const char *from_dir, const char *to_path);
+char* rename_wikilink_target(const RenameOp *op, const char *target);
+char* rename_link_url(const RenameOp *op, const char *dir, const char *new_dir,
+                      const char *url, gboolean angle);
+char* rename_rewrite_links(const RenameOp *op, const char *path, const char *text);
+void rename_file_run(gpointer data, gpointer user_data);
+gboolean rename_drain_results(gpointer user_data);
+void rename_file_free(RenameFile *file);
+void rename_op_free(RenameOp *op);
+void rename_start(const char *old_path, const char *new_path, gboolean is_dir);
+void rename_finish(RenameOp *op);
+
+// Large-file mode
+void large_file_open(const char *path, GBytes *bytes, gboolean keep_position);
+void large_file_close();
+void large_file_free(LargeFile *file);
+void large_file_reopen();
+void large_file_save_failed(NoteSave *save, GError *error);
+void large_file_release(const char *data, gsize length);
+gboolean large_file_line_offset(LargeFile *file, guint64 line, guint64 *offset);
+gsize large_file_skip_lines(LargeFile *file, gsize offset, guint64 lines);
+GBytes* large_file_window_json(LargeFile *file, guint64 first, guint count);
+void large_file_serve_window(LargeFile *file, WebKitURISchemeRequest *request,
+                             guint64 first, guint count);
+void large_file_finish_waiting(LargeFile *file);
+void large_file_save(LargeFile *file, guint seq);
+void large_file_index_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void large_file_index_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void large_file_index_free(LargeFileIndex *index);
+gboolean note_save_write_splice(NoteSave *save, GError **error);
+gboolean large_file_stream_range(int fd, const char *base, gsize start, gsize end, guint64 *offset);
+void handle_large_file_edit(WebKitUserContentManager *manager,
+                            WebKitJavascriptResult *js_result,
+                            gpointer user_data);
+void handle_large_file_done(WebKitUserContentManager *manager,
+                            WebKitJavascriptResult *js_result,
+                            gpointer user_data);
+
+// Tabs
+EditorTab* tab_find(const char *path);
+EditorTab* tab_for_seq(guint seq);
+EditorTab* tab_add(const char *path);
+void tab_open(const char *path);
+void tab_stash(EditorTab *tab);
+void tab_activate(EditorTab *tab);
+void tab_close(EditorTab *tab);
+void tab_make_cold(EditorTab *tab);
+void tab_save_stashed();
+gboolean tab_stashed_unsaved();
+gboolean tab_check_unsaved();
+gboolean tab_check_all_unsaved();
+void tab_enforce_budget();
+void tab_update_label(EditorTab *tab);
+void tab_free(EditorTab *tab);
+void tab_switch_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer data);
+void tab_close_clicked(GtkButton *button, gpointer data);
+void tab_low_memory(GMemoryMonitor *monitor, GMemoryMonitorWarningLevel level, gpointer data);
+
+// Quick open
+guint64 quick_open_char_bit(guchar c);
+guint64 quick_open_mask(const char *text, gsize length);
+void quick_open_rebuild();
+void quick_open_refresh_opened();
+gboolean quick_open_is_boundary(const char *text, guint32 position);
+gint quick_open_match_from(const char *text, guint32 length, guint32 name_start, guint32 from,
+                           const char *query, guint query_length, guint32 *positions);
+gint quick_open_score(guint32 id, const char *query, guint query_length, guint32 *positions);
+void quick_open_note_opened(const char *path);
+void quick_open_recent_read(GKeyFile *keyfile);
+void quick_open_recent_write(GKeyFile *keyfile);
+char* quick_open_markup(guint32 id, const char *query, guint query_length);
+void quick_open_update();
+void quick_open_query_changed(GtkEditable *editable, gpointer data);
+void quick_open_activate();
+void quick_open_row_activated(GtkTreeView *view, GtkTreePath *path,
+                              GtkTreeViewColumn *column, gpointer data);
+void quick_open_entry_activated(GtkEntry *entry, gpointer data);
+void quick_open_move_selection(gint delta);
+gboolean quick_open_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data);
+gboolean quick_open_focus_out(GtkWidget *widget, GdkEventFocus *event, gpointer data);
+void quick_open_show();
+gboolean on_window_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data);
+
+// Version history
+void history_init_gear();
+gsize history_chunk_length(const guint8 *data, gsize length);
+void history_id_compute(const void *data, gsize length, HistoryId *id);
+guint history_id_hash(gconstpointer key);
+gboolean history_id_equal(gconstpointer a, gconstpointer b);
+void history_version_free(HistoryVersion *version);
+gboolean history_write_all(int fd, const void *data, gsize length, guint64 offset);
+gboolean history_read_exact(int fd, void *data, gsize length, guint64 offset);
+gboolean history_compress(const guint8 *data, gsize length, guint8 **out, gsize *out_length);
+gboolean history_decompress(const guint8 *data, gsize length, guint8 *out, gsize out_length);
+GArray* history_manifest(GPtrArray *versions, guint index);
+GArray* history_apply_delta(GArray *previous, HistoryVersion *version);
+void history_encode_delta(HistoryVersion *version, guint index, GArray *previous, GArray *manifest);
+void history_encode_version(GByteArray *out, const char *relative, HistoryVersion *version);
+GPtrArray* history_note_versions(HistoryStore *store, const char *relative, gboolean create);
+gboolean history_load(HistoryStore *store);
+void history_unload(HistoryStore *store);
+void history_store_free(HistoryStore *store);
+HistoryStore* history_store_open(const char *vault);
+void history_open(const char *vault);
+void history_close();
+gboolean history_append(HistoryStore *store, const char *path, const char *content, gsize length);
+GBytes* history_read(HistoryStore *store, const char *relative, const HistoryId *content,
+                     GError **error);
+void history_collect(HistoryStore *store, gint keep_days, gint keep_versions);
+void history_job_free(HistoryJob *job);
+void history_job_run(gpointer data, gpointer user_data);
+void history_queue_append(const char *path, char *content, gsize length);
+gboolean history_collect_timeout(gpointer user_data);
+void history_read_free(HistoryRead *read);
+void history_read_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void history_read_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void history_version_selected(GtkTreeSelection *selection, gpointer user_data);
+void history_list_free(HistoryList *list);
+void history_list_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+void history_list_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void history_browser_run(HistoryList *list);
+void history_show(GtkWidget *menuitem, gpointer userdata);
+void history_restore(const char *path, GBytes *bytes);
+
+// Tracing
+void trace_start(const char *path);
+gint64 trace_now();
+void trace_record(const char *category, const char *name, gint64 start, gint64 duration);
+void trace_span(const char *category, const char *name, gint64 start);
+void trace_mark(const char *category, const char *name);
+void trace_finish();
+const char* trace_script_name(const char *script);
+void editor_run_script(const char *script, GAsyncReadyCallback callback, gpointer user_data);
+void editor_run_script_done(GObject *source_object, GAsyncResult *result, gpointer user_data);
+void trace_message_begin(WebKitUserContentManager *manager,
+                         WebKitJavascriptResult *js_result,
+                         gpointer user_data);
+void trace_message_end(WebKitUserContentManager *manager,
+                       WebKitJavascriptResult *js_result,
+                       gpointer user_data);
+
+// Startup
+void startup_milestone(const char *name);
+gboolean startup_first_draw(GtkWidget *widget, cairo_t *cr, gpointer data);
+gboolean startup_deferred(gpointer user_data);
+void startup_check_ready();
+gboolean startup_measure_quit(gpointer user_data);
+
+// Session
+guint32 session_add_string(GString *strings, const char *text);
+void session_collect_expanded(GtkTreeView *view, GtkTreePath *tree_path, gpointer data);
+gboolean session_write();
+gboolean session_read();
+void session_restore_free(SessionRestore *restore);
+void session_restore_tabs();
+void session_expand_parent(GtkTreeIter *parent, const char *child_path);
+void session_scan_done();
+void session_schedule_save();
+gboolean session_save_timeout(gpointer user_data);
+void session_tree_changed(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *tree_path, gpointer data);
+void session_tree_scrolled(GtkAdjustment *adjustment, gpointer data);
+gboolean session_window_delete(GtkWidget *widget, GdkEvent *event, gpointer data);
+void handle_view_state(WebKitUserContentManager *manager,
+                       WebKitJavascriptResult *js_result,
+                       gpointer user_data);
+
 // Settings and configuration
 void init_config();
+gboolean config_read(char **last_file);
 void load_config();
 void save_config();
 void toggle_dark_mode(GtkWidget *widget, gpointer data);
@@ -89,10 +1370,12 @@ void toggle_preview(GtkWidget *widget, gpointer data);
 
 // Autosave functionality
 gboolean autosave_callback(gpointer user_data);
+void autosave_schedule();
 void toggle_autosave(GtkWidget *widget, gpointer data);
 void update_save_indicator();
 void mark_content_unsaved();
 gboolean check_unsaved_changes();
+gint unsaved_changes_dialog();
 
 // WebKit handlers
 void register_web_handlers(WebKitUserContentManager *manager);
@@ -103,12 +1386,18 @@ void handle_new_note(WebKitUserContentManager *manager,
 void handle_open_file(WebKitUserContentManager *manager, 
                      WebKitJavascriptResult *js_result, 
                      gpointer user_data);
+void handle_search(WebKitUserContentManager *manager,
+                   WebKitJavascriptResult *js_result,
+                   gpointer user_data);
 
 void apply_gtk_css();
 
 void handle_editor_initialized(WebKitUserContentManager *manager, 
                              WebKitJavascriptResult *js_result, 
                              gpointer user_data);
+void handle_document_loaded(WebKitUserContentManager *manager,
+                            WebKitJavascriptResult *js_result,
+                            gpointer user_data);
 
 
 static void ignore_webkit_messages(const gchar *log_domain,
@@ -129,11 +1418,60 @@ int main(int argc, char *argv[]) {
                      ignore_webkit_messages,
                      NULL);
 
+    startup_origin = g_get_monotonic_time();
+
+    // --trace=FILE records startup and interaction spans as Chrome trace JSON,
+    // --measure-startup prints startup milestones and quits once the editor is ready,
+    // --bench[=OPTIONS] times the core on a synthetic vault without opening a window
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0 || g_str_has_prefix(argv[i], "--bench=")) {
+            return bench_run(argv[i][7] == '=' ? argv[i] + 8 : "");
+        } else if (g_str_has_prefix(argv[i], "--trace=")) {
+            trace_start(argv[i] + strlen("--trace="));
+        } else if (strcmp(argv[i], "--measure-startup") == 0) {
+            startup_measure = TRUE;
+        } else {
+            continue;
+        }
+        memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(char *));
+        argc--;
+        i--;
+    }
 
+    gint64 phase = trace_now();
     gtk_init(&argc, &argv);
-
-
+    trace_span("startup", "gtk_init", phase);
+
+    // Persistent cache and data directories let WebKit keep compiled
+    // scripts and cached resources between runs
+    phase = trace_now();
+    char *web_cache_dir = g_build_filename(g_get_user_cache_dir(), "notes-gui", "webkit", NULL);
+    char *web_data_dir = g_build_filename(g_get_user_data_dir(), "notes-gui", "webkit", NULL);
+    WebKitWebsiteDataManager *data_manager = webkit_website_data_manager_new(
+        "base-cache-directory", web_cache_dir,
+        "base-data-directory", web_data_dir,
+        NULL);
+    WebKitWebContext *web_context = webkit_web_context_new_with_website_data_manager(data_manager);
+    webkit_web_context_set_cache_model(web_context, WEBKIT_CACHE_MODEL_DOCUMENT_BROWSER);
+    g_object_unref(data_manager);
+    g_free(web_cache_dir);
+    g_free(web_data_dir);
+
+    // The editor page, its assets and note content are all served from envelope://
+    webkit_web_context_register_uri_scheme_protocol(web_context, "envelope",
+                                                    envelope_scheme_request, NULL, NULL);
+    WebKitSecurityManager *security_manager = webkit_web_context_get_security_manager(web_context);
+    webkit_security_manager_register_uri_scheme_as_secure(security_manager, "envelope");
+    webkit_security_manager_register_uri_scheme_as_cors_enabled(security_manager, "envelope");
+
+    // The web process boots while the window is built and the config is read;
+    // the editor page is loaded into it as soon as the web view exists
+    webkit_web_context_prewarm(web_context);
+    trace_span("startup", "prewarm_web_process", phase);
+
+    phase = trace_now();
     setup_css_provider();
+    trace_span("startup", "setup_css_provider", phase);
 
 
     // Create main window
@@ -141,6 +1479,9 @@ int main(int argc, char *argv[]) {
     gtk_window_set_title(GTK_WINDOW(window), "Markdown Notes App");
     gtk_window_set_default_size(GTK_WINDOW(window), 1200, 700);
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    g_signal_connect(window, "delete-event", G_CALLBACK(session_window_delete), NULL);
+    g_signal_connect_after(window, "draw", G_CALLBACK(startup_first_draw), NULL);
+    g_signal_connect(window, "key-press-event", G_CALLBACK(on_window_key_press), NULL);
 
     // Create main container
     GtkWidget *main_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
@@ -158,8 +1499,17 @@ int main(int argc, char *argv[]) {
     gtk_label_set_ellipsize(GTK_LABEL(vault_label), PANGO_ELLIPSIZE_START);
     gtk_box_pack_start(GTK_BOX(left_panel), vault_label, FALSE, FALSE, 5);
 
+    // Shown while a rename updates the links to it
+    rename_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(rename_progress), TRUE);
+    gtk_widget_set_no_show_all(rename_progress, TRUE);
+    gtk_box_pack_start(GTK_BOX(left_panel), rename_progress, FALSE, FALSE, 0);
+
     // File tree section
-    tree_store = gtk_tree_store_new(2, G_TYPE_STRING, G_TYPE_STRING);
+    // Columns: name, path, is_dir, collation key used to keep folders sorted
+    tree_store = gtk_tree_store_new(4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_STRING);
+    file_tree_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, (GDestroyNotify)gtk_tree_iter_free);
     tree_view = GTK_TREE_VIEW(gtk_tree_view_new_with_model(GTK_TREE_MODEL(tree_store)));
     g_signal_connect(GTK_WIDGET(tree_view), "button-press-event", 
                     G_CALLBACK(on_tree_button_press), NULL);
@@ -173,13 +1523,59 @@ int main(int argc, char *argv[]) {
     gtk_tree_view_column_set_title(column, "Files");
     gtk_tree_view_append_column(tree_view, column);
 
+    // Tag filter, e.g. "tag:a AND NOT status:done"
+    meta_filter_entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(meta_filter_entry), "Filter by tag:…");
+    gtk_widget_set_tooltip_text(meta_filter_entry,
+        "Show notes by tag or front-matter field, e.g. tag:a AND NOT status:done. "
+        "Combine with AND, OR, NOT and parentheses.");
+    g_signal_connect(meta_filter_entry, "search-changed", G_CALLBACK(meta_filter_changed), NULL);
+    gtk_box_pack_start(GTK_BOX(left_panel), meta_filter_entry, FALSE, FALSE, 0);
+
     GtkWidget *scroll_tree = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll_tree),
                                  GTK_POLICY_AUTOMATIC,
                                  GTK_POLICY_AUTOMATIC);
     gtk_container_add(GTK_CONTAINER(scroll_tree), GTK_WIDGET(tree_view));
+    g_signal_connect(tree_view, "row-expanded", G_CALLBACK(session_tree_changed), NULL);
+    g_signal_connect(tree_view, "row-collapsed", G_CALLBACK(session_tree_changed), NULL);
+    g_signal_connect(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(tree_view)), "value-changed",
+                     G_CALLBACK(session_tree_scrolled), NULL);
     gtk_widget_set_size_request(scroll_tree, 200, 300);
     gtk_box_pack_start(GTK_BOX(left_panel), scroll_tree, TRUE, TRUE, 0);
+    file_tree_scroll = scroll_tree;
+
+    // The filtered tree shares the file tree's store and is shown in its place
+    meta_filter_model = gtk_tree_model_filter_new(GTK_TREE_MODEL(tree_store), NULL);
+    gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(meta_filter_model),
+                                           meta_filter_visible, NULL, NULL);
+    meta_filter_view = GTK_TREE_VIEW(gtk_tree_view_new_with_model(meta_filter_model));
+    gtk_tree_view_insert_column_with_attributes(meta_filter_view, -1, "Notes",
+                                                gtk_cell_renderer_text_new(), "text", 0, NULL);
+    g_signal_connect(gtk_tree_view_get_selection(meta_filter_view), "changed",
+                     G_CALLBACK(meta_filter_selection_changed), NULL);
+    meta_filter_scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(meta_filter_scroll),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(meta_filter_scroll), GTK_WIDGET(meta_filter_view));
+    gtk_widget_set_size_request(meta_filter_scroll, 200, 300);
+    gtk_widget_show(GTK_WIDGET(meta_filter_view));
+    gtk_widget_set_no_show_all(meta_filter_scroll, TRUE);
+    gtk_box_pack_start(GTK_BOX(left_panel), meta_filter_scroll, TRUE, TRUE, 0);
+
+    // Backlinks of the open note
+    backlinks_expander = gtk_expander_new("Backlinks (0)");
+    gtk_expander_set_expanded(GTK_EXPANDER(backlinks_expander), TRUE);
+    backlinks_list = gtk_list_box_new();
+    g_signal_connect(backlinks_list, "row-activated", G_CALLBACK(backlinks_row_activated), NULL);
+    GtkWidget *scroll_backlinks = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll_backlinks),
+                                   GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_max_content_height(GTK_SCROLLED_WINDOW(scroll_backlinks), 160);
+    gtk_scrolled_window_set_propagate_natural_height(GTK_SCROLLED_WINDOW(scroll_backlinks), TRUE);
+    gtk_container_add(GTK_CONTAINER(scroll_backlinks), backlinks_list);
+    gtk_container_add(GTK_CONTAINER(backlinks_expander), scroll_backlinks);
+    gtk_box_pack_start(GTK_BOX(left_panel), backlinks_expander, FALSE, FALSE, 0);
 
     // Settings section
     GtkWidget *settings_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
@@ -209,7 +1605,9 @@ int main(int argc, char *argv[]) {
     gtk_box_pack_start(GTK_BOX(settings_box), autosave_check, FALSE, FALSE, 0);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(autosave_check), TRUE);
 
+    phase = trace_now();
     init_config();
+    trace_span("startup", "init_config", phase);
 
     if (dark_mode_enabled) {
     gtk_switch_set_active(GTK_SWITCH(dark_mode_switch), TRUE);
@@ -225,22 +1623,24 @@ int main(int argc, char *argv[]) {
     gtk_box_pack_start(GTK_BOX(left_panel), buttons_box, FALSE, FALSE, 5);
 
     GtkWidget *add_button = gtk_button_new_with_label("Add Note");
-    GtkWidget *delete_button = gtk_button_new_with_label("Delete Note");
     GtkWidget *save_button = gtk_button_new_with_label("Save");
     GtkWidget *save_as_button = gtk_button_new_with_label("Save As");
 
     gtk_box_pack_start(GTK_BOX(buttons_box), add_button, FALSE, FALSE, 0);
-    gtk_box_pack_start(GTK_BOX(buttons_box), delete_button, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(buttons_box), save_button, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(buttons_box), save_as_button, FALSE, FALSE, 0);
 
     // Editor section
+    phase = trace_now();
     // Create the user content manager and register handlers
     WebKitUserContentManager *manager = webkit_user_content_manager_new();
     register_web_handlers(manager);
 
     // Create the web view with the user content manager
-    web_view = webkit_web_view_new_with_user_content_manager(manager);
+    web_view = GTK_WIDGET(g_object_new(WEBKIT_TYPE_WEB_VIEW,
+                                       "web-context", web_context,
+                                       "user-content-manager", manager,
+                                       NULL));
 
     // Set settings
     WebKitSettings *settings = webkit_web_view_get_settings(WEBKIT_WEB_VIEW(web_view));
@@ -253,10 +1653,27 @@ int main(int argc, char *argv[]) {
     gtk_widget_set_hexpand(scrolled_window_web, TRUE);
     gtk_widget_set_vexpand(scrolled_window_web, TRUE);
     gtk_container_add(GTK_CONTAINER(scrolled_window_web), web_view);
-    gtk_box_pack_start(GTK_BOX(main_box), scrolled_window_web, TRUE, TRUE, 5);
+
+    // Tab strip above the editor. Its pages stay empty: every tab is shown
+    // by the one web view, which swaps editor instances.
+    GtkWidget *editor_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    editor_tabs = g_ptr_array_new_with_free_func((GDestroyNotify)tab_free);
+    tab_notebook = gtk_notebook_new();
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(tab_notebook), TRUE);
+    gtk_notebook_set_show_border(GTK_NOTEBOOK(tab_notebook), FALSE);
+    gtk_widget_set_no_show_all(tab_notebook, TRUE);
+    g_signal_connect_after(tab_notebook, "switch-page", G_CALLBACK(tab_switch_page), NULL);
+    gtk_box_pack_start(GTK_BOX(editor_box), tab_notebook, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(editor_box), scrolled_window_web, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(main_box), editor_box, TRUE, TRUE, 5);
+    g_signal_connect(g_memory_monitor_dup_default(), "low-memory-warning",
+                     G_CALLBACK(tab_low_memory), NULL);
+    trace_span("startup", "create_web_view", phase);
 
     // Now that web_view is initialized, call load_editor()
+    phase = trace_now();
     load_editor();
+    trace_span("startup", "load_editor", phase);
 
     // Connect to load-changed signal
     g_signal_connect(web_view, "load-changed", G_CALLBACK(web_view_load_changed), NULL);
@@ -264,7 +1681,6 @@ int main(int argc, char *argv[]) {
     // Connect all signals
     g_signal_connect(choose_vault_button, "clicked", G_CALLBACK(choose_vault_directory), NULL);
     g_signal_connect(add_button, "clicked", G_CALLBACK(add_note), NULL);
-    g_signal_connect(delete_button, "clicked", G_CALLBACK(delete_note), NULL);
     g_signal_connect(save_button, "clicked", G_CALLBACK(save_note), NULL);
     g_signal_connect(save_as_button, "clicked", G_CALLBACK(save_note_as), NULL);
     g_signal_connect(dark_mode_switch, "notify::active", G_CALLBACK(toggle_dark_mode), NULL);
@@ -280,60 +1696,68 @@ int main(int argc, char *argv[]) {
     update_vault_label();
 
     // Show window
+    phase = trace_now();
     gtk_widget_show_all(window);
+    trace_span("startup", "show_window", phase);
+    trace_mark("startup", "main_loop");
     gtk_main();
 
     if (css_provider) {
         g_object_unref(css_provider);
     }
 
+    // Saves started while closing are written before the indexes shut down
+    while (save_running) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
     // Save config before exit
     save_config();
+    search_index_close();
+    link_graph_close();
+    history_close();
+    recent_flush();
+    trace_finish();
 
     return 0;
 }
 
 void load_editor() {
-    char *css_path = get_asset_path("editor.css");
-    char *js_path = get_asset_path("editor.js");
-    
-    if (!css_path || !js_path) {
-        show_error_dialog("Failed to locate assets");
-        g_free(css_path);
-        g_free(js_path);
-        return;
-    }
-    
-    // Read CSS file
-    char *css_content = get_file_contents(css_path);
-    if (!css_content) {
-        show_error_dialog("Failed to load editor.css");
-        g_free(css_path);
-        g_free(js_path);
+    // The page pulls everything else from envelope://app/
+    if (!asset_available("editor.js") || !asset_available("editor.css")) {
+        show_error_dialog("Failed to load editor assets (editor.js, editor.css)");
         return;
     }
-    
-    // Read JS file
-    char *js_content = get_file_contents(js_path);
-    if (!js_content) {
-        show_error_dialog("Failed to load editor.js");
-        g_free(css_path);
-        g_free(js_path);
-        g_free(css_content);
-        return;
+
+    // Toast UI comes from the bundle. The CDN is only used when the user
+    // asked for it, and only then is it allowed by the page's policy.
+    const char *editor_js = "vendor/toastui-editor-all.min.js";
+    const char *editor_css = "vendor/toastui-editor.min.css";
+    const char *cdn_source = "";
+    if (!asset_available(editor_js) || !asset_available(editor_css)) {
+        if (!editor_cdn_fallback) {
+            show_error_dialog("Toast UI Editor is not bundled. Run 'make vendor' and rebuild, "
+                              "or set editor_cdn_fallback=true in user.conf to load it from "
+                              "uicdn.toast.com.");
+            return;
+        }
+        g_warning("Toast UI Editor is not bundled, loading it from uicdn.toast.com");
+        editor_js = TOASTUI_CDN "/toastui-editor-all.min.js";
+        editor_css = TOASTUI_CDN "/toastui-editor.min.css";
+        cdn_source = " https://uicdn.toast.com";
     }
-    
+
     const char *html_template = 
         "<!DOCTYPE html>"
         "<html>"
         "<head>"
         "<meta charset=\"UTF-8\">"
         "<meta http-equiv=\"Content-Security-Policy\" "
-        "content=\"default-src 'self' 'unsafe-inline' 'unsafe-eval' "
-        "https://uicdn.toast.com data: blob:;\">"
+        "content=\"default-src 'self' 'unsafe-inline' 'unsafe-eval'%s "
+        "envelope: data: blob:;\">"
         "<title>Markdown Editor</title>"
-        "<link rel=\"stylesheet\" href=\"https://uicdn.toast.com/editor/latest/toastui-editor.min.css\">"
-        "<style>%s</style>"
+        "<link rel=\"stylesheet\" href=\"%s\">"
+        "<link rel=\"stylesheet\" href=\"editor.css\">"
         "</head>"
         "<body>"
         "<div id=\"start-page\" class=\"start-page\">"
@@ -342,32 +1766,48 @@ void load_editor() {
         "    <button onclick=\"window.webkit.messageHandlers.newNote.postMessage('')\" "
         "            class=\"start-button\">New Note</button>"
         "  </div>"
+        "  <div class=\"search-box\">"
+        "    <input type=\"search\" id=\"search-input\" placeholder=\"Search notes\" autocomplete=\"off\">"
+        "    <div id=\"search-results\"></div>"
+        "  </div>"
         "  <div class=\"recent-files\" id=\"recent-files\">"
         "    <h2>Recent Notes</h2>"
         "    <div id=\"recent-files-list\"></div>"
         "  </div>"
         "</div>"
-        "<div id=\"editor\"></div>"
-        "<script src=\"https://uicdn.toast.com/editor/latest/toastui-editor-all.min.js\"></script>"
-        "<script>%s</script>"
+        "<div id=\"editor-area\">"
+        "  <div id=\"editor\"></div>"
+        "  <div id=\"large-file\">"
+        "    <div class=\"large-file-bar\">"
+        "      <span id=\"large-file-status\"></span>"
+        "      <button id=\"large-file-edit\">Edit these lines</button>"
+        "      <button id=\"large-file-done\">Done</button>"
+        "    </div>"
+        "    <div id=\"large-file-scroll\">"
+        "      <div id=\"large-file-spacer\"><pre id=\"large-file-lines\"></pre></div>"
+        "    </div>"
+        "    <textarea id=\"large-file-text\" spellcheck=\"false\"></textarea>"
+        "  </div>"
+        "  <div id=\"native-preview\" class=\"toastui-editor-contents\"></div>"
+        "</div>"
+        "<script src=\"%s\"></script>"
+        "<script src=\"editor.js\"></script>"
         "</body>"
         "</html>";
     
-    char *html_content = g_strdup_printf(html_template, css_content, js_content);
-    
-    webkit_web_view_load_html(WEBKIT_WEB_VIEW(web_view), html_content, "file:///");
-    
-    g_free(css_path);
-    g_free(js_path);
-    g_free(css_content);
-    g_free(js_content);
+    char *html_content = g_strdup_printf(html_template, cdn_source, editor_css, editor_js);
+    webkit_web_view_load_html(WEBKIT_WEB_VIEW(web_view), html_content, "envelope://app/");
     g_free(html_content);
 }
 
 void web_view_load_changed(WebKitWebView *web_view, WebKitLoadEvent load_event, gpointer user_data) {
     if (load_event == WEBKIT_LOAD_FINISHED) {
-        // Now that the content is loaded, we can call JavaScript functions
-        show_start_page();
+        startup_milestone("WEBKIT_LOAD_FINISHED");
+        // Now that the content is loaded, we can call JavaScript functions.
+        // A note still being read will switch to the editor itself.
+        if (!current_file_path && !note_load_path) {
+            show_start_page();
+        }
         apply_dark_mode(); // Apply dark mode after content is loaded
     }
 }
@@ -390,86 +1830,838 @@ void choose_vault_directory(GtkWidget *widget, gpointer data) {
 }
 
 void refresh_file_tree() {
+    gint64 started = trace_now();
+    // Drop whatever the previous scan was still producing
+    if (scan_cancellable) {
+        g_cancellable_cancel(scan_cancellable);
+        g_clear_object(&scan_cancellable);
+    }
+    scan_generation++;
+    watch_reset();
+
+    g_hash_table_remove_all(file_tree_index);
     gtk_tree_store_clear(tree_store);
-    if (!vault_directory) return;
+    quick_open_dirty = TRUE;
+    if (!scan_queue) {
+        scan_queue = g_async_queue_new_full((GDestroyNotify)scan_batch_free);
+    }
+    scan_in_progress = FALSE;
+    search_index_open(vault_directory);
+    link_graph_open(vault_directory);
+    history_open(vault_directory);
+    vault_meta_open(vault_directory);
+    if (!vault_directory) {
+        trace_span("vault", "refresh_file_tree", started);
+        return;
+    }
+
+    scan_in_progress = TRUE;
+    scan_cancellable = g_cancellable_new();
+    watch_directory(vault_directory);
+    scan_start(vault_directory, FALSE);
+    trace_scan_start = trace_now();
+    trace_span("vault", "refresh_file_tree", started);
+}
 
-    GDir *dir = g_dir_open(vault_directory, 0, NULL);
-    if (!dir) return;
+void scan_start(const char *root, gboolean subtree) {
+    ScanJob *job = g_new0(ScanJob, 1);
+    job->root = g_strdup(root);
+    job->generation = scan_generation;
+    job->subtree = subtree;
+    if (!subtree) {
+        job->cache = vault_meta ? g_mapped_file_ref(vault_meta) : NULL;
+        job->meta_path = g_strdup(vault_meta_path);
+    }
 
-    const gchar *filename;
-    GtkTreeIter iter;
+    GTask *task = g_task_new(NULL, scan_cancellable, NULL, NULL);
+    g_task_set_task_data(task, job, (GDestroyNotify)scan_job_free);
+    g_task_run_in_thread(task, scan_vault_thread);
+    g_object_unref(task);
+}
 
-    while ((filename = g_dir_read_name(dir))) {
-        if (g_str_has_suffix(filename, ".md")) {
-            char *full_path = g_build_filename(vault_directory, filename, NULL);
-            gtk_tree_store_append(tree_store, &iter, NULL);
-            gtk_tree_store_set(tree_store, &iter,
-                             0, filename,
-                             1, full_path,
-                             -1);
-            g_free(full_path);
+ScanBatch* scan_batch_new(ScanJob *job) {
+    ScanBatch *batch = g_new0(ScanBatch, 1);
+    batch->generation = job->generation;
+    batch->subtree = job->subtree;
+    batch->reconcile = job->cache != NULL;
+    batch->entries = g_ptr_array_new_with_free_func((GDestroyNotify)scan_entry_free);
+    return batch;
+}
+
+void scan_vault_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    ScanJob *job = task_data;
+    GQueue pending_dirs = G_QUEUE_INIT;
+    g_queue_push_tail(&pending_dirs, g_strdup(job->root));
+    gsize root_length = strlen(job->root);
+
+    // With a cache the tree is filled from it first; the walk below then
+    // only adds what is new and reads titles of notes that changed
+    const VaultMetaHeader *cache = job->cache ?
+        (const VaultMetaHeader *)g_mapped_file_get_contents(job->cache) : NULL;
+    const VaultMetaEntry *cached_entries = NULL;
+    const char *cached_strings = NULL;
+    GHashTable *cached_paths = NULL;   // relative path -> entry index + 1
+    guint8 *cached_seen = NULL;
+    if (cache) {
+        scan_emit_cached(job, cache);
+        cached_entries = vault_meta_entries(cache);
+        cached_strings = vault_meta_strings(cache);
+        cached_paths = g_hash_table_new(g_str_hash, g_str_equal);
+        for (guint32 i = 0; i < cache->entry_count; i++) {
+            g_hash_table_insert(cached_paths, (gpointer)(cached_strings + cached_entries[i].path),
+                                GUINT_TO_POINTER(i + 1));
+        }
+        cached_seen = g_new0(guint8, cache->entry_count);
+    }
+    VaultMetaBuilder *meta = job->meta_path ? vault_meta_builder_new(job->root) : NULL;
+
+    ScanBatch *batch = scan_batch_new(job);
+    gint64 batch_started = g_get_monotonic_time();
+    gboolean first_batch = TRUE;
+
+    // Breadth-first so top-level rows reach the tree before deep ones
+    char *dir_path;
+    while ((dir_path = g_queue_pop_head(&pending_dirs))) {
+        if (g_cancellable_is_cancelled(cancellable)) {
+            g_free(dir_path);
+            break;
+        }
+
+        GDir *dir = g_dir_open(dir_path, 0, NULL);
+        if (!dir) {
+            g_free(dir_path);
+            continue;
+        }
+
+        // Subtree scans hang their rows under an existing folder row
+        gboolean top_level = !job->subtree && strcmp(dir_path, job->root) == 0;
+        GPtrArray *children = g_ptr_array_new();
+        const gchar *filename;
+        while ((filename = g_dir_read_name(dir))) {
+            // Skip hidden entries such as .git
+            if (filename[0] == '.') continue;
+
+            char *full_path = g_build_filename(dir_path, filename, NULL);
+            GStatBuf st;
+            if (g_lstat(full_path, &st) != 0) {
+                g_free(full_path);
+                continue;
+            }
+
+            gboolean is_dir = S_ISDIR(st.st_mode);
+            if (!is_dir && !g_str_has_suffix(filename, ".md")) {
+                g_free(full_path);
+                continue;
+            }
+
+            ScanEntry *entry = g_new0(ScanEntry, 1);
+            entry->name = g_strdup(filename);
+            entry->path = full_path;
+            entry->parent = top_level ? NULL : g_strdup(dir_path);
+            entry->sort_key = g_utf8_collate_key_for_filename(filename, -1);
+            entry->is_dir = is_dir;
+            entry->mtime = st.st_mtime;
+            entry->size = st.st_size;
+            g_ptr_array_add(children, entry);
+        }
+        g_dir_close(dir);
+        g_free(dir_path);
+
+        g_ptr_array_sort(children, scan_entry_compare);
+        for (guint i = 0; i < children->len; i++) {
+            ScanEntry *entry = g_ptr_array_index(children, i);
+            if (entry->is_dir) {
+                g_queue_push_tail(&pending_dirs, g_strdup(entry->path));
+            }
+            if (meta) {
+                guint index = cached_paths ?
+                    GPOINTER_TO_UINT(g_hash_table_lookup(cached_paths, entry->path + root_length + 1)) : 0;
+                const VaultMetaEntry *old = index ? &cached_entries[index - 1] : NULL;
+                char *title = NULL;
+                if (old) cached_seen[index - 1] = TRUE;
+                if (old && old->mtime == entry->mtime && old->size == entry->size &&
+                    old->is_dir == (guint32)entry->is_dir) {
+                    title = g_strdup(cached_strings + old->title);
+                } else if (!entry->is_dir) {
+                    title = vault_meta_read_title(entry->path);
+                }
+                vault_meta_builder_add(meta, entry, title);
+                g_free(title);
+            }
+            g_ptr_array_add(batch->entries, entry);
+        }
+        g_ptr_array_free(children, TRUE);
+
+        if (first_batch ||
+            batch->entries->len >= SCAN_BATCH_SIZE ||
+            g_get_monotonic_time() - batch_started >= SCAN_BATCH_INTERVAL_US) {
+            scan_flush_batch(batch);
+            batch = scan_batch_new(job);
+            batch_started = g_get_monotonic_time();
+            first_batch = FALSE;
         }
     }
-    g_dir_close(dir);
+    g_queue_clear_full(&pending_dirs, g_free);
+
+    batch->done = TRUE;
+    if (meta && !g_cancellable_is_cancelled(cancellable)) {
+        vault_meta_builder_write(meta, job->meta_path);
+        if (cache) {
+            // Rows under a folder that is gone leave with the folder
+            batch->removed = g_ptr_array_new_with_free_func(g_free);
+            for (guint32 i = 0; i < cache->entry_count; i++) {
+                gint32 parent = cached_entries[i].parent;
+                if (cached_seen[i] || (parent >= 0 && !cached_seen[parent])) continue;
+                g_ptr_array_add(batch->removed,
+                                g_build_filename(job->root, cached_strings + cached_entries[i].path, NULL));
+            }
+        }
+    }
+    scan_flush_batch(batch);
+
+    if (meta) vault_meta_builder_free(meta);
+    if (cached_paths) g_hash_table_unref(cached_paths);
+    g_free(cached_seen);
+
+    g_task_return_boolean(task, TRUE);
+}
+
+void scan_flush_batch(ScanBatch *batch) {
+    g_async_queue_push(scan_queue, batch);
+    if (g_atomic_int_compare_and_exchange(&scan_drain_scheduled, 0, 1)) {
+        g_idle_add(scan_drain_batches, NULL);
+    }
 }
 
-void file_tree_selection_changed(GtkTreeSelection *selection, gpointer data) {
-    // Check for unsaved changes before switching files
-    if (!is_content_saved && !check_unsaved_changes()) {
-        // User cancelled, reselect the previous file
-        if (current_file_path) {
-            GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
-            GtkTreeIter iter;
-            gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
-            while (valid) {
-                char *filepath;
-                gtk_tree_model_get(model, &iter, 1, &filepath, -1);
-                if (g_strcmp0(filepath, current_file_path) == 0) {
-                    gtk_tree_selection_select_iter(selection, &iter);
-                    g_free(filepath);
-                    return;
+gboolean scan_drain_batches(gpointer user_data) {
+    gint64 deadline = g_get_monotonic_time() + SCAN_FRAME_BUDGET_US;
+
+    while (g_get_monotonic_time() < deadline) {
+        if (!scan_current_batch) {
+            scan_current_batch = g_async_queue_try_pop(scan_queue);
+            scan_current_index = 0;
+        }
+        if (!scan_current_batch) {
+            g_atomic_int_set(&scan_drain_scheduled, 0);
+            // The worker may have pushed between the pop and the reset above
+            if (g_async_queue_length(scan_queue) > 0 &&
+                g_atomic_int_compare_and_exchange(&scan_drain_scheduled, 0, 1)) {
+                continue;
+            }
+            return G_SOURCE_REMOVE;
+        }
+
+        ScanBatch *batch = scan_current_batch;
+        if (batch->generation == scan_generation) {
+            // Check the clock every few rows rather than on every insert
+            guint stop = MIN(batch->entries->len, scan_current_index + 64);
+            for (; scan_current_index < stop; scan_current_index++) {
+                scan_apply_entry(batch, g_ptr_array_index(batch->entries, scan_current_index));
+            }
+            if (scan_current_index < batch->entries->len) continue;
+
+            if (batch->done && !batch->subtree) {
+                scan_in_progress = FALSE;
+                trace_span("vault", "vault_scan", trace_scan_start);
+                search_index_prune_unseen();
+                link_graph_prune_unseen();
+                session_scan_done();
+                // The watcher drops rows for paths that are no longer on disk
+                if (batch->removed && batch->removed->len > 0) {
+                    for (guint i = 0; i < batch->removed->len; i++) {
+                        watch_queue_path(g_ptr_array_index(batch->removed, i));
+                    }
+                    watch_schedule_flush();
                 }
-                g_free(filepath);
-                valid = gtk_tree_model_iter_next(model, &iter);
+                // Pick up the cache the scan just wrote
+                vault_meta_open(vault_directory);
             }
         }
+
+        scan_batch_free(batch);
+        scan_current_batch = NULL;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void scan_apply_entry(ScanBatch *batch, ScanEntry *entry) {
+    GtkTreeIter *parent = NULL;
+    if (entry->parent) {
+        parent = g_hash_table_lookup(file_tree_index, entry->parent);
+        if (!parent) return;
+    }
+
+    GtkTreeIter iter;
+    if (batch->subtree || batch->reconcile) {
+        // Watcher events or the vault cache may already have added this row
+        if (!file_tree_find_path(entry->path, &iter)) {
+            gint position = file_tree_sorted_position(parent, entry->sort_key, entry->is_dir);
+            file_tree_insert_row(&iter, parent, position, entry->name, entry->path,
+                                 entry->is_dir, entry->sort_key);
+        } else if (batch->subtree) {
+            return;
+        }
+    } else {
+        file_tree_insert_row(&iter, parent, -1, entry->name, entry->path,
+                             entry->is_dir, entry->sort_key);
+    }
+
+    // Cached sizes and times are checked once the walk reaches the note
+    if (!entry->is_dir && !batch->cached) {
+        search_index_check(entry->path, entry->mtime, entry->size);
+        link_graph_check(entry->path, entry->mtime, entry->size);
+    }
+}
+
+gint scan_entry_compare(gconstpointer a, gconstpointer b) {
+    const ScanEntry *entry_a = *(ScanEntry * const *)a;
+    const ScanEntry *entry_b = *(ScanEntry * const *)b;
+
+    // Directories first, then natural filename order
+    if (entry_a->is_dir != entry_b->is_dir) {
+        return entry_a->is_dir ? -1 : 1;
+    }
+    return strcmp(entry_a->sort_key, entry_b->sort_key);
+}
+
+void scan_entry_free(ScanEntry *entry) {
+    g_free(entry->name);
+    g_free(entry->path);
+    g_free(entry->parent);
+    g_free(entry->sort_key);
+    g_free(entry);
+}
+
+void scan_batch_free(ScanBatch *batch) {
+    g_ptr_array_free(batch->entries, TRUE);
+    if (batch->removed) g_ptr_array_unref(batch->removed);
+    g_free(batch);
+}
+
+void scan_job_free(ScanJob *job) {
+    if (job->cache) g_mapped_file_unref(job->cache);
+    g_free(job->meta_path);
+    g_free(job->root);
+    g_free(job);
+}
+
+gboolean path_has_prefix(const char *path, const char *prefix) {
+    size_t len = strlen(prefix);
+    return strncmp(path, prefix, len) == 0 &&
+           (path[len] == '\0' || path[len] == G_DIR_SEPARATOR);
+}
+
+// Whether a path on disk belongs in the file tree at all
+gboolean vault_path_is_listed(const char *path, gboolean *is_dir) {
+    char *name = g_path_get_basename(path);
+    gboolean hidden = name[0] == '.';
+    gboolean markdown = g_str_has_suffix(name, ".md");
+    g_free(name);
+    if (hidden) return FALSE;
+
+    GStatBuf st;
+    if (g_lstat(path, &st) != 0) return FALSE;
+    if (is_dir) *is_dir = S_ISDIR(st.st_mode);
+    return S_ISDIR(st.st_mode) || markdown;
+}
+
+gboolean file_tree_find_path(const char *path, GtkTreeIter *iter) {
+    GtkTreeIter *row = path ? g_hash_table_lookup(file_tree_index, path) : NULL;
+    if (!row) return FALSE;
+
+    if (iter) *iter = *row;
+    return TRUE;
+}
+
+gboolean file_tree_select_path(const char *path) {
+    GtkTreeIter iter;
+    if (!file_tree_find_path(path, &iter)) return FALSE;
+
+    file_tree_select_iter(&iter);
+    return TRUE;
+}
+
+// Index among parent's children where a new row keeps the folder order, or -1 to append
+gint file_tree_sorted_position(GtkTreeIter *parent, const char *sort_key, gboolean is_dir) {
+    GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
+    GtkTreeIter sibling;
+    gint position = 0;
+    gboolean valid = gtk_tree_model_iter_children(model, &sibling, parent);
+    while (valid) {
+        char *sibling_key;
+        gboolean sibling_is_dir;
+        gtk_tree_model_get(model, &sibling, 2, &sibling_is_dir, 3, &sibling_key, -1);
+        gboolean before = is_dir != sibling_is_dir ? is_dir : g_strcmp0(sort_key, sibling_key) < 0;
+        g_free(sibling_key);
+        if (before) return position;
+        position++;
+        valid = gtk_tree_model_iter_next(model, &sibling);
+    }
+    return -1;
+}
+
+void file_tree_insert_row(GtkTreeIter *iter, GtkTreeIter *parent, gint position,
+                          const char *name, const char *path, gboolean is_dir,
+                          const char *sort_key) {
+    quick_open_dirty = TRUE;
+    gtk_tree_store_insert_with_values(tree_store, iter, parent, position,
+                                      0, name,
+                                      1, path,
+                                      2, is_dir,
+                                      3, sort_key,
+                                      -1);
+    g_hash_table_insert(file_tree_index, g_strdup(path), gtk_tree_iter_copy(iter));
+    if (session_expand_pending && parent) session_expand_parent(parent, path);
+
+    if (is_dir) {
+        watch_directory(path);
+    } else if (pending_tree_selection && strcmp(pending_tree_selection, path) == 0) {
+        g_clear_pointer(&pending_tree_selection, g_free);
+        file_tree_select_iter(iter);
+    }
+}
+
+void file_tree_select_iter(GtkTreeIter *iter) {
+    GtkTreePath *tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree_store), iter);
+    gtk_tree_view_expand_to_path(tree_view, tree_path);
+    gtk_tree_selection_select_iter(gtk_tree_view_get_selection(tree_view), iter);
+    gtk_tree_view_scroll_to_cell(tree_view, tree_path, NULL, FALSE, 0.0, 0.0);
+    gtk_tree_path_free(tree_path);
+}
+
+gboolean file_tree_add_path(const char *path) {
+    gboolean is_dir;
+    GtkTreeIter iter;
+    if (!vault_path_is_listed(path, &is_dir)) return FALSE;
+    if (file_tree_find_path(path, &iter)) return FALSE;
+
+    GtkTreeIter parent;
+    char *parent_path = g_path_get_dirname(path);
+    gboolean at_root = g_strcmp0(parent_path, vault_directory) == 0;
+    gboolean has_parent = !at_root && file_tree_find_path(parent_path, &parent);
+    g_free(parent_path);
+    // Without a parent row the folder's own rescan brings this entry in
+    if (!at_root && !has_parent) return FALSE;
+
+    char *name = g_path_get_basename(path);
+    char *sort_key = g_utf8_collate_key_for_filename(name, -1);
+    GtkTreeIter *parent_iter = has_parent ? &parent : NULL;
+    gint position = file_tree_sorted_position(parent_iter, sort_key, is_dir);
+    file_tree_insert_row(&iter, parent_iter, position, name, path, is_dir, sort_key);
+    g_free(name);
+    g_free(sort_key);
+
+    if (!is_dir) {
+        search_index_queue(path, NULL);
+        link_graph_queue(path, NULL);
+    }
+
+    // A folder that appears at once (mkdir -p, checkout, move-in) may already have contents
+    if (is_dir) {
+        scan_start(path, TRUE);
+    }
+    return TRUE;
+}
+
+void file_tree_remove_iter(GtkTreeIter *iter) {
+    file_tree_forget_rows(iter);
+    gtk_tree_store_remove(tree_store, iter);
+}
+
+// Drop index entries and folder monitors for a row and everything below it
+void file_tree_forget_rows(GtkTreeIter *iter) {
+    GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
+    char *path;
+    gboolean is_dir;
+    gtk_tree_model_get(model, iter, 1, &path, 2, &is_dir, -1);
+    quick_open_dirty = TRUE;
+
+    if (is_dir) {
+        if (vault_monitors) g_hash_table_remove(vault_monitors, path);
+
+        GtkTreeIter child;
+        gboolean valid = gtk_tree_model_iter_children(model, &child, iter);
+        while (valid) {
+            file_tree_forget_rows(&child);
+            valid = gtk_tree_model_iter_next(model, &child);
+        }
+    } else {
+        search_index_remove_path(path);
+        link_graph_remove_path(path);
+    }
+    g_hash_table_remove(file_tree_index, path);
+    g_free(path);
+}
+
+// Point descendant rows of a renamed folder at their new paths
+void file_tree_rebase_children(GtkTreeIter *parent, const char *old_prefix, const char *new_prefix) {
+    GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
+    GtkTreeIter child;
+    gboolean valid = gtk_tree_model_iter_children(model, &child, parent);
+    while (valid) {
+        char *path;
+        gboolean is_dir;
+        gtk_tree_model_get(model, &child, 1, &path, 2, &is_dir, -1);
+
+        char *new_path = g_strconcat(new_prefix, path + strlen(old_prefix), NULL);
+        gtk_tree_store_set(tree_store, &child, 1, new_path, -1);
+        g_hash_table_remove(file_tree_index, path);
+        g_hash_table_insert(file_tree_index, g_strdup(new_path), gtk_tree_iter_copy(&child));
+        if (is_dir) {
+            if (vault_monitors) g_hash_table_remove(vault_monitors, path);
+            watch_directory(new_path);
+            file_tree_rebase_children(&child, old_prefix, new_prefix);
+        } else {
+            search_index_remove_path(path);
+            search_index_queue(new_path, NULL);
+            link_graph_remove_path(path);
+            link_graph_queue(new_path, NULL);
+        }
+        g_free(path);
+        g_free(new_path);
+        valid = gtk_tree_model_iter_next(model, &child);
+    }
+}
+
+gboolean file_tree_move_path(const char *old_path, const char *new_path) {
+    GtkTreeIter iter;
+    if (!file_tree_find_path(old_path, &iter)) return FALSE;
+
+    gboolean is_dir;
+    gtk_tree_model_get(GTK_TREE_MODEL(tree_store), &iter, 2, &is_dir, -1);
+    gboolean was_selected = gtk_tree_selection_iter_is_selected(
+        gtk_tree_view_get_selection(tree_view), &iter);
+
+    file_tree_rename_open_path(old_path, new_path);
+    recent_rename(old_path, new_path);
+
+    char *new_name = g_path_get_basename(new_path);
+    char *old_parent = g_path_get_dirname(old_path);
+    char *new_parent = g_path_get_dirname(new_path);
+    gboolean listed = path_has_prefix(new_path, vault_directory) && new_name[0] != '.' &&
+                      (is_dir || g_str_has_suffix(new_name, ".md"));
+    GtkTreeIter existing;
+
+    if (!listed || file_tree_find_path(new_path, &existing)) {
+        // Moved out of the vault, hidden, or already shown at the destination
+        file_tree_remove_iter(&iter);
+    } else if (strcmp(old_parent, new_parent) == 0) {
+        // Same folder: update in place so selection and expansion survive
+        quick_open_dirty = TRUE;
+        char *sort_key = g_utf8_collate_key_for_filename(new_name, -1);
+        gtk_tree_store_set(tree_store, &iter, 0, new_name, 1, new_path, 3, sort_key, -1);
+        g_hash_table_remove(file_tree_index, old_path);
+        g_hash_table_insert(file_tree_index, g_strdup(new_path), gtk_tree_iter_copy(&iter));
+
+        GtkTreeIter parent;
+        gboolean has_parent = gtk_tree_model_iter_parent(GTK_TREE_MODEL(tree_store), &parent, &iter);
+        gint position = file_tree_sorted_position(has_parent ? &parent : NULL, sort_key, is_dir);
+        GtkTreeIter sibling;
+        if (position >= 0 &&
+            gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(tree_store), &sibling,
+                                          has_parent ? &parent : NULL, position)) {
+            gtk_tree_store_move_before(tree_store, &iter, &sibling);
+        } else {
+            gtk_tree_store_move_before(tree_store, &iter, NULL);
+        }
+        g_free(sort_key);
+
+        if (is_dir) {
+            if (vault_monitors) g_hash_table_remove(vault_monitors, old_path);
+            watch_directory(new_path);
+            file_tree_rebase_children(&iter, old_path, new_path);
+        } else {
+            search_index_remove_path(old_path);
+            search_index_queue(new_path, NULL);
+            link_graph_remove_path(old_path);
+            link_graph_queue(new_path, NULL);
+        }
+    } else {
+        // GtkTreeStore cannot reparent rows, so re-add under the new folder
+        file_tree_remove_iter(&iter);
+        file_tree_add_path(new_path);
+        if (was_selected && file_tree_find_path(new_path, &iter)) {
+            file_tree_select_iter(&iter);
+        }
+    }
+
+    g_free(new_name);
+    g_free(old_parent);
+    g_free(new_parent);
+    return TRUE;
+}
+
+// Keep the open note's path valid when it, or a folder above it, is renamed
+void file_tree_rename_open_path(const char *old_path, const char *new_path) {
+    if (note_load_path && path_has_prefix(note_load_path, old_path)) {
+        char *renamed = g_strconcat(new_path, note_load_path + strlen(old_path), NULL);
+        g_free(note_load_path);
+        note_load_path = renamed;
+    }
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (!path_has_prefix(tab->path, old_path)) continue;
+        char *renamed = g_strconcat(new_path, tab->path + strlen(old_path), NULL);
+        g_free(tab->path);
+        tab->path = renamed;
+        tab_update_label(tab);
+    }
+    if (large_file && path_has_prefix(large_file->path, old_path)) {
+        char *renamed = g_strconcat(new_path, large_file->path + strlen(old_path), NULL);
+        g_free(large_file->path);
+        large_file->path = renamed;
+    }
+    if (!current_file_path || !path_has_prefix(current_file_path, old_path)) return;
+
+    char *renamed = g_strconcat(new_path, current_file_path + strlen(old_path), NULL);
+    g_free(current_file_path);
+    current_file_path = renamed;
+    update_window_title();
+    backlinks_schedule_refresh();
+}
+
+void file_tree_save_scroll_anchor() {
+    g_clear_pointer(&scroll_anchor_path, g_free);
+
+    GtkTreePath *start;
+    if (gtk_tree_view_get_visible_range(tree_view, &start, NULL)) {
+        GtkTreeIter iter;
+        if (gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter, start)) {
+            gtk_tree_model_get(GTK_TREE_MODEL(tree_store), &iter, 1, &scroll_anchor_path, -1);
+        }
+        gtk_tree_path_free(start);
+    }
+}
+
+void file_tree_restore_scroll_anchor() {
+    if (!scroll_anchor_path) return;
+
+    GtkTreeIter iter;
+    if (file_tree_find_path(scroll_anchor_path, &iter)) {
+        GtkTreePath *tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree_store), &iter);
+        gtk_tree_view_scroll_to_cell(tree_view, tree_path, NULL, TRUE, 0.0, 0.0);
+        gtk_tree_path_free(tree_path);
+    }
+    g_clear_pointer(&scroll_anchor_path, g_free);
+}
+
+void vault_monitor_free(gpointer monitor) {
+    g_file_monitor_cancel(G_FILE_MONITOR(monitor));
+    g_object_unref(monitor);
+}
+
+void watch_directory(const char *dir_path) {
+    if (!vault_monitors) {
+        vault_monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, vault_monitor_free);
+    }
+    if (g_hash_table_contains(vault_monitors, dir_path)) return;
+
+    GFile *dir = g_file_new_for_path(dir_path);
+    GError *error = NULL;
+    GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+    g_object_unref(dir);
+    if (!monitor) {
+        g_warning("Failed to watch %s: %s", dir_path, error->message);
+        g_error_free(error);
         return;
     }
 
+    g_signal_connect(monitor, "changed", G_CALLBACK(vault_monitor_changed), NULL);
+    g_hash_table_insert(vault_monitors, g_strdup(dir_path), monitor);
+}
+
+void watch_reset() {
+    if (watch_flush_id) {
+        g_source_remove(watch_flush_id);
+        watch_flush_id = 0;
+    }
+    if (vault_monitors) g_hash_table_remove_all(vault_monitors);
+    if (watch_pending) g_hash_table_remove_all(watch_pending);
+    if (watch_renames) g_hash_table_remove_all(watch_renames);
+    g_clear_pointer(&watch_work, g_ptr_array_unref);
+}
+
+void vault_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                           GFileMonitorEvent event_type, gpointer user_data) {
+    char *path = g_file_get_path(file);
+    char *other_path = other_file ? g_file_get_path(other_file) : NULL;
+
+    switch (event_type) {
+        case G_FILE_MONITOR_EVENT_RENAMED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            // file is the old location, other_file the new one
+            if (other_path) watch_queue_rename(path, other_path);
+            watch_queue_path(path);
+            watch_queue_path(other_path);
+            break;
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+            // file is the new location, other_file the old one
+            if (other_path) watch_queue_rename(other_path, path);
+            watch_queue_path(path);
+            watch_queue_path(other_path);
+            break;
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_DELETED:
+            watch_queue_path(path);
+            break;
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+            // Notes not in the tree yet are indexed when their row is added
+            if (g_hash_table_contains(file_tree_index, path)) {
+                search_index_queue(path, NULL);
+                link_graph_queue(path, NULL);
+            }
+            break;
+        default:
+            break;
+    }
+
+    g_free(path);
+    g_free(other_path);
+}
+
+void watch_schedule_flush() {
+    if (!watch_flush_id) {
+        watch_flush_id = g_timeout_add(WATCH_COALESCE_MS, watch_flush, NULL);
+    }
+}
+
+void watch_queue_path(const char *path) {
+    if (!path || !vault_directory || !path_has_prefix(path, vault_directory)) return;
+
+    if (!watch_pending) {
+        watch_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_add(watch_pending, g_strdup(path));
+    watch_schedule_flush();
+}
+
+void watch_queue_rename(const char *old_path, const char *new_path) {
+    if (!vault_directory || !path_has_prefix(old_path, vault_directory)) return;
+
+    if (!watch_renames) {
+        watch_renames = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+    g_hash_table_insert(watch_renames, g_strdup(old_path), g_strdup(new_path));
+    watch_schedule_flush();
+}
+
+// Apply queued changes now instead of waiting for the coalescing window,
+// used after the app itself creates, renames or deletes a note
+void watch_flush_now() {
+    if (scan_in_progress || watch_work) return;
+
+    if (watch_flush_id) {
+        g_source_remove(watch_flush_id);
+        watch_flush_id = 0;
+    }
+    watch_flush(NULL);
+}
+
+gint watch_path_compare(gconstpointer a, gconstpointer b) {
+    // Plain byte order puts every folder ahead of its contents
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+// Bring the tree in line with disk for every path touched since the last flush.
+// Each path is checked against the filesystem, so a storm of events for the same
+// file collapses into a single row update.
+gboolean watch_flush(gpointer user_data) {
+    // The running scan picks up most of these; reconcile the rest once it is done
+    if (scan_in_progress) return G_SOURCE_CONTINUE;
+
+    if (!watch_work) {
+        file_tree_save_scroll_anchor();
+
+        if (watch_renames && g_hash_table_size(watch_renames) > 0) {
+            GHashTableIter iter;
+            gpointer old_path, new_path;
+            g_hash_table_iter_init(&iter, watch_renames);
+            while (g_hash_table_iter_next(&iter, &old_path, &new_path)) {
+                file_tree_move_path(old_path, new_path);
+            }
+            g_hash_table_remove_all(watch_renames);
+        }
+
+        watch_work = g_ptr_array_new_with_free_func(g_free);
+        if (watch_pending) {
+            GHashTableIter iter;
+            gpointer path;
+            g_hash_table_iter_init(&iter, watch_pending);
+            while (g_hash_table_iter_next(&iter, &path, NULL)) {
+                g_ptr_array_add(watch_work, path);
+                g_hash_table_iter_steal(&iter);
+            }
+        }
+        g_ptr_array_sort(watch_work, watch_path_compare);
+        watch_work_index = 0;
+    }
+
+    gint64 deadline = g_get_monotonic_time() + WATCH_FRAME_BUDGET_US;
+    while (watch_work_index < watch_work->len && g_get_monotonic_time() < deadline) {
+        const char *path = g_ptr_array_index(watch_work, watch_work_index++);
+        GtkTreeIter iter;
+        gboolean in_tree = file_tree_find_path(path, &iter);
+        gboolean on_disk = vault_path_is_listed(path, NULL);
+
+        if (on_disk && !in_tree) {
+            file_tree_add_path(path);
+        } else if (!on_disk && in_tree) {
+            file_tree_remove_iter(&iter);
+        }
+    }
+
+    if (watch_work_index < watch_work->len) {
+        // Large storms continue on the next idle so the UI keeps drawing
+        watch_flush_id = g_idle_add(watch_flush, NULL);
+        return G_SOURCE_REMOVE;
+    }
+
+    g_clear_pointer(&watch_work, g_ptr_array_unref);
+    file_tree_restore_scroll_anchor();
+
+    watch_flush_id = 0;
+    if ((watch_pending && g_hash_table_size(watch_pending) > 0) ||
+        (watch_renames && g_hash_table_size(watch_renames) > 0)) {
+        watch_schedule_flush();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void file_tree_selection_changed(GtkTreeSelection *selection, gpointer data) {
     GtkTreeIter iter;
     GtkTreeModel *model;
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        char *filepath;
-        gtk_tree_model_get(model, &iter, 1, &filepath, -1);
-        g_free(current_file_path);
-        current_file_path = g_strdup(filepath);
-
-        char *content = NULL;
-        g_file_get_contents(filepath, &content, NULL, NULL);
-        if (content) {
-            char *escaped_content = g_markup_escape_text(content, -1);
-            char *script = g_strdup_printf("editor.setMarkdown(`%s`);", escaped_content);
-            webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view), 
-                                             script, -1, NULL, NULL, NULL, NULL, NULL);
-            g_free(script);
-            g_free(escaped_content);
-            g_free(content);
-            is_content_saved = TRUE;
-            update_save_indicator();
-            update_window_title();
-        }
+    // Rows vanishing under the watcher leave nothing selected; that is not a switch
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+
+    char *filepath;
+    gboolean is_dir;
+    gtk_tree_model_get(model, &iter, 1, &filepath, 2, &is_dir, -1);
+    // Folders only expand, and re-selecting the open note keeps the editor as is
+    if (is_dir || g_strcmp0(filepath, current_file_path) == 0 ||
+        g_strcmp0(filepath, note_load_path) == 0) {
+        g_free(filepath);
+        return;
+    }
+
+    // Without autosave, leaving a note with unsaved edits asks first;
+    // otherwise the note being left keeps its edits in its tab
+    if (!autosave_enabled && !tab_check_unsaved()) {
+        if (current_file_path) file_tree_select_path(current_file_path);
         g_free(filepath);
-        show_editor(); // Show the editor when a file is selected
+        return;
     }
+    tab_open(filepath);
+    g_free(filepath);
 }
 
 void toggle_preview(GtkWidget *widget, gpointer data) {
     preview_hidden = gtk_switch_get_active(GTK_SWITCH(widget));
     char *script = g_strdup_printf("togglePreview(!Boolean(%s));", 
                                  preview_hidden ? "true" : "false");
-    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-        script, -1, NULL, NULL, NULL, NULL, NULL);
+    editor_run_script(script, NULL, NULL);
     g_free(script);
+    // Edits made while hidden were not rendered
+    preview_schedule();
 }
 
 
@@ -479,6 +2671,8 @@ void save_note(GtkWidget *widget, gpointer data) {
         save_note_as(widget, data);
         return;
     }
+    // An explicit save reports its own failure even while autosave is quiet
+    autosave_failures = 0;
     save_current_content_to_file(current_file_path);
 }
 
@@ -524,53 +2718,317 @@ void save_note_as(GtkWidget *widget, gpointer data) {
 }
 
 void save_current_content_to_file(const char *filepath) {
-    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-        "editor.getMarkdown();",
-        -1,
-        NULL,
-        NULL,
-        NULL,
-        handle_save_content,
-        (gpointer)filepath);
-}
+    // The editor still shows the previous tab until this note has been read
+    if (note_load_path && g_strcmp0(filepath, note_load_path) == 0) return;
+    if (large_file && g_strcmp0(filepath, large_file->path) == 0) {
+        large_file_save(large_file, edit_seq);
+        return;
+    }
+
+    // The mirror already holds what the editor shows; no round-trip needed
+    if (editor_mirror_valid && editor_mirror_seq == editor_document_seq) {
+        note_save_start(filepath, piece_table_to_string(&editor_mirror), edit_seq);
+        return;
+    }
+
+    // The snapshot is taken right away so it matches the note being shown;
+    // the path is copied as current_file_path may change before the reply
+    NoteSave *request = g_new0(NoteSave, 1);
+    request->path = g_strdup(filepath);
+    request->edit_seq = edit_seq;
+    save_snapshots_pending++;
+
+    editor_run_script("editor.getMarkdown();", handle_save_content, request);
+}
 
 void handle_save_content(GObject *source_object, GAsyncResult *result, gpointer user_data) {
-    const char *filepath = (const char *)user_data;
+    NoteSave *request = user_data;
     GError *error = NULL;
     JSCValue *value = webkit_web_view_evaluate_javascript_finish(WEBKIT_WEB_VIEW(source_object), 
                                                                result, 
                                                                &error);
+    save_snapshots_pending--;
     
+    // Without a snapshot nothing reaches note_save_done(), which re-arms
+    // autosave, and autosave_callback() skipped its turn while this was pending
     if (error) {
         show_error_dialog(error->message);
         g_error_free(error);
+        note_save_free(request);
+        autosave_schedule();
         return;
     }
 
     if (jsc_value_is_string(value)) {
-        char *content = jsc_value_to_string(value);
-        
-        FILE *file = fopen(filepath, "w");
-        if (file) {
-            fputs(content, file);
-            fclose(file);
-            
-            is_content_saved = TRUE;
-            update_save_indicator();
-            
-            // Update window title to show current file
-            char *filename = g_path_get_basename(filepath);
-            char *title = g_strdup_printf("Markdown Notes App - %s", filename);
-            gtk_window_set_title(GTK_WINDOW(window), title);
-            g_free(filename);
-            g_free(title);
-        } else {
-            show_error_dialog("Failed to save file");
-        }
-        g_free(content);
+        note_save_start(request->path, jsc_value_to_string(value), request->edit_seq);
+    } else {
+        autosave_schedule();
     }
     
     g_object_unref(value);
+    note_save_free(request);
+}
+
+// 64-bit hash over whole words, used only to notice unchanged content
+guint64 content_hash64(const void *data, gsize length) {
+    const guint64 m = G_GUINT64_CONSTANT(0xc6a4a7935bd1e995);
+    const guchar *p = data;
+    guint64 h = G_GUINT64_CONSTANT(0x9e3779b97f4a7c15) ^ (length * m);
+
+    for (; length >= 8; p += 8, length -= 8) {
+        guint64 k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+        h = (h ^ k) * m;
+    }
+    if (length > 0) {
+        guint64 k = 0;
+        memcpy(&k, p, length);
+        h = (h ^ k) * m;
+    }
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+    return h;
+}
+
+// Modification time with its sub-second part, so two saves within the same
+// second still tell apart
+gint64 stat_mtime_ns(const GStatBuf *st) {
+    return (gint64)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+void note_file_state_record(const char *path, const NoteFileState *state) {
+    if (!note_file_states) {
+        note_file_states = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+    g_hash_table_insert(note_file_states, g_strdup(path), g_memdup2(state, sizeof(*state)));
+}
+
+// Whether a note was changed by something else since we last read or wrote it
+gboolean note_file_changed_on_disk(const char *path) {
+    NoteFileState *known = note_file_states ? g_hash_table_lookup(note_file_states, path) : NULL;
+    GStatBuf st;
+    if (!known || g_stat(path, &st) != 0) return TRUE;
+    return stat_mtime_ns(&st) != known->mtime || (guint64)st.st_size != known->size;
+}
+
+// Every mode writes a temporary file and renames it over the note, so a crash
+// never leaves a half-written note. "fast" skips the fsync for notes that
+// do not exist yet, "consistent" always syncs the data before the rename and "durable"
+// asks GLib for the strongest guarantee it offers (it does not sync the
+// containing directory)
+GFileSetContentsFlags save_durability_flags() {
+    if (g_strcmp0(save_durability, "fast") == 0) {
+        return G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_ONLY_EXISTING;
+    }
+    if (g_strcmp0(save_durability, "durable") == 0) {
+        return G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_DURABLE;
+    }
+    return G_FILE_SET_CONTENTS_CONSISTENT;
+}
+
+// Write content (taken over) to path on a worker thread. Only one write runs
+// at a time; a newer snapshot of a path replaces one still waiting.
+void note_save_start(const char *path, char *content, guint seq) {
+    NoteSave *save = g_new0(NoteSave, 1);
+    save->path = g_strdup(path);
+    save->edit_seq = seq;
+    save->content = content;
+    save->length = strlen(content);
+    save->trace_start = trace_now();
+    note_save_queue(save);
+}
+
+void note_save_queue(NoteSave *save) {
+    if (!save_running) {
+        note_save_run(save);
+        return;
+    }
+    for (GList *l = save_queue.head; l; l = l->next) {
+        NoteSave *queued = l->data;
+        if (strcmp(queued->path, save->path) == 0) {
+            note_save_free(queued);
+            l->data = save;
+            return;
+        }
+    }
+    g_queue_push_tail(&save_queue, save);
+}
+
+void note_save_run(NoteSave *save) {
+    save_running = save;
+    save->flags = save_durability_flags();
+
+    // Read at start so it reflects the write that ran just before
+    NoteFileState *known = note_file_states ? g_hash_table_lookup(note_file_states, save->path) : NULL;
+    if (known) {
+        save->have_known = TRUE;
+        save->known = *known;
+    }
+
+    GTask *task = g_task_new(NULL, NULL, note_save_done, NULL);
+    g_task_set_task_data(task, save, (GDestroyNotify)note_save_free);
+    g_task_run_in_thread(task, note_save_thread);
+    g_object_unref(task);
+}
+
+void note_save_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    NoteSave *save = task_data;
+    gint64 started = g_get_monotonic_time();
+    GStatBuf st;
+    gboolean exists = g_stat(save->path, &st) == 0;
+
+    if (save->base) {
+        // The rest of the note comes from the mapping, so writing it over a
+        // note changed by something else since would lose that change
+        if (!exists || !save->have_known || stat_mtime_ns(&st) != save->known.mtime ||
+            (guint64)st.st_size != save->known.size) {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG,
+                                    "%s was changed on disk since it was opened", save->path);
+            return;
+        }
+        GError *error = NULL;
+        if (!note_save_write_splice(save, &error)) {
+            g_task_return_error(task, error);
+            return;
+        }
+        save->state.size = g_stat(save->path, &st) == 0 ? (guint64)st.st_size : 0;
+        save->state.mtime = stat_mtime_ns(&st);
+        save->elapsed_us = g_get_monotonic_time() - started;
+        trace_span("save", "note_save_splice", started);
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    save->state.hash = content_hash64(save->content, save->length);
+    save->state.size = save->length;
+
+    // Same bytes as last time and nobody touched the file since: nothing to do
+    if (exists && save->have_known &&
+        save->known.hash == save->state.hash &&
+        save->known.size == save->state.size &&
+        save->known.mtime == stat_mtime_ns(&st) && (guint64)st.st_size == save->state.size) {
+        save->skipped = TRUE;
+        save->state.mtime = stat_mtime_ns(&st);
+        save->elapsed_us = g_get_monotonic_time() - started;
+        trace_span("save", "note_save_skip", started);
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    // Written to a temporary file and renamed over the note, so a crash
+    // leaves either the old or the new content, never a truncated file
+    GError *error = NULL;
+    int mode = exists ? (st.st_mode & 0777) : 0644;
+    if (!g_file_set_contents_full(save->path, save->content, save->length,
+                                  save->flags, mode, &error)) {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    save->state.mtime = g_stat(save->path, &st) == 0 ? stat_mtime_ns(&st) : 0;
+    save->elapsed_us = g_get_monotonic_time() - started;
+    trace_span("save", "note_save_write", started);
+    g_task_return_boolean(task, TRUE);
+}
+
+void note_save_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    GTask *task = G_TASK(result);
+    NoteSave *save = g_task_get_task_data(task);
+    GError *error = NULL;
+
+    trace_span("save", "note_save", save->trace_start);
+    save_running = NULL;
+    NoteSave *next = g_queue_pop_head(&save_queue);
+    if (next) {
+        note_save_run(next);
+    }
+
+    if (!g_task_propagate_boolean(task, &error) && save->base) {
+        large_file_save_failed(save, error);
+        g_error_free(error);
+        return;
+    }
+    if (error) {
+        // Only the first failure is reported; autosave keeps retrying quietly
+        // with a growing delay until a save goes through
+        if (autosave_failures++ == 0) {
+            char *message = g_strdup_printf("Failed to save file: %s", error->message);
+            show_error_dialog(message);
+            g_free(message);
+        }
+        g_error_free(error);
+        update_save_indicator();
+        autosave_schedule();
+        return;
+    }
+
+    if (autosave_failures) {
+        autosave_failures = 0;
+        update_save_indicator();
+    }
+    note_file_state_record(save->path, &save->state);
+    save_count++;
+    if (save->skipped) save_skipped_count++;
+    save_last_us = save->elapsed_us;
+    save_max_us = MAX(save_max_us, save->elapsed_us);
+    g_debug("%s %s (%" G_GSIZE_FORMAT " bytes) in %.2f ms",
+            save->skipped ? "Unchanged, skipped" : "Saved", save->path,
+            save->length, save->elapsed_us / 1000.0);
+
+    // Only a window of a large note is in memory, so it is neither indexed
+    // nor kept in the history
+    if (!save->skipped && !save->base) {
+        // The rename is reported as a move of the temporary file, not a change
+        search_index_queue(save->path, save->content);
+        link_graph_queue(save->path, save->content);
+        recent_touch(save->path, RECENT_SAVE_WEIGHT);
+        history_queue_append(save->path, save->content, save->length);
+        save->content = NULL;
+    }
+
+    // A background tab is clean once its last snapshot is written
+    EditorTab *tab = tab_find(save->path);
+    if (tab && tab != tab_active && save->edit_seq == tab->edit_seq) {
+        tab->saved = TRUE;
+        tab_update_label(tab);
+    }
+
+    // Typing after the snapshot keeps the note dirty for the next autosave
+    if (g_strcmp0(save->path, current_file_path) == 0 && save->edit_seq == edit_seq) {
+        is_content_saved = TRUE;
+        autosave_dirty_since = 0;
+        update_save_indicator();
+        update_window_title();
+    } else {
+        // The active note or a background tab is still dirty
+        autosave_schedule();
+    }
+    if (large_file && large_file->reopen && is_content_saved &&
+        g_strcmp0(save->path, large_file->path) == 0) {
+        large_file_reopen();
+    }
+    update_save_stats();
+}
+
+void note_save_free(NoteSave *save) {
+    if (save->base) g_bytes_unref(save->base);
+    g_free(save->path);
+    g_free(save->content);
+    g_free(save);
+}
+
+// Save latency and skip counts, shown on the save indicator
+void update_save_stats() {
+    char *tooltip = g_strdup_printf("Last save %.1f ms, slowest %.1f ms\n"
+                                    "%u saves, %u skipped as unchanged",
+                                    save_last_us / 1000.0, save_max_us / 1000.0,
+                                    save_count, save_skipped_count);
+    gtk_widget_set_tooltip_text(save_indicator_label, tooltip);
+    g_free(tooltip);
 }
 
 void show_error_dialog(const char *message) {
@@ -619,24 +3077,12 @@ void add_note(GtkWidget *widget, gpointer data) {
         FILE *file = fopen(filepath, "w");
         if (file) {
             fclose(file);
-            refresh_file_tree();
-            
-            // Select the new file
-            GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
-            GtkTreeIter iter;
-            gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
-            while (valid) {
-                char *path;
-                gtk_tree_model_get(model, &iter, 1, &path, -1);
-                if (g_strcmp0(path, filepath) == 0) {
-                    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-                    gtk_tree_selection_select_iter(selection, &iter);
-                    g_free(path);
-                    break;
-                }
-                g_free(path);
-                valid = gtk_tree_model_iter_next(model, &iter);
-            }
+
+            // Select the new file as soon as its row is in the tree
+            g_free(pending_tree_selection);
+            pending_tree_selection = g_strdup(filepath);
+            watch_queue_path(filepath);
+            watch_flush_now();
         } else {
             show_error_dialog("Failed to create new note");
         }
@@ -645,134 +3091,6 @@ void add_note(GtkWidget *widget, gpointer data) {
     gtk_widget_destroy(dialog);
 }
 
-void delete_note(GtkWidget *widget, gpointer data) {
-    GtkListBoxRow *selected_row = gtk_list_box_get_selected_row(GTK_LIST_BOX(list_box));
-    if (selected_row != NULL) {
-        int index = gtk_list_box_row_get_index(selected_row);
-        for (int i = index; i < noteCount - 1; i++) {
-            notes[i] = notes[i + 1];
-        }
-        noteCount--;
-        update_notes_list();
-
-        webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-            "editor.setMarkdown('');",
-            -1,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL);
-    }
-}
-
-void note_selected(GtkListBox *box, GtkListBoxRow *row, gpointer data) {
-    // Check for unsaved changes before switching
-    if (!is_content_saved && !check_unsaved_changes()) {
-        // User cancelled, reselect the previous row
-        if (current_file_path) {
-            // Find and select the row corresponding to current_file_path
-            GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
-            GtkTreeIter iter;
-            gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
-            while (valid) {
-                char *filepath;
-                gtk_tree_model_get(model, &iter, 1, &filepath, -1);
-                if (g_strcmp0(filepath, current_file_path) == 0) {
-                    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-                    gtk_tree_selection_select_iter(selection, &iter);
-                    g_free(filepath);
-                    break;
-                }
-                g_free(filepath);
-                valid = gtk_tree_model_iter_next(model, &iter);
-            }
-        }
-        return;
-    }
-
-    if (row != NULL) {
-        int index = gtk_list_box_row_get_index(row);
-        char *escaped_content = g_markup_escape_text(notes[index].content, -1);
-        char *script = g_strdup_printf("editor.setMarkdown(`%s`);", escaped_content);
-        
-        webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-            script,
-            -1,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL);
-
-        g_free(escaped_content);
-        g_free(script);
-        
-        is_content_saved = TRUE;
-        update_save_indicator();
-    } else {
-        webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-            "editor.setMarkdown('');",
-            -1,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL);
-    }
-}
-
-void update_notes_list() {
-    GList *children, *iter;
-    children = gtk_container_get_children(GTK_CONTAINER(list_box));
-    for (iter = children; iter != NULL; iter = g_list_next(iter))
-        gtk_widget_destroy(GTK_WIDGET(iter->data));
-    g_list_free(children);
-
-    for (int i = 0; i < noteCount; i++) {
-        char label[50];
-        snprintf(label, sizeof(label), "Note %d", notes[i].id);
-        GtkWidget *label_widget = gtk_label_new(label);
-        gtk_list_box_insert(GTK_LIST_BOX(list_box), label_widget, -1);
-    }
-    gtk_widget_show_all(list_box);
-}
-
-void get_editor_content(GtkWidget *widget, gpointer data) {
-    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-        "editor.getMarkdown();",
-        -1,
-        NULL,
-        NULL,
-        NULL,
-        handle_editor_content,
-        NULL);
-}
-
-void handle_editor_content(GObject *source_object, GAsyncResult *result, gpointer user_data) {
-    GError *error = NULL;
-    JSCValue *value = webkit_web_view_evaluate_javascript_finish(WEBKIT_WEB_VIEW(source_object), 
-                                                               result, 
-                                                               &error);
-    if (error) {
-        g_warning("Error getting content: %s", error->message);
-        g_error_free(error);
-        return;
-    }
-
-    if (jsc_value_is_string(value)) {
-        char *markdown_content = jsc_value_to_string(value);
-        GtkListBoxRow *selected_row = gtk_list_box_get_selected_row(GTK_LIST_BOX(list_box));
-        if (selected_row != NULL) {
-            int index = gtk_list_box_row_get_index(selected_row);
-            strncpy(notes[index].content, markdown_content, MAX_LENGTH - 1);
-            notes[index].content[MAX_LENGTH - 1] = '\0';
-        }
-        g_free(markdown_content);
-    }
-    g_object_unref(value);
-}
-
 void update_window_title() {
     char *title;
     if (current_file_path) {
@@ -787,49 +3105,73 @@ void update_window_title() {
     }
     gtk_window_set_title(GTK_WINDOW(window), title);
     g_free(title);
+    if (tab_active) {
+        tab_active->saved = is_content_saved;
+        tab_update_label(tab_active);
+    }
 }
 
 void mark_content_unsaved() {
-    is_content_saved = FALSE;
-    update_save_indicator();
-    update_window_title();
+    edit_seq++;
+    if (is_content_saved) {
+        is_content_saved = FALSE;
+        update_save_indicator();
+        update_window_title();
+    }
+    autosave_schedule();
+}
 
-    if (autosave_enabled && current_file_path) {
-        save_current_content_to_file(current_file_path);
+// (Re)arm the autosave timer after an edit
+void autosave_schedule() {
+    if (!autosave_enabled) return;
+    if ((!current_file_path || is_content_saved) && !tab_stashed_unsaved()) return;
+
+    gint64 now = g_get_monotonic_time();
+    if (!autosave_dirty_since) autosave_dirty_since = now;
+    gint64 waited_ms = (now - autosave_dirty_since) / 1000;
+    guint delay = waited_ms >= AUTOSAVE_MAX_DELAY_MS ? 0 :
+                  MIN(AUTOSAVE_IDLE_MS, AUTOSAVE_MAX_DELAY_MS - waited_ms);
+    if (autosave_failures) {
+        delay = MIN((guint64)AUTOSAVE_IDLE_MS << MIN(autosave_failures, 6),
+                    AUTOSAVE_RETRY_MAX_MS);
+    }
+
+    if (autosave_timeout_id) {
+        g_source_remove(autosave_timeout_id);
     }
+    autosave_timeout_id = g_timeout_add(delay, autosave_callback, NULL);
 }
 
 void update_save_indicator() {
-    gtk_label_set_text(GTK_LABEL(save_indicator_label), 
-                      is_content_saved ? "Saved" : "Unsaved*");
+    gtk_label_set_text(GTK_LABEL(save_indicator_label),
+                      is_content_saved ? "Saved" :
+                      autosave_failures ? "Save failed*" : "Unsaved*");
 }
 
 gboolean autosave_callback(gpointer user_data) {
-    if (autosave_enabled && current_file_path && !is_content_saved) {
+    autosave_timeout_id = 0;
+
+    // With a save still outstanding, note_save_done() schedules the next one
+    if (save_snapshots_pending > 0 || save_running) return G_SOURCE_REMOVE;
+
+    if (!autosave_enabled) return G_SOURCE_REMOVE;
+    // Background tabs edited after they were left are saved from their mirror
+    tab_save_stashed();
+    if (current_file_path && !is_content_saved) {
         save_current_content_to_file(current_file_path);
     }
-    return G_SOURCE_CONTINUE;
+    return G_SOURCE_REMOVE;
 }
 
 void toggle_autosave(GtkWidget *widget, gpointer data) {
     autosave_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
     
     if (autosave_enabled) {
-        // Save immediately if there's unsaved content
-        if (!is_content_saved && current_file_path) {
-            save_current_content_to_file(current_file_path);
-        }
-        
-        // Set up the autosave timer if not already running
-        if (autosave_timeout_id == 0) {
-            autosave_timeout_id = g_timeout_add_seconds(30, autosave_callback, NULL);
-        }
-    } else {
-        // Remove the autosave timer if it exists
-        if (autosave_timeout_id > 0) {
-            g_source_remove(autosave_timeout_id);
-            autosave_timeout_id = 0;
-        }
+        // Save soon if there's unsaved content
+        autosave_schedule();
+    } else if (autosave_timeout_id > 0) {
+        g_source_remove(autosave_timeout_id);
+        autosave_timeout_id = 0;
     }
 }
 
@@ -839,6 +3181,24 @@ gboolean check_unsaved_changes() {
         return TRUE;
     }
 
+    switch (unsaved_changes_dialog()) {
+        case GTK_RESPONSE_YES:
+            if (current_file_path) {
+                save_current_content_to_file(current_file_path);
+            } else {
+                save_note_as(NULL, NULL);
+            }
+            return TRUE;
+        case GTK_RESPONSE_NO:
+            return TRUE;
+        case GTK_RESPONSE_CANCEL:
+        default:
+            return FALSE;
+    }
+}
+
+// GTK_RESPONSE_YES to save, GTK_RESPONSE_NO to discard, anything else cancels
+gint unsaved_changes_dialog() {
     GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window),
                                              GTK_DIALOG_MODAL,
                                              GTK_MESSAGE_WARNING,
@@ -853,21 +3213,7 @@ gboolean check_unsaved_changes() {
 
     gint response = gtk_dialog_run(GTK_DIALOG(dialog));
     gtk_widget_destroy(dialog);
-
-    switch (response) {
-        case GTK_RESPONSE_YES:
-            if (current_file_path) {
-                save_current_content_to_file(current_file_path);
-            } else {
-                save_note_as(NULL, NULL);
-            }
-            return TRUE;
-        case GTK_RESPONSE_NO:
-            return TRUE;
-        case GTK_RESPONSE_CANCEL:
-        default:
-            return FALSE;
-    }
+    return response;
 }
 
 void rename_file(GtkWidget *menuitem, gpointer userdata) {
@@ -878,9 +3224,11 @@ void rename_file(GtkWidget *menuitem, gpointer userdata) {
     if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
         char *filepath;
         char *filename;
+        gboolean is_dir;
         gtk_tree_model_get(model, &iter, 
                           0, &filename,
                           1, &filepath, 
+                          2, &is_dir,
                           -1);
 
         GtkWidget *dialog = gtk_dialog_new_with_buttons("Rename File",
@@ -900,20 +3248,19 @@ void rename_file(GtkWidget *menuitem, gpointer userdata) {
 
         if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
             const char *new_filename = gtk_entry_get_text(GTK_ENTRY(entry));
-            char *new_filepath = g_build_filename(vault_directory, new_filename, NULL);
+            // Rename in place, nested notes stay in their own folder
+            char *parent_dir = g_path_get_dirname(filepath);
+            char *new_filepath = g_build_filename(parent_dir, new_filename, NULL);
+            g_free(parent_dir);
             
             // Ensure .md extension
-            if (!g_str_has_suffix(new_filepath, ".md")) {
+            if (!is_dir && !g_str_has_suffix(new_filepath, ".md")) {
                 char *temp = g_strconcat(new_filepath, ".md", NULL);
                 g_free(new_filepath);
                 new_filepath = temp;
             }
 
-            if (g_rename(filepath, new_filepath) == 0) {
-                refresh_file_tree();
-            } else {
-                show_error_dialog("Failed to rename file");
-            }
+            rename_start(filepath, new_filepath, is_dir);
             g_free(new_filepath);
         }
         
@@ -931,9 +3278,11 @@ void delete_file(GtkWidget *menuitem, gpointer userdata) {
     if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
         char *filepath;
         char *filename;
+        gboolean is_dir;
         gtk_tree_model_get(model, &iter, 
                           0, &filename,
                           1, &filepath, 
+                          2, &is_dir,
                           -1);
 
         GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window),
@@ -943,8 +3292,10 @@ void delete_file(GtkWidget *menuitem, gpointer userdata) {
                                                  "Delete file '%s'?", filename);
 
         if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_YES) {
-            if (g_unlink(filepath) == 0) {
-                refresh_file_tree();
+            // Folders are only removed when empty
+            if ((is_dir ? g_rmdir(filepath) : g_unlink(filepath)) == 0) {
+                watch_queue_path(filepath);
+                watch_flush_now();
             } else {
                 show_error_dialog("Failed to delete file");
             }
@@ -961,12 +3312,15 @@ gboolean on_tree_button_press(GtkWidget *widget, GdkEventButton *event, gpointer
         GtkWidget *menu = gtk_menu_new();
         GtkWidget *rename_item = gtk_menu_item_new_with_label("Rename");
         GtkWidget *delete_item = gtk_menu_item_new_with_label("Delete");
+        GtkWidget *history_item = gtk_menu_item_new_with_label("History…");
 
         g_signal_connect(rename_item, "activate", G_CALLBACK(rename_file), NULL);
         g_signal_connect(delete_item, "activate", G_CALLBACK(delete_file), NULL);
+        g_signal_connect(history_item, "activate", G_CALLBACK(history_show), NULL);
 
         gtk_menu_shell_append(GTK_MENU_SHELL(menu), rename_item);
         gtk_menu_shell_append(GTK_MENU_SHELL(menu), delete_item);
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), history_item);
 
         gtk_widget_show_all(menu);
         gtk_menu_popup_at_pointer(GTK_MENU(menu), (GdkEvent*)event);
@@ -990,8 +3344,7 @@ void apply_dark_mode() {
             "document.body.classList.add('dark-theme');" :
             "document.body.classList.remove('dark-theme');";
         
-        webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-            script, -1, NULL, NULL, NULL, NULL, NULL);
+        editor_run_script(script, NULL, NULL);
     }
 
     // Force redraw
@@ -1013,6 +3366,7 @@ void init_config() {
     
     // Set config file path
     config_file_path = g_build_filename(config_dir, "user.conf", NULL);
+    session_file_path = g_build_filename(config_dir, "session", NULL);
     g_free(config_dir);
     
     // Load config if it exists, otherwise create default
@@ -1023,54 +3377,96 @@ void init_config() {
     }
 }
 
-void load_config() {
+// Read user.conf into the settings globals. No widgets are touched, so this
+// also runs headless; applying the settings is up to the caller.
+gboolean config_read(char **last_file) {
     GKeyFile *keyfile = g_key_file_new();
     GError *error = NULL;
-    
-    if (g_key_file_load_from_file(keyfile, config_file_path, G_KEY_FILE_NONE, &error)) {
+    gboolean loaded = g_key_file_load_from_file(keyfile, config_file_path, G_KEY_FILE_NONE, &error);
+
+    if (loaded) {
         char *saved_vault = g_key_file_get_string(keyfile, "Settings", "vault_directory", NULL);
         if (saved_vault) {
             g_free(vault_directory);
             vault_directory = saved_vault;
-            refresh_file_tree();
+        }
+        dark_mode_enabled = g_key_file_get_boolean(keyfile, "Settings", "dark_mode", NULL);
+        preview_hidden = g_key_file_get_boolean(keyfile, "Settings", "preview_hidden", NULL);
+        editor_cdn_fallback = g_key_file_get_boolean(keyfile, "Settings", "editor_cdn_fallback", NULL);
+
+        g_free(save_durability);
+        save_durability = g_key_file_get_string(keyfile, "Settings", "save_durability", NULL);
+
+        if (g_key_file_has_key(keyfile, "History", "keep_days", NULL)) {
+            history_keep_days = MAX(0, g_key_file_get_integer(keyfile, "History", "keep_days", NULL));
+        }
+        if (g_key_file_has_key(keyfile, "History", "keep_versions", NULL)) {
+            history_keep_versions = MAX(1, g_key_file_get_integer(keyfile, "History", "keep_versions", NULL));
+        }
+        // Two hot tabs at least, so the one just left is never evicted on switching
+        if (g_key_file_has_key(keyfile, "Tabs", "hot_max", NULL)) {
+            tab_hot_max = MAX(2, g_key_file_get_integer(keyfile, "Tabs", "hot_max", NULL));
+        }
+        if (g_key_file_has_key(keyfile, "Tabs", "memory_budget_mb", NULL)) {
+            tab_memory_budget_mb = MAX(1, g_key_file_get_integer(keyfile, "Tabs", "memory_budget_mb", NULL));
+        }
+        if (g_key_file_has_key(keyfile, "LargeFiles", "threshold_mb", NULL)) {
+            large_file_threshold_mb = MAX(1, g_key_file_get_integer(keyfile, "LargeFiles", "threshold_mb", NULL));
+        }
+        quick_open_recent_read(keyfile);
+
+        *last_file = g_key_file_get_string(keyfile, "Settings", "last_file", NULL);
+    } else {
+        g_error_free(error);
+    }
+
+    g_key_file_free(keyfile);
+    return loaded;
+}
+
+void load_config() {
+    gint64 started = trace_now();
+    char *last_file = NULL;
+
+    if (config_read(&last_file)) {
+        if (vault_directory) {
             update_vault_label();
+            // At startup the scan waits until the window has painted
+            if (startup_painted) {
+                refresh_file_tree();
+            }
         }
         
-        dark_mode_enabled = g_key_file_get_boolean(keyfile, "Settings", "dark_mode", NULL);
         if (dark_mode_enabled) {
             gtk_switch_set_active(GTK_SWITCH(dark_mode_switch), TRUE);
         }
-        
-        preview_hidden = g_key_file_get_boolean(keyfile, "Settings", "preview_hidden", NULL);
         if (preview_toggle_switch) {
             gtk_switch_set_active(GTK_SWITCH(preview_toggle_switch), preview_hidden);
         }
-        
         apply_dark_mode();
-        
-        char *last_file = g_key_file_get_string(keyfile, "Settings", "last_file", NULL);
-        if (last_file && g_file_test(last_file, G_FILE_TEST_EXISTS)) {
-            g_free(current_file_path);
-            current_file_path = last_file;
-            
-            char *content = NULL;
-            if (g_file_get_contents(current_file_path, &content, NULL, NULL)) {
-                char *escaped_content = g_markup_escape_text(content, -1);
-                char *script = g_strdup_printf("editor.setMarkdown(`%s`);", escaped_content);
-                webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-                    script, -1, NULL, NULL, NULL, NULL, NULL);
-                g_free(script);
-                g_free(escaped_content);
-                g_free(content);
-                is_content_saved = TRUE;
-                update_save_indicator();
-                update_window_title();
-                show_editor();
+
+        // The session snapshot, when there is one for this vault, brings back
+        // every open note; last_file is only the fallback
+        if (session_read()) {
+            g_clear_pointer(&last_file, g_free);
+            if (startup_painted) {
+                session_restore_tabs();
+            } else {
+                startup_waiting_for_note = session_restore->active < session_restore->paths->len;
             }
         }
+
+        if (last_file && startup_painted) {
+            tab_open(last_file);
+        } else if (last_file) {
+            g_free(startup_last_file);
+            startup_last_file = g_strdup(last_file);
+            startup_waiting_for_note = TRUE;
+        }
+        g_free(last_file);
     }
     
-    g_key_file_free(keyfile);
+    trace_span("startup", "load_config", started);
 }
 void save_config() {
     GKeyFile *keyfile = g_key_file_new();
@@ -1081,6 +3477,15 @@ void save_config() {
     
     g_key_file_set_boolean(keyfile, "Settings", "dark_mode", dark_mode_enabled);
     g_key_file_set_boolean(keyfile, "Settings", "preview_hidden", preview_hidden);
+    g_key_file_set_boolean(keyfile, "Settings", "editor_cdn_fallback", editor_cdn_fallback);
+    g_key_file_set_string(keyfile, "Settings", "save_durability",
+                          save_durability ? save_durability : "consistent");
+    g_key_file_set_integer(keyfile, "History", "keep_days", history_keep_days);
+    g_key_file_set_integer(keyfile, "History", "keep_versions", history_keep_versions);
+    g_key_file_set_integer(keyfile, "Tabs", "hot_max", tab_hot_max);
+    g_key_file_set_integer(keyfile, "Tabs", "memory_budget_mb", tab_memory_budget_mb);
+    g_key_file_set_integer(keyfile, "LargeFiles", "threshold_mb", large_file_threshold_mb);
+    quick_open_recent_write(keyfile);
     
     if (current_file_path) {
         g_key_file_set_string(keyfile, "Settings", "last_file", current_file_path);
@@ -1108,24 +3513,53 @@ void update_vault_label() {
 }
 
 void register_web_handlers(WebKitUserContentManager *manager) {
-    webkit_user_content_manager_register_script_message_handler(manager, "contentChanged");
+    // Connected without a detail, these bracket every message handler below
+    if (trace_events) {
+        g_signal_connect(manager, "script-message-received",
+                         G_CALLBACK(trace_message_begin), NULL);
+        g_signal_connect_after(manager, "script-message-received",
+                               G_CALLBACK(trace_message_end), NULL);
+    }
+
+    webkit_user_content_manager_register_script_message_handler(manager, "contentDelta");
+    webkit_user_content_manager_register_script_message_handler(manager, "contentReset");
     webkit_user_content_manager_register_script_message_handler(manager, "newNote");
     webkit_user_content_manager_register_script_message_handler(manager, "openFile");
     webkit_user_content_manager_register_script_message_handler(manager, "editorInitialized");
+    webkit_user_content_manager_register_script_message_handler(manager, "search");
+    webkit_user_content_manager_register_script_message_handler(manager, "documentLoaded");
+    webkit_user_content_manager_register_script_message_handler(manager, "largeFileEdit");
+    webkit_user_content_manager_register_script_message_handler(manager, "largeFileDone");
+    webkit_user_content_manager_register_script_message_handler(manager, "viewState");
     
-    g_signal_connect(manager, "script-message-received::contentChanged", 
-                     G_CALLBACK(mark_content_unsaved), NULL);
+    g_signal_connect(manager, "script-message-received::contentDelta",
+                     G_CALLBACK(handle_content_delta), NULL);
+    g_signal_connect(manager, "script-message-received::contentReset",
+                     G_CALLBACK(handle_content_reset), NULL);
     g_signal_connect(manager, "script-message-received::newNote", 
                      G_CALLBACK(handle_new_note), NULL);
     g_signal_connect(manager, "script-message-received::openFile", 
                      G_CALLBACK(handle_open_file), NULL);
     g_signal_connect(manager, "script-message-received::editorInitialized", 
                      G_CALLBACK(handle_editor_initialized), NULL);
+    g_signal_connect(manager, "script-message-received::search",
+                     G_CALLBACK(handle_search), NULL);
+    g_signal_connect(manager, "script-message-received::documentLoaded",
+                     G_CALLBACK(handle_document_loaded), NULL);
+    g_signal_connect(manager, "script-message-received::largeFileEdit",
+                     G_CALLBACK(handle_large_file_edit), NULL);
+    g_signal_connect(manager, "script-message-received::largeFileDone",
+                     G_CALLBACK(handle_large_file_done), NULL);
+    g_signal_connect(manager, "script-message-received::viewState",
+                     G_CALLBACK(handle_view_state), NULL);
 }
 
 void handle_editor_initialized(WebKitUserContentManager *manager, 
                              WebKitJavascriptResult *js_result, 
                              gpointer user_data) {
+    editor_ready = TRUE;
+    startup_milestone("editorInitialized");
+
     // Apply initial settings
     if (dark_mode_enabled) {
         apply_dark_mode();
@@ -1134,160 +3568,6877 @@ void handle_editor_initialized(WebKitUserContentManager *manager,
     if (preview_hidden) {
         char *script = g_strdup_printf("window.togglePreview(!Boolean(%s));", 
                                      preview_hidden ? "true" : "false");
-        webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-            script, -1, NULL, NULL, NULL, NULL, NULL);
+        editor_run_script(script, NULL, NULL);
         g_free(script);
     }
 
+    // A note chosen before the page finished loading is fetched now
+    if (large_file) {
+        char script[96];
+        g_snprintf(script, sizeof(script), "openLargeFile(%u, %" G_GUINT64_FORMAT ", %s, false);",
+                   large_file->seq, large_file->line_count,
+                   large_file->checkpoints ? "true" : "false");
+        editor_run_script(script, NULL, NULL);
+    } else if (editor_document) {
+        editor_request_document();
+    }
+
+    preview_schedule();
+
     // Show the appropriate view
-    if (current_file_path) {
+    if (current_file_path || note_load_path) {
         show_editor();
     } else {
         show_start_page();
     }
+    startup_check_ready();
+}
+
+// The editor finished applying a document fetched by loadDocument()
+void handle_document_loaded(WebKitUserContentManager *manager,
+                            WebKitJavascriptResult *js_result,
+                            gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    if ((guint)jsc_value_to_double(val) != editor_document_seq) return;
+
+    trace_span("note", "note_open", trace_note_open_start);
+    trace_note_open_start = 0;
+    if (startup_waiting_for_note) {
+        startup_waiting_for_note = FALSE;
+        startup_milestone("last note shown");
+        startup_check_ready();
+    }
 }
 
 
 void update_recent_files() {
     if (!web_view) return;
-    
-    // Create JSON array of recent files
-    GString *json = g_string_new("[");
-    // Add your recent files logic here
-    // Example:
-    if (vault_directory) {
-        GDir *dir = g_dir_open(vault_directory, 0, NULL);
-        if (dir) {
-            const gchar *filename;
-            gboolean first = TRUE;
-            while ((filename = g_dir_read_name(dir))) {
-                if (g_str_has_suffix(filename, ".md")) {
-                    if (!first) g_string_append(json, ",");
-                    char *full_path = g_build_filename(vault_directory, filename, NULL);
-                    g_string_append_printf(json, 
-                        "{\"name\":\"%s\",\"path\":\"%s\"}", 
-                        filename, full_path);
-                    g_free(full_path);
-                    first = FALSE;
-                }
-            }
-            g_dir_close(dir);
-        }
-    }
-    g_string_append(json, "]");
 
-    char *script = g_strdup_printf("updateRecentFiles(%s)", json->str);
-    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-        script, -1, NULL, NULL, NULL, NULL, NULL);
-    
-    g_string_free(json, TRUE);
+    char *json = recent_files_json(vault_directory, RECENT_FILES_MAX);
+    char *script = g_strdup_printf("updateRecentFiles(%s)", json);
+    editor_run_script(script, NULL, NULL);
+    g_free(json);
     g_free(script);
 }
 
 void show_start_page() {
-    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-        "showStartPage()", -1, NULL, NULL, NULL, NULL, NULL);
+    editor_run_script("showStartPage()", NULL, NULL);
     update_recent_files();
 }
 
 void show_editor() {
-    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
-        "showEditor()", -1, NULL, NULL, NULL, NULL, NULL);
+    editor_run_script("showEditor()", NULL, NULL);
 }
 
-void handle_new_note(WebKitUserContentManager *manager, 
+// Hand note content to the editor. The bytes are served as-is from
+// envelope://app/document/<seq>; only the sequence number goes through script,
+// so content is never escaped, copied into JS source or parsed as code.
+void editor_load_document(GBytes *bytes) {
+    g_clear_pointer(&editor_document, g_bytes_unref);
+    editor_document = g_bytes_ref(bytes);
+    editor_document_seq++;
+
+    // The editor reports edits to this text from now on
+    piece_table_reset(&editor_mirror, bytes);
+    editor_mirror_seq = editor_document_seq;
+    editor_mirror_valid = TRUE;
+    preview_schedule();
+
+    // It goes into the active tab's editor, which now lives in the page
+    if (tab_active) {
+        tab_active->hot = TRUE;
+        tab_active->bytes = g_bytes_get_size(bytes);
+    }
+
+    // Until the editor reports in, handle_editor_initialized() asks for it
+    if (!editor_ready) return;
+    editor_request_document();
+}
+
+// Have the page fetch the current document into the active tab's editor. A
+// view saved for the tab is applied along with the text, so the note appears
+// where it was left without first showing its top.
+void editor_request_document() {
+    EditorTab *tab = tab_active;
+    char *view = NULL;
+    if (tab && tab->view_pending) {
+        view = g_strdup_printf("{anchorLine: %u, anchorCh: %u, headLine: %u, headCh: %u, "
+                               "scrollTop: %d, previewTop: %d}",
+                               tab->view.anchor_line, tab->view.anchor_ch,
+                               tab->view.head_line, tab->view.head_ch,
+                               tab->view.scroll_top, tab->view.preview_top);
+        tab->view_pending = FALSE;
+    }
+    char *script = g_strdup_printf("loadDocument(%u, %u, %s);", editor_document_seq,
+                                   tab ? tab->id : 0, view ? view : "null");
+    editor_run_script(script, NULL, NULL);
+    g_free(script);
+    g_free(view);
+}
+
+// Read a note on a worker thread. Picking another note first cancels this one.
+void note_load_start(const char *path) {
+    if (note_load_cancellable) {
+        g_cancellable_cancel(note_load_cancellable);
+        g_clear_object(&note_load_cancellable);
+    }
+    note_load_cancellable = g_cancellable_new();
+    g_free(note_load_path);
+    note_load_path = g_strdup(path);
+
+    NoteLoad *load = g_new0(NoteLoad, 1);
+    load->path = g_strdup(path);
+    load->seq = ++note_load_seq;
+    load->trace_start = trace_now();
+    trace_note_open_start = load->trace_start;
+
+    GTask *task = g_task_new(NULL, note_load_cancellable, note_load_done, NULL);
+    g_task_set_task_data(task, load, (GDestroyNotify)note_load_free);
+    g_task_run_in_thread(task, note_load_thread);
+    g_object_unref(task);
+}
+
+// Drop a read in progress; the note is read again when it is next shown
+void note_load_cancel() {
+    if (!note_load_cancellable) return;
+    g_cancellable_cancel(note_load_cancellable);
+    g_clear_object(&note_load_cancellable);
+    g_clear_pointer(&note_load_path, g_free);
+    note_load_seq++;
+}
+
+void note_load_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    NoteLoad *load = task_data;
+    GError *error = NULL;
+    gint64 started = trace_now();
+
+    // Mapped pages are only faulted in as WebKit reads the document
+    GMappedFile *mapped = g_mapped_file_new(load->path, FALSE, &error);
+    if (!mapped) {
+        g_task_return_error(task, error);
+        return;
+    }
+    GBytes *bytes = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    // Large notes are neither hashed nor validated, which would read them
+    // whole; the view only ever touches the lines it shows
+    GStatBuf st;
+    gsize length;
+    const void *data = g_bytes_get_data(bytes, &length);
+    if (length >= (gsize)large_file_threshold_mb * 1024 * 1024) {
+        load->large = TRUE;
+        load->state.size = length;
+        load->state.mtime = g_stat(load->path, &st) == 0 ? stat_mtime_ns(&st) : 0;
+        g_task_return_pointer(task, bytes, (GDestroyNotify)g_bytes_unref);
+        return;
+    }
+
+    // Remember what is on disk so saving identical content can be skipped
+    load->state.hash = content_hash64(data, length);
+    load->state.size = length;
+    load->state.mtime = g_stat(load->path, &st) == 0 ? stat_mtime_ns(&st) : 0;
+
+    if (g_task_return_error_if_cancelled(task)) {
+        g_bytes_unref(bytes);
+        return;
+    }
+
+    GBytes *text = note_normalize_text(bytes);
+    g_bytes_unref(bytes);
+    trace_span("note", "note_read", started);
+    g_task_return_pointer(task, text, (GDestroyNotify)g_bytes_unref);
+}
+
+// Valid UTF-8 with LF line endings. Returns a new reference to the input when
+// it is already clean, which is the common case and avoids any copy.
+GBytes* note_normalize_text(GBytes *bytes) {
+    gsize length;
+    const char *data = g_bytes_get_data(bytes, &length);
+    gboolean valid = g_utf8_validate_len(data, length, NULL);
+    gboolean has_cr = length > 0 && memchr(data, '\r', length) != NULL;
+    if (valid && !has_cr) return g_bytes_ref(bytes);
+
+    char *text = valid ? g_strndup(data, length) : g_utf8_make_valid(data, length);
+    if (has_cr) {
+        // CRLF and lone CR both become LF
+        char *out = text;
+        for (const char *in = text; *in; in++) {
+            if (*in == '\r') {
+                *out++ = '\n';
+                if (in[1] == '\n') in++;
+            } else {
+                *out++ = *in;
+            }
+        }
+        *out = '\0';
+    }
+    return g_bytes_new_take(text, strlen(text));
+}
+
+void note_load_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    GTask *task = G_TASK(result);
+    NoteLoad *load = g_task_get_task_data(task);
+    GError *error = NULL;
+    GBytes *text = g_task_propagate_pointer(task, &error);
+
+    // Superseded by a later pick
+    if (load->seq != note_load_seq) {
+        if (text) g_bytes_unref(text);
+        g_clear_error(&error);
+        return;
+    }
+    g_clear_object(&note_load_cancellable);
+
+    if (!text) {
+        // The last note from the config may have been deleted since; startup
+        // then goes on without it
+        gboolean missing_at_startup = startup_waiting_for_note &&
+            g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+        if (!missing_at_startup && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            char *message = g_strdup_printf("Failed to open note: %s", error->message);
+            show_error_dialog(message);
+            g_free(message);
+        }
+        g_error_free(error);
+        g_clear_pointer(&note_load_path, g_free);
+        EditorTab *tab = tab_find(load->path);
+        if (tab) tab_close(tab);
+        if (startup_waiting_for_note) {
+            startup_waiting_for_note = FALSE;
+            show_start_page();
+            startup_check_ready();
+        }
+        return;
+    }
+
+    g_free(current_file_path);
+    current_file_path = note_load_path;
+    note_load_path = NULL;
+    quick_open_note_opened(current_file_path);
+    recent_touch(current_file_path, RECENT_OPEN_WEIGHT);
+    note_file_state_record(current_file_path, &load->state);
+
+    if (load->large) {
+        large_file_open(current_file_path, text, FALSE);
+    } else {
+        editor_load_document(text);
+    }
+    g_bytes_unref(text);
+    trace_span("note", "note_load", load->trace_start);
+    is_content_saved = TRUE;
+    autosave_dirty_since = 0;
+    update_save_indicator();
+    update_window_title();
+    show_editor();
+}
+
+void note_load_free(NoteLoad *load) {
+    g_free(load->path);
+    g_free(load);
+}
+
+void piece_table_reset(PieceTable *table, GBytes *bytes) {
+    if (!table->pieces) {
+        table->added = g_string_new(NULL);
+        table->pieces = g_array_new(FALSE, FALSE, sizeof(Piece));
+    }
+    g_clear_pointer(&table->original, g_bytes_unref);
+    table->original = g_bytes_ref(bytes);
+    g_string_truncate(table->added, 0);
+    g_array_set_size(table->pieces, 0);
+
+    table->length = g_bytes_get_size(bytes);
+    if (table->length > 0) {
+        Piece piece = { FALSE, 0, table->length };
+        g_array_append_val(table->pieces, piece);
+    }
+}
+
+// Replace delete_length bytes at offset with insert. FALSE if out of range.
+gboolean piece_table_replace(PieceTable *table, gsize offset, gsize delete_length,
+                             const char *insert, gsize insert_length) {
+    if (!table->pieces) {
+        GBytes *empty = g_bytes_new_static("", 0);
+        piece_table_reset(table, empty);
+        g_bytes_unref(empty);
+    }
+    if (offset > table->length || delete_length > table->length - offset) return FALSE;
+
+    gsize delete_end = offset + delete_length;
+    GArray *pieces = g_array_sized_new(FALSE, FALSE, sizeof(Piece), table->pieces->len + 2);
+    gboolean inserted = insert_length == 0;
+    gsize position = 0;
+
+    for (guint i = 0; i < table->pieces->len; i++) {
+        Piece piece = g_array_index(table->pieces, Piece, i);
+        gsize piece_end = position + piece.length;
+
+        // Part before the edited range
+        if (position < offset) {
+            Piece head = piece;
+            head.length = MIN(piece_end, offset) - position;
+            g_array_append_val(pieces, head);
+        }
+
+        if (!inserted && piece_end >= offset) {
+            // Typing at the end of the last insertion just grows that piece
+            Piece *last = pieces->len > 0 ? &g_array_index(pieces, Piece, pieces->len - 1) : NULL;
+            if (last && last->added && last->start + last->length == table->added->len) {
+                last->length += insert_length;
+            } else {
+                Piece added = { TRUE, table->added->len, insert_length };
+                g_array_append_val(pieces, added);
+            }
+            g_string_append_len(table->added, insert, insert_length);
+            inserted = TRUE;
+        }
+
+        // Part after the edited range
+        if (piece_end > delete_end) {
+            Piece tail = piece;
+            gsize skip = delete_end > position ? delete_end - position : 0;
+            tail.start += skip;
+            tail.length -= skip;
+            g_array_append_val(pieces, tail);
+        }
+        position = piece_end;
+    }
+    if (!inserted) {
+        // Empty document
+        Piece added = { TRUE, table->added->len, insert_length };
+        g_array_append_val(pieces, added);
+        g_string_append_len(table->added, insert, insert_length);
+    }
+
+    g_array_unref(table->pieces);
+    table->pieces = pieces;
+    table->length = table->length - delete_length + insert_length;
+
+    if (table->pieces->len > PIECE_TABLE_MAX_PIECES) {
+        char *text = piece_table_to_string(table);
+        GBytes *flat = g_bytes_new_take(text, table->length);
+        piece_table_reset(table, flat);
+        g_bytes_unref(flat);
+    }
+    return TRUE;
+}
+
+char* piece_table_to_string(PieceTable *table) {
+    char *text = g_malloc(table->length + 1);
+    const char *original = table->original ? g_bytes_get_data(table->original, NULL) : NULL;
+    gsize position = 0;
+    for (guint i = 0; table->pieces && i < table->pieces->len; i++) {
+        Piece *piece = &g_array_index(table->pieces, Piece, i);
+        const char *source = piece->added ? table->added->str : original;
+        memcpy(text + position, source + piece->start, piece->length);
+        position += piece->length;
+    }
+    text[position] = '\0';
+    return text;
+}
+
+// The document into buffer, reusing its allocation
+void piece_table_copy_to(PieceTable *table, GString *buffer) {
+    const char *original = table->original ? g_bytes_get_data(table->original, NULL) : NULL;
+    g_string_set_size(buffer, table->length);
+    gsize position = 0;
+    for (guint i = 0; table->pieces && i < table->pieces->len; i++) {
+        Piece *piece = &g_array_index(table->pieces, Piece, i);
+        const char *source = piece->added ? table->added->str : original;
+        memcpy(buffer->str + position, source + piece->start, piece->length);
+        position += piece->length;
+    }
+}
+
+void piece_table_clear(PieceTable *table) {
+    g_clear_pointer(&table->original, g_bytes_unref);
+    if (table->added) g_string_free(table->added, TRUE);
+    g_clear_pointer(&table->pieces, g_array_unref);
+    memset(table, 0, sizeof(*table));
+}
+
+// Ask the editor for the whole document after the mirror fell out of step
+void editor_mirror_resync() {
+    editor_mirror_valid = FALSE;
+    char script[64];
+    g_snprintf(script, sizeof(script), "sendDocument(%u);", editor_mirror_seq);
+    editor_run_script(script, NULL, NULL);
+}
+
+void handle_content_delta(WebKitUserContentManager *manager,
+                          WebKitJavascriptResult *js_result,
+                          gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    JSCValue *seq = jsc_value_object_get_property(val, "seq");
+    JSCValue *offset = jsc_value_object_get_property(val, "offset");
+    JSCValue *delete_length = jsc_value_object_get_property(val, "deleteLength");
+    JSCValue *insert = jsc_value_object_get_property(val, "insert");
+    JSCValue *length = jsc_value_object_get_property(val, "length");
+
+    // Edits to a document that has since been replaced are dropped; those to
+    // a background tab were still in flight when it was switched away from
+    EditorTab *tab = tab_for_seq((guint)jsc_value_to_double(seq));
+    if (tab) {
+        char *text = jsc_value_to_string(insert);
+        if (tab->mirror_valid &&
+            (!piece_table_replace(&tab->mirror, (gsize)jsc_value_to_double(offset),
+                                  (gsize)jsc_value_to_double(delete_length), text, strlen(text)) ||
+             tab->mirror.length != (gsize)jsc_value_to_double(length))) {
+            // Asked for again when the tab is shown
+            tab->mirror_valid = FALSE;
+        }
+        g_free(text);
+        tab->edit_seq++;
+        tab->saved = FALSE;
+        tab_update_label(tab);
+        autosave_schedule();
+    } else if ((guint)jsc_value_to_double(seq) == editor_mirror_seq && editor_mirror_valid) {
+        char *text = jsc_value_to_string(insert);
+        gboolean applied = piece_table_replace(&editor_mirror,
+                                               (gsize)jsc_value_to_double(offset),
+                                               (gsize)jsc_value_to_double(delete_length),
+                                               text, strlen(text));
+        if (!applied || editor_mirror.length != (gsize)jsc_value_to_double(length)) {
+            g_warning("Editor mirror out of sync, requesting the full document");
+            editor_mirror_resync();
+        }
+        g_free(text);
+        mark_content_unsaved();
+        preview_schedule();
+    }
+
+    g_object_unref(seq);
+    g_object_unref(offset);
+    g_object_unref(delete_length);
+    g_object_unref(insert);
+    g_object_unref(length);
+}
+
+void handle_content_reset(WebKitUserContentManager *manager,
+                          WebKitJavascriptResult *js_result,
+                          gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    JSCValue *seq = jsc_value_object_get_property(val, "seq");
+    JSCValue *text = jsc_value_object_get_property(val, "text");
+
+    EditorTab *tab = tab_for_seq((guint)jsc_value_to_double(seq));
+    if (tab) {
+        char *content = jsc_value_to_string(text);
+        GBytes *bytes = g_bytes_new_take(content, strlen(content));
+        piece_table_reset(&tab->mirror, bytes);
+        g_bytes_unref(bytes);
+        tab->mirror_valid = TRUE;
+    } else if ((guint)jsc_value_to_double(seq) == editor_mirror_seq) {
+        char *content = jsc_value_to_string(text);
+        GBytes *bytes = g_bytes_new_take(content, strlen(content));
+        piece_table_reset(&editor_mirror, bytes);
+        g_bytes_unref(bytes);
+        editor_mirror_valid = TRUE;
+        preview_schedule();
+    }
+
+    g_object_unref(seq);
+    g_object_unref(text);
+}
+
+void envelope_scheme_request(WebKitURISchemeRequest *request, gpointer user_data) {
+    const char *uri = webkit_uri_scheme_request_get_uri(request);
+    // Page, assets and documents share one origin, so fetches need no CORS
+    const char *prefix = "envelope://app/document/";
+    const char *lines_prefix = "envelope://app/lines/";
+    const char *assets_prefix = "envelope://app/";
+
+    // Large-file windows: lines/<seq>/<first>/<count>
+    if (g_str_has_prefix(uri, lines_prefix)) {
+        char *end;
+        guint64 seq = g_ascii_strtoull(uri + strlen(lines_prefix), &end, 10);
+        guint64 first = *end == '/' ? g_ascii_strtoull(end + 1, &end, 10) : 0;
+        guint64 count = *end == '/' ? g_ascii_strtoull(end + 1, &end, 10) : 0;
+        if (large_file && seq == large_file->seq) {
+            large_file_serve_window(large_file, request, first,
+                                    MIN(count, LARGE_FILE_WINDOW_MAX_LINES));
+            return;
+        }
+    }
+
+    if (!g_str_has_prefix(uri, prefix) && !g_str_has_prefix(uri, lines_prefix) &&
+        g_str_has_prefix(uri, assets_prefix)) {
+        const char *name = uri + strlen(assets_prefix);
+        GBytes *bytes = strstr(name, "..") ? NULL : asset_lookup(name);
+        if (bytes) {
+            GInputStream *stream = g_memory_input_stream_new_from_bytes(bytes);
+            webkit_uri_scheme_request_finish(request, stream, g_bytes_get_size(bytes),
+                                             asset_content_type(name));
+            g_object_unref(stream);
+            g_bytes_unref(bytes);
+            return;
+        }
+    }
+
+    if (g_str_has_prefix(uri, prefix)) {
+        guint64 seq = g_ascii_strtoull(uri + strlen(prefix), NULL, 10);
+        // A newer note was picked while this fetch was on its way
+        if (editor_document && seq == editor_document_seq) {
+            GInputStream *stream = g_memory_input_stream_new_from_bytes(editor_document);
+            webkit_uri_scheme_request_finish(request, stream, g_bytes_get_size(editor_document),
+                                             "text/markdown; charset=utf-8");
+            g_object_unref(stream);
+            // The stream holds its own reference until WebKit has read it
+            g_clear_pointer(&editor_document, g_bytes_unref);
+            return;
+        }
+    }
+
+    GError *error = g_error_new(G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No such resource: %s", uri);
+    webkit_uri_scheme_request_finish_error(request, error);
+    g_error_free(error);
+}
+
+// Native preview
+//
+// cmark parses a snapshot of the editor mirror on a worker thread. Each
+// top-level block is keyed by a hash of its source lines, and only blocks
+// whose hash is not already in the preview are rendered. The page then gets
+// a single splice: the blocks between the unchanged prefix and suffix.
+
+void preview_block_clear(gpointer data) {
+    PreviewBlock *block = data;
+    g_free(block->html);
+}
+
+// Render the mirror again, or once the render in flight is done
+void preview_schedule() {
+    if (preview_hidden || !editor_ready) return;
+    if (preview_running) {
+        preview_dirty = TRUE;
+        return;
+    }
+    preview_start();
+}
+
+void preview_start() {
+    // A resync is on its way and will schedule another render
+    if (!editor_mirror_valid) return;
+
+    // One buffer for every render; only one runs at a time
+    if (!preview_text) preview_text = g_string_new(NULL);
+    piece_table_copy_to(&editor_mirror, preview_text);
+
+    PreviewJob *job = g_new0(PreviewJob, 1);
+    job->text = preview_text->str;
+    job->length = preview_text->len;
+    job->known = g_array_sized_new(FALSE, FALSE, sizeof(guint64),
+                                   preview_blocks ? preview_blocks->len : 0);
+    for (guint i = 0; preview_blocks && i < preview_blocks->len; i++) {
+        g_array_append_val(job->known, g_array_index(preview_blocks, PreviewBlock, i).hash);
+    }
+    job->blocks = g_array_new(FALSE, FALSE, sizeof(PreviewBlock));
+    g_array_set_clear_func(job->blocks, preview_block_clear);
+
+    preview_running = TRUE;
+    preview_dirty = FALSE;
+    GTask *task = g_task_new(NULL, NULL, preview_done, NULL);
+    g_task_set_task_data(task, job, (GDestroyNotify)preview_job_free);
+    g_task_run_in_thread(task, preview_thread);
+    g_object_unref(task);
+}
+
+void preview_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    PreviewJob *job = task_data;
+    gint64 started = g_get_monotonic_time();
+    gsize length = job->length;
+
+    // Where each line starts, so block source ranges can be hashed. Link
+    // reference definitions affect blocks anywhere in the note, so their
+    // hash is mixed into every block.
+    GArray *lines = g_array_new(FALSE, FALSE, sizeof(gsize));
+    guint64 refs = 0;
+    gsize line_start = 0;
+    while (line_start <= length) {
+        g_array_append_val(lines, line_start);
+        const char *line = job->text + line_start;
+        const char *newline = memchr(line, '\n', length - line_start);
+        gsize line_length = newline ? (gsize)(newline - line) : length - line_start;
+        gsize indent = 0;
+        while (indent < 3 && indent < line_length && line[indent] == ' ') indent++;
+        if (indent < line_length && line[indent] == '[' &&
+            g_strstr_len(line, line_length, "]:")) {
+            refs = refs * 31 + content_hash64(line, line_length);
+        }
+        if (!newline) break;
+        line_start += line_length + 1;
+    }
+
+    GHashTable *known = g_hash_table_new(g_int64_hash, g_int64_equal);
+    for (guint i = 0; i < job->known->len; i++) {
+        g_hash_table_add(known, &g_array_index(job->known, guint64, i));
+    }
+
+    cmark_node *document = cmark_parse_document(job->text, length, CMARK_OPT_DEFAULT);
+    for (cmark_node *node = cmark_node_first_child(document); node; node = cmark_node_next(node)) {
+        guint start = CLAMP(cmark_node_get_start_line(node), 1, (gint)lines->len);
+        guint end = CLAMP(cmark_node_get_end_line(node), (gint)start, (gint)lines->len);
+        gsize from = g_array_index(lines, gsize, start - 1);
+        gsize to = end < lines->len ? g_array_index(lines, gsize, end) : length;
+
+        // Safe mode leaves out raw HTML and javascript: style links, so a note
+        // cannot run script in the page
+        PreviewBlock block;
+        block.hash = content_hash64(job->text + from, to - from) ^ refs;
+        block.html = g_hash_table_contains(known, &block.hash) ?
+            NULL : cmark_render_html(node, CMARK_OPT_DEFAULT | CMARK_OPT_SAFE);
+        g_array_append_val(job->blocks, block);
+    }
+    cmark_node_free(document);
+
+    g_hash_table_unref(known);
+    g_array_unref(lines);
+    job->elapsed_us = g_get_monotonic_time() - started;
+    trace_span("preview", "preview_render", started);
+    g_task_return_boolean(task, TRUE);
+}
+
+void preview_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    PreviewJob *job = g_task_get_task_data(G_TASK(result));
+    gint64 started = trace_now();
+    preview_running = FALSE;
+
+    if (!preview_blocks) {
+        preview_blocks = g_array_new(FALSE, FALSE, sizeof(PreviewBlock));
+        g_array_set_clear_func(preview_blocks, preview_block_clear);
+    }
+    GArray *old = preview_blocks;
+    GArray *new = job->blocks;
+
+    guint prefix = 0;
+    while (prefix < old->len && prefix < new->len &&
+           g_array_index(old, PreviewBlock, prefix).hash ==
+           g_array_index(new, PreviewBlock, prefix).hash) {
+        prefix++;
+    }
+    guint suffix = 0;
+    while (suffix < old->len - prefix && suffix < new->len - prefix &&
+           g_array_index(old, PreviewBlock, old->len - 1 - suffix).hash ==
+           g_array_index(new, PreviewBlock, new->len - 1 - suffix).hash) {
+        suffix++;
+    }
+
+    // Blocks the worker skipped take their HTML from the old list: moved
+    // where they line up, copied when they reappear elsewhere
+    GHashTable *old_html = g_hash_table_new(g_int64_hash, g_int64_equal);
+    for (guint i = 0; i < old->len; i++) {
+        PreviewBlock *block = &g_array_index(old, PreviewBlock, i);
+        g_hash_table_insert(old_html, &block->hash, block->html);
+    }
+    for (guint i = 0; i < new->len; i++) {
+        PreviewBlock *block = &g_array_index(new, PreviewBlock, i);
+        if (block->html) continue;
+        if (i < prefix || i >= new->len - suffix) {
+            PreviewBlock *same = &g_array_index(old, PreviewBlock,
+                                                i < prefix ? i : old->len - (new->len - i));
+            block->html = same->html;
+            same->html = NULL;
+        } else {
+            block->html = g_strdup(g_hash_table_lookup(old_html, &block->hash));
+        }
+    }
+
+    guint deleted = old->len - prefix - suffix;
+    guint inserted = new->len - prefix - suffix;
+    if (deleted > 0 || inserted > 0) {
+        GString *script = g_string_new(NULL);
+        g_string_append_printf(script, "patchPreview(%u, %u, [", prefix, deleted);
+        for (guint i = prefix; i < prefix + inserted; i++) {
+            if (i > prefix) g_string_append_c(script, ',');
+            json_append_escaped(script, g_array_index(new, PreviewBlock, i).html);
+        }
+        g_string_append(script, "]);");
+        editor_run_script(script->str, NULL, NULL);
+        g_string_free(script, TRUE);
+    }
+    g_hash_table_unref(old_html);
+
+    g_array_unref(old);
+    preview_blocks = g_array_ref(new);
+    g_debug("Preview: %u blocks, %u replaced by %u, parsed in %.2f ms",
+            new->len, deleted, inserted, job->elapsed_us / 1000.0);
+    trace_span("preview", "preview_patch", started);
+
+    if (preview_dirty) {
+        preview_schedule();
+    }
+}
+
+void preview_job_free(PreviewJob *job) {
+    g_array_unref(job->known);
+    g_array_unref(job->blocks);
+    g_free(job);
+}
+
+void handle_new_note(WebKitUserContentManager *manager, 
                     WebKitJavascriptResult *js_result, 
                     gpointer user_data) {
     add_note(NULL, NULL);
 }
 
-void handle_open_file(WebKitUserContentManager *manager, 
-                     WebKitJavascriptResult *js_result, 
-                     gpointer user_data) {
-    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
-    char *filepath = jsc_value_to_string(val);
-    
-    // Find and select the file in the tree view
-    GtkTreeModel *model = GTK_TREE_MODEL(tree_store);
-    GtkTreeIter iter;
-    gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
-    while (valid) {
-        char *path;
-        gtk_tree_model_get(model, &iter, 1, &path, -1);
-        if (g_strcmp0(path, filepath) == 0) {
-            GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-            gtk_tree_selection_select_iter(selection, &iter);
-            g_free(path);
+void handle_open_file(WebKitUserContentManager *manager, 
+                     WebKitJavascriptResult *js_result, 
+                     gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    char *filepath = jsc_value_to_string(val);
+    
+    // Find and select the file in the tree view
+    file_tree_select_path(filepath);
+    
+    g_free(filepath);
+}
+
+// Full-text search
+//
+// The index for a vault is one file under ~/.config/notes-gui/index, mapped
+// read-only at startup (the "base"). Notes indexed since then live in a small
+// in-memory "delta" whose doc ids continue after the base ones; replaced or
+// deleted base docs are tombstoned. Saving merges both into a new base file.
+
+void varint_append(GByteArray *out, guint32 value) {
+    guint8 buf[5];
+    int n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+    g_byte_array_append(out, buf, n);
+}
+
+const guint8* varint_read(const guint8 *p, const guint8 *end, guint32 *value) {
+    guint32 result = 0;
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        guint8 byte = *p++;
+        result |= (guint32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;  // Truncated or corrupt
+}
+
+// Splits text into lowercase alphanumeric words. Returns FALSE at the end.
+gboolean search_next_token(const char **cursor, const char *end, GString *token,
+                           const char **token_start, const char **token_end) {
+    const char *p = *cursor;
+    g_string_truncate(token, 0);
+
+    while (p < end) {
+        const char *start = p;
+        if ((guchar)*p < 0x80) {
+            char c = *p++;
+            if (g_ascii_isalnum(c)) {
+                if (token->len == 0) *token_start = start;
+                g_string_append_c(token, g_ascii_tolower(c));
+                *token_end = p;
+                continue;
+            }
+        } else {
+            gunichar c = g_utf8_get_char_validated(p, end - p);
+            if (c == (gunichar)-1 || c == (gunichar)-2) {
+                p++;
+            } else {
+                p = g_utf8_next_char(p);
+                if (g_unichar_isalnum(c)) {
+                    if (token->len == 0) *token_start = start;
+                    g_string_append_unichar(token, g_unichar_tolower(c));
+                    *token_end = p;
+                    continue;
+                }
+            }
+        }
+        if (token->len > 0) break;
+    }
+
+    *cursor = p;
+    return token->len > 0;
+}
+
+gboolean search_cursor_next(SearchCursor *cursor) {
+    const guint8 *p = cursor->next;
+    if (!p || p >= cursor->end) return FALSE;
+
+    guint32 delta, tf, offset, position;
+    if (!(p = varint_read(p, cursor->end, &delta))) return FALSE;
+    if (!(p = varint_read(p, cursor->end, &tf))) return FALSE;
+    if (!(p = varint_read(p, cursor->end, &offset))) return FALSE;
+    cursor->doc += delta;
+    cursor->tf = tf;
+    cursor->offset = offset;
+    cursor->positions = p;
+    for (guint32 i = 0; i < tf; i++) {
+        if (!(p = varint_read(p, cursor->end, &position))) return FALSE;
+    }
+    cursor->next = p;
+    return TRUE;
+}
+
+// Postings of a term in the base file and in the delta, either may be empty
+guint32 search_term_cursors(SearchIndex *index, const char *term,
+                            SearchCursor *base, SearchCursor *delta) {
+    guint32 doc_freq = 0;
+    memset(base, 0, sizeof(*base));
+    memset(delta, 0, sizeof(*delta));
+
+    // The dictionary is sorted by byte order
+    guint32 low = 0, high = index->base_term_count;
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        const SearchDiskTerm *entry = &index->base_terms[mid];
+        int cmp = strcmp(index->base_strings + entry->term_offset, term);
+        if (cmp == 0) {
+            base->next = index->base_postings + entry->postings_offset;
+            base->end = base->next + entry->postings_length;
+            doc_freq += entry->doc_freq;
+            break;
+        }
+        if (cmp < 0) low = mid + 1;
+        else high = mid;
+    }
+
+    SearchTermPostings *postings = g_hash_table_lookup(index->terms, term);
+    if (postings) {
+        delta->next = postings->bytes->data;
+        delta->end = delta->next + postings->bytes->len;
+        doc_freq += postings->doc_freq;
+    }
+    return doc_freq;
+}
+
+gboolean search_doc_live(SearchIndex *index, guint32 doc) {
+    if (doc < index->base_count) return !index->base_dead[doc];
+    doc -= index->base_count;
+    return doc < index->docs->len && ((SearchDoc *)g_ptr_array_index(index->docs, doc))->live;
+}
+
+guint32 search_doc_length(SearchIndex *index, guint32 doc) {
+    if (doc < index->base_count) return index->base_docs[doc].length;
+    return ((SearchDoc *)g_ptr_array_index(index->docs, doc - index->base_count))->length;
+}
+
+const char* search_doc_path(SearchIndex *index, guint32 doc) {
+    if (doc < index->base_count) return index->base_strings + index->base_docs[doc].path_offset;
+    return ((SearchDoc *)g_ptr_array_index(index->docs, doc - index->base_count))->path;
+}
+
+gboolean search_index_map(SearchIndex *index) {
+    GError *error = NULL;
+    GMappedFile *mapped = g_mapped_file_new(index->file_path, FALSE, &error);
+    if (!mapped) {
+        // No index yet for this vault; the scan builds one
+        g_error_free(error);
+        return FALSE;
+    }
+
+    const char *data = g_mapped_file_get_contents(mapped);
+    guint64 length = g_mapped_file_get_length(mapped);
+    const SearchIndexHeader *header = (const SearchIndexHeader *)data;
+    gboolean valid = length >= sizeof(SearchIndexHeader) &&
+        memcmp(header->magic, SEARCH_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == SEARCH_INDEX_VERSION &&
+        header->docs_offset % 8 == 0 && header->terms_offset % 8 == 0 &&
+        header->docs_offset + (guint64)header->doc_count * sizeof(SearchDiskDoc) <= header->terms_offset &&
+        header->terms_offset + (guint64)header->term_count * sizeof(SearchDiskTerm) <= header->postings_offset &&
+        header->postings_offset <= header->strings_offset &&
+        header->strings_offset < length &&
+        data[length - 1] == '\0';
+
+    guint64 strings_length = valid ? length - header->strings_offset : 0;
+    guint64 postings_length = valid ? header->strings_offset - header->postings_offset : 0;
+    const SearchDiskDoc *docs = valid ? (const SearchDiskDoc *)(data + header->docs_offset) : NULL;
+    const SearchDiskTerm *terms = valid ? (const SearchDiskTerm *)(data + header->terms_offset) : NULL;
+    for (guint32 i = 0; valid && i < header->doc_count; i++) {
+        valid = docs[i].path_offset < strings_length;
+    }
+    for (guint32 i = 0; valid && i < header->term_count; i++) {
+        valid = terms[i].term_offset < strings_length &&
+                terms[i].postings_offset + terms[i].postings_length <= postings_length;
+    }
+    if (!valid) {
+        g_warning("Ignoring corrupt search index %s", index->file_path);
+        g_mapped_file_unref(mapped);
+        return FALSE;
+    }
+
+    index->mapped = mapped;
+    index->base_docs = docs;
+    index->base_terms = terms;
+    index->base_postings = (const guint8 *)data + header->postings_offset;
+    index->base_strings = data + header->strings_offset;
+    index->base_count = header->doc_count;
+    index->base_term_count = header->term_count;
+    index->base_dead = g_new0(guint8, index->base_count);
+    index->base_seen = g_new0(guint32, index->base_count);
+    index->base_paths = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint32 i = 0; i < index->base_count; i++) {
+        g_hash_table_insert(index->base_paths, (gpointer)(index->base_strings + docs[i].path_offset),
+                            GUINT_TO_POINTER(i + 1));
+    }
+    index->live_docs = header->doc_count;
+    index->live_tokens = header->total_tokens;
+    return TRUE;
+}
+
+void search_index_unmap(SearchIndex *index) {
+    g_clear_pointer(&index->base_paths, g_hash_table_unref);
+    g_clear_pointer(&index->base_dead, g_free);
+    g_clear_pointer(&index->base_seen, g_free);
+    g_clear_pointer(&index->mapped, g_mapped_file_unref);
+    index->base_docs = NULL;
+    index->base_terms = NULL;
+    index->base_postings = NULL;
+    index->base_strings = NULL;
+    index->base_count = 0;
+    index->base_term_count = 0;
+}
+
+void search_doc_free(SearchDoc *doc) {
+    g_free(doc->path);
+    g_free(doc);
+}
+
+void search_term_postings_free(SearchTermPostings *postings) {
+    g_byte_array_unref(postings->bytes);
+    g_free(postings);
+}
+
+void search_index_reset_delta(SearchIndex *index) {
+    g_hash_table_remove_all(index->doc_paths);
+    g_hash_table_remove_all(index->terms);
+    g_ptr_array_set_size(index->docs, 0);
+}
+
+void search_index_open(const char *vault) {
+    if (search_index && g_strcmp0(search_index->vault, vault) == 0) return;
+    search_index_close();
+    if (!vault) return;
+
+    if (!search_pool) {
+        search_results = g_async_queue_new();
+        search_pool = g_thread_pool_new(search_job_run, NULL,
+                                        CLAMP(g_get_num_processors() - 1, 1, 4),
+                                        FALSE, NULL);
+    }
+
+    SearchIndex *index = g_new0(SearchIndex, 1);
+    index->vault = g_strdup(vault);
+    index->generation = ++search_generation;
+
+    char *index_dir = g_build_filename(g_get_home_dir(), ".config", "notes-gui", "index", NULL);
+    g_mkdir_with_parents(index_dir, 0755);
+    char *vault_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, vault, -1);
+    char *file_name = g_strconcat(vault_hash, ".idx", NULL);
+    index->file_path = g_build_filename(index_dir, file_name, NULL);
+    g_free(file_name);
+    g_free(vault_hash);
+    g_free(index_dir);
+
+    index->docs = g_ptr_array_new_with_free_func((GDestroyNotify)search_doc_free);
+    index->doc_paths = g_hash_table_new(g_str_hash, g_str_equal);
+    index->terms = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify)search_term_postings_free);
+    index->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->merge_forgotten = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    search_index_map(index);
+
+    search_index = index;
+}
+
+void search_index_close() {
+    SearchIndex *index = search_index;
+    if (!index) return;
+
+    // Waits for a merge still running, which may schedule another save
+    search_index_save(index);
+    if (index->save_id) {
+        g_source_remove(index->save_id);
+    }
+
+    search_index = NULL;
+    search_index_unmap(index);
+    g_ptr_array_unref(index->docs);
+    g_hash_table_unref(index->doc_paths);
+    g_hash_table_unref(index->terms);
+    g_hash_table_unref(index->pending);
+    g_hash_table_unref(index->merge_forgotten);
+    g_free(index->vault);
+    g_free(index->file_path);
+    g_free(index);
+}
+
+// Queue a note for (re)indexing. When text is given it is indexed as is,
+// otherwise the worker reads the file.
+void search_index_queue(const char *path, const char *text) {
+    SearchIndex *index = search_index;
+    if (!index) return;
+
+    SearchJob *job = g_new0(SearchJob, 1);
+    job->path = g_strdup(path);
+    job->text = g_strdup(text);
+    job->generation = index->generation;
+    job->sequence = ++index->sequence;
+    g_hash_table_insert(index->pending, g_strdup(path), GUINT_TO_POINTER(job->sequence));
+    g_thread_pool_push(search_pool, job, NULL);
+}
+
+// Called for every note the scanner sees; only changed notes are re-read
+void search_index_check(const char *path, gint64 mtime, guint64 size) {
+    SearchIndex *index = search_index;
+    if (!index) return;
+
+    guint32 delta_id = GPOINTER_TO_UINT(g_hash_table_lookup(index->doc_paths, path));
+    if (delta_id) {
+        SearchDoc *doc = g_ptr_array_index(index->docs, delta_id - 1 - index->base_count);
+        if (doc->mtime == mtime && doc->size == size) {
+            doc->seen_generation = scan_generation;
+            return;
+        }
+    } else if (index->base_paths) {
+        guint32 base_id = GPOINTER_TO_UINT(g_hash_table_lookup(index->base_paths, path));
+        if (base_id && !index->base_dead[base_id - 1] &&
+            index->base_docs[base_id - 1].mtime == mtime &&
+            index->base_docs[base_id - 1].size == size) {
+            index->base_seen[base_id - 1] = scan_generation;
+            return;
+        }
+    }
+    search_index_queue(path, NULL);
+}
+
+// Tombstone whatever version of path is currently indexed
+void search_index_forget(SearchIndex *index, const char *path) {
+    if (index->merging) {
+        g_hash_table_add(index->merge_forgotten, g_strdup(path));
+    }
+
+    guint32 delta_id = GPOINTER_TO_UINT(g_hash_table_lookup(index->doc_paths, path));
+    if (delta_id) {
+        SearchDoc *doc = g_ptr_array_index(index->docs, delta_id - 1 - index->base_count);
+        g_hash_table_remove(index->doc_paths, path);
+        doc->live = FALSE;
+        index->live_docs--;
+        index->live_tokens -= doc->length;
+        index->dirty = TRUE;
+        return;
+    }
+
+    guint32 base_id = index->base_paths ?
+        GPOINTER_TO_UINT(g_hash_table_lookup(index->base_paths, path)) : 0;
+    if (base_id && !index->base_dead[base_id - 1]) {
+        index->base_dead[base_id - 1] = TRUE;
+        index->live_docs--;
+        index->live_tokens -= index->base_docs[base_id - 1].length;
+        index->dirty = TRUE;
+    }
+}
+
+void search_index_remove_path(const char *path) {
+    SearchIndex *index = search_index;
+    if (!index) return;
+
+    // Results still in flight for this path are dropped on arrival
+    g_hash_table_remove(index->pending, path);
+    search_index_forget(index, path);
+    search_index_schedule_save(index);
+}
+
+// Drop notes the finished scan did not find on disk
+void search_index_prune_unseen() {
+    SearchIndex *index = search_index;
+    if (!index) return;
+
+    for (guint32 i = 0; i < index->base_count; i++) {
+        const char *path = index->base_strings + index->base_docs[i].path_offset;
+        if (!index->base_dead[i] && index->base_seen[i] != scan_generation &&
+            !g_hash_table_contains(index->pending, path) &&
+            !g_hash_table_contains(index->doc_paths, path)) {
+            search_index_forget(index, path);
+        }
+    }
+    for (guint32 i = 0; i < index->docs->len; i++) {
+        SearchDoc *doc = g_ptr_array_index(index->docs, i);
+        if (doc->live && doc->seen_generation != scan_generation &&
+            !g_hash_table_contains(index->pending, doc->path)) {
+            search_index_forget(index, doc->path);
+        }
+    }
+    search_index_schedule_save(index);
+}
+
+void search_job_free(SearchJob *job) {
+    g_free(job->path);
+    g_free(job->text);
+    if (job->terms) g_hash_table_unref(job->terms);
+    g_free(job);
+}
+
+void search_job_term_free(SearchJobTerm *term) {
+    g_array_unref(term->positions);
+    g_free(term);
+}
+
+// Thread pool worker: read and tokenize one note
+void search_job_run(gpointer data, gpointer user_data) {
+    SearchJob *job = data;
+
+    GStatBuf st;
+    char *text = job->text;
+    gsize length = text ? strlen(text) : 0;
+    if (g_stat(job->path, &st) != 0 ||
+        (!text && !g_file_get_contents(job->path, &text, &length, NULL))) {
+        job->missing = TRUE;
+    } else {
+        job->mtime = st.st_mtime;
+        job->size = st.st_size;
+
+        job->terms = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, (GDestroyNotify)search_job_term_free);
+        GString *token = g_string_new(NULL);
+        const char *cursor = text, *end = text + length, *token_start, *token_end;
+        guint32 position = 0;
+        while (search_next_token(&cursor, end, token, &token_start, &token_end)) {
+            if (token->len <= SEARCH_MAX_TOKEN_BYTES) {
+                SearchJobTerm *term = g_hash_table_lookup(job->terms, token->str);
+                if (!term) {
+                    term = g_new0(SearchJobTerm, 1);
+                    term->offset = (guint32)MIN((gsize)(token_start - text), G_MAXUINT32);
+                    term->positions = g_array_new(FALSE, FALSE, sizeof(guint32));
+                    g_hash_table_insert(job->terms, g_strdup(token->str), term);
+                }
+                g_array_append_val(term->positions, position);
+            }
+            position++;
+        }
+        job->length = position;
+        g_string_free(token, TRUE);
+    }
+
+    if (text != job->text) g_free(text);
+    g_clear_pointer(&job->text, g_free);
+
+    g_async_queue_push(search_results, job);
+    if (g_atomic_int_compare_and_exchange(&search_drain_scheduled, 0, 1)) {
+        g_idle_add(search_drain_results, NULL);
+    }
+}
+
+gboolean search_drain_results(gpointer user_data) {
+    gint64 deadline = g_get_monotonic_time() + SEARCH_FRAME_BUDGET_US;
+
+    // The delta may not change under a merge; search_merge_done drains again
+    if (search_index && search_index->merging) {
+        g_atomic_int_set(&search_drain_scheduled, 0);
+        return G_SOURCE_REMOVE;
+    }
+
+    while (g_get_monotonic_time() < deadline) {
+        SearchJob *job = g_async_queue_try_pop(search_results);
+        if (!job) {
+            g_atomic_int_set(&search_drain_scheduled, 0);
+            if (g_async_queue_length(search_results) > 0 &&
+                g_atomic_int_compare_and_exchange(&search_drain_scheduled, 0, 1)) {
+                continue;
+            }
+            return G_SOURCE_REMOVE;
+        }
+        search_index_apply(job);
+        search_job_free(job);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void search_index_apply(SearchJob *job) {
+    SearchIndex *index = search_index;
+    if (!index || job->generation != index->generation) return;
+
+    // Only the newest job for a path counts; a later save may have overtaken it
+    guint latest = GPOINTER_TO_UINT(g_hash_table_lookup(index->pending, job->path));
+    if (latest != job->sequence) return;
+    g_hash_table_remove(index->pending, job->path);
+
+    search_index_forget(index, job->path);
+    index->dirty = TRUE;
+    search_index_schedule_save(index);
+    if (job->missing) return;
+
+    guint32 doc_id = index->base_count + index->docs->len;
+    SearchDoc *doc = g_new0(SearchDoc, 1);
+    doc->path = g_strdup(job->path);
+    doc->mtime = job->mtime;
+    doc->size = job->size;
+    doc->length = job->length;
+    doc->seen_generation = scan_generation;
+    doc->live = TRUE;
+    g_ptr_array_add(index->docs, doc);
+    g_hash_table_insert(index->doc_paths, doc->path, GUINT_TO_POINTER(doc_id + 1));
+    index->live_docs++;
+    index->live_tokens += doc->length;
+
+    GHashTableIter iter;
+    gpointer term, value;
+    g_hash_table_iter_init(&iter, job->terms);
+    while (g_hash_table_iter_next(&iter, &term, &value)) {
+        SearchJobTerm *occurrences = value;
+        GArray *positions = occurrences->positions;
+        SearchTermPostings *postings = g_hash_table_lookup(index->terms, term);
+        if (!postings) {
+            postings = g_new0(SearchTermPostings, 1);
+            postings->bytes = g_byte_array_new();
+            g_hash_table_insert(index->terms, g_strdup(term), postings);
+        }
+
+        varint_append(postings->bytes, doc_id - postings->last_doc);
+        varint_append(postings->bytes, positions->len);
+        varint_append(postings->bytes, occurrences->offset);
+        guint32 previous = 0;
+        for (guint i = 0; i < positions->len; i++) {
+            guint32 position = g_array_index(positions, guint32, i);
+            varint_append(postings->bytes, position - previous);
+            previous = position;
+        }
+        postings->last_doc = doc_id;
+        postings->doc_freq++;
+    }
+}
+
+void search_index_schedule_save(SearchIndex *index) {
+    if (!index->save_id) {
+        index->save_id = g_timeout_add_seconds(SEARCH_SAVE_DELAY_S, search_index_save_timeout, index);
+    }
+}
+
+gboolean search_index_save_timeout(gpointer user_data) {
+    SearchIndex *index = user_data;
+
+    // Wait for a quiet moment rather than merging in the middle of a bulk index
+    if (scan_in_progress || g_hash_table_size(index->pending) > 0) return G_SOURCE_CONTINUE;
+
+    index->save_id = 0;
+    search_index_save_start(index);
+    return G_SOURCE_REMOVE;
+}
+
+// Copy one term's live postings into the merged file, renumbering docs
+guint32 search_merge_postings(SearchIndex *index, SearchCursor *cursor, const guint32 *remap,
+                              GByteArray *out, guint32 *last_doc) {
+    guint32 doc_freq = 0;
+    guint32 total = index->base_count + index->docs->len;
+    while (search_cursor_next(cursor)) {
+        if (cursor->doc >= total || remap[cursor->doc] == G_MAXUINT32) continue;
+
+        guint32 doc = remap[cursor->doc];
+        varint_append(out, doc - *last_doc);
+        varint_append(out, cursor->tf);
+        varint_append(out, cursor->offset);
+        // Position deltas do not depend on doc ids and are copied verbatim
+        g_byte_array_append(out, cursor->positions, cursor->next - cursor->positions);
+        *last_doc = doc;
+        doc_freq++;
+    }
+    return doc_freq;
+}
+
+gint search_term_compare(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+// The doc table and the sorted list of delta terms; cheap enough for the main
+// thread, and fixes which docs survive the merge
+SearchMerge* search_merge_prepare(SearchIndex *index) {
+    SearchMerge *merge = g_new0(SearchMerge, 1);
+    merge->index = index;
+    guint32 total = index->base_count + index->docs->len;
+    merge->remap = g_new(guint32, MAX(total, 1));
+    merge->docs = g_byte_array_new();
+    merge->strings = g_string_new(NULL);
+
+    for (guint32 i = 0; i < total; i++) {
+        merge->remap[i] = G_MAXUINT32;
+        if (!search_doc_live(index, i)) continue;
+
+        SearchDiskDoc disk_doc = { 0 };
+        if (i < index->base_count) {
+            disk_doc = index->base_docs[i];
+        } else {
+            SearchDoc *doc = g_ptr_array_index(index->docs, i - index->base_count);
+            disk_doc.mtime = doc->mtime;
+            disk_doc.size = doc->size;
+            disk_doc.length = doc->length;
+        }
+        const char *path = search_doc_path(index, i);
+        disk_doc.path_offset = merge->strings->len;
+        g_string_append_len(merge->strings, path, strlen(path) + 1);
+        g_byte_array_append(merge->docs, (const guint8 *)&disk_doc, sizeof(disk_doc));
+        merge->total_tokens += disk_doc.length;
+        merge->remap[i] = merge->doc_count++;
+    }
+
+    merge->delta_terms = g_ptr_array_sized_new(g_hash_table_size(index->terms));
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, index->terms);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_ptr_array_add(merge->delta_terms, key);
+    }
+    g_ptr_array_sort(merge->delta_terms, search_term_compare);
+    return merge;
+}
+
+// Merge the postings and write the new base file. Only reads the index, so it
+// may run on a worker while the main thread keeps querying.
+gboolean search_merge_write(SearchMerge *merge, GError **error) {
+    SearchIndex *index = merge->index;
+    GByteArray *terms = g_byte_array_new();
+    GByteArray *postings = g_byte_array_new();
+    GString *strings = merge->strings;
+    guint32 term_count = 0;
+
+    // Merge the sorted base dictionary with the sorted delta terms
+    GPtrArray *delta_terms = merge->delta_terms;
+    guint32 base_i = 0, delta_i = 0;
+    while (base_i < index->base_term_count || delta_i < delta_terms->len) {
+        const char *base_term = base_i < index->base_term_count ?
+            index->base_strings + index->base_terms[base_i].term_offset : NULL;
+        const char *delta_term = delta_i < delta_terms->len ?
+            g_ptr_array_index(delta_terms, delta_i) : NULL;
+        int cmp = !base_term ? 1 : !delta_term ? -1 : strcmp(base_term, delta_term);
+        const char *term = cmp <= 0 ? base_term : delta_term;
+
+        SearchDiskTerm disk_term = { 0 };
+        disk_term.postings_offset = postings->len;
+        guint32 last_doc = 0;
+        if (cmp <= 0) {
+            const SearchDiskTerm *entry = &index->base_terms[base_i++];
+            SearchCursor cursor = { 0 };
+            cursor.next = index->base_postings + entry->postings_offset;
+            cursor.end = cursor.next + entry->postings_length;
+            disk_term.doc_freq += search_merge_postings(index, &cursor, merge->remap, postings, &last_doc);
+        }
+        if (cmp >= 0) {
+            SearchTermPostings *delta = g_hash_table_lookup(index->terms, delta_term);
+            SearchCursor cursor = { 0 };
+            cursor.next = delta->bytes->data;
+            cursor.end = cursor.next + delta->bytes->len;
+            disk_term.doc_freq += search_merge_postings(index, &cursor, merge->remap, postings, &last_doc);
+            delta_i++;
+        }
+        if (disk_term.doc_freq == 0) continue;
+
+        disk_term.postings_length = postings->len - disk_term.postings_offset;
+        disk_term.term_offset = strings->len;
+        g_string_append_len(strings, term, strlen(term) + 1);
+        g_byte_array_append(terms, (const guint8 *)&disk_term, sizeof(disk_term));
+        term_count++;
+    }
+
+    // Keep the string section non-empty so the trailing NUL check holds
+    if (strings->len == 0) g_string_append_c(strings, '\0');
+
+    SearchIndexHeader header = { 0 };
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SEARCH_INDEX_VERSION;
+    header.doc_count = merge->doc_count;
+    header.term_count = term_count;
+    header.total_tokens = merge->total_tokens;
+    header.docs_offset = sizeof(header);
+    header.terms_offset = header.docs_offset + merge->docs->len;
+    header.postings_offset = header.terms_offset + terms->len;
+    header.strings_offset = header.postings_offset + postings->len;
+
+    // g_file_replace writes to a temporary file and renames it on close
+    GFile *file = g_file_new_for_path(index->file_path);
+    GFileOutputStream *stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, error);
+    gboolean saved = stream &&
+        g_output_stream_write_all(G_OUTPUT_STREAM(stream), &header, sizeof(header), NULL, NULL, error) &&
+        g_output_stream_write_all(G_OUTPUT_STREAM(stream), merge->docs->data, merge->docs->len, NULL, NULL, error) &&
+        g_output_stream_write_all(G_OUTPUT_STREAM(stream), terms->data, terms->len, NULL, NULL, error) &&
+        g_output_stream_write_all(G_OUTPUT_STREAM(stream), postings->data, postings->len, NULL, NULL, error) &&
+        g_output_stream_write_all(G_OUTPUT_STREAM(stream), strings->str, strings->len, NULL, NULL, error) &&
+        g_output_stream_close(G_OUTPUT_STREAM(stream), NULL, error);
+    if (stream) g_object_unref(stream);
+    g_object_unref(file);
+    g_byte_array_unref(terms);
+    g_byte_array_unref(postings);
+    return saved;
+}
+
+// Swap the merged file in as the new base, then tombstone what was forgotten
+// while the merge ran
+void search_merge_finish(SearchMerge *merge, gboolean saved) {
+    SearchIndex *index = merge->index;
+    index->merging = FALSE;
+    if (saved) {
+        search_index_unmap(index);
+        search_index_reset_delta(index);
+        index->live_docs = 0;
+        index->live_tokens = 0;
+        search_index_map(index);
+        for (guint32 i = 0; i < index->base_count; i++) {
+            index->base_seen[i] = scan_generation;
+        }
+        index->dirty = FALSE;
+
+        GHashTableIter iter;
+        gpointer path;
+        g_hash_table_iter_init(&iter, index->merge_forgotten);
+        while (g_hash_table_iter_next(&iter, &path, NULL)) {
+            search_index_forget(index, path);
+        }
+        if (index->dirty) search_index_schedule_save(index);
+    }
+    g_hash_table_remove_all(index->merge_forgotten);
+}
+
+void search_merge_free(SearchMerge *merge) {
+    g_free(merge->remap);
+    g_byte_array_unref(merge->docs);
+    g_string_free(merge->strings, TRUE);
+    g_ptr_array_unref(merge->delta_terms);
+    g_free(merge);
+}
+
+void search_merge_thread(GTask *task, gpointer source_object, gpointer task_data,
+                         GCancellable *cancellable) {
+    GError *error = NULL;
+    if (search_merge_write(task_data, &error)) {
+        g_task_return_boolean(task, TRUE);
+    } else {
+        g_task_return_error(task, error);
+    }
+}
+
+void search_merge_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    SearchMerge *merge = g_task_get_task_data(G_TASK(result));
+    GError *error = NULL;
+    gboolean saved = g_task_propagate_boolean(G_TASK(result), &error);
+    if (!saved) {
+        g_warning("Failed to save search index: %s", error->message);
+        g_error_free(error);
+    }
+    search_merge_finish(merge, saved);
+
+    // Results held back during the merge
+    if (g_async_queue_length(search_results) > 0 &&
+        g_atomic_int_compare_and_exchange(&search_drain_scheduled, 0, 1)) {
+        g_idle_add(search_drain_results, NULL);
+    }
+}
+
+// Merge on a worker; the index stays queryable meanwhile
+void search_index_save_start(SearchIndex *index) {
+    if (!index->dirty || index->merging) return;
+
+    index->merging = TRUE;
+    GTask *task = g_task_new(NULL, NULL, search_merge_done, NULL);
+    g_task_set_task_data(task, search_merge_prepare(index), (GDestroyNotify)search_merge_free);
+    g_task_run_in_thread(task, search_merge_thread);
+    g_object_unref(task);
+}
+
+// Merge right away, for closing the index
+gboolean search_index_save(SearchIndex *index) {
+    while (index->merging) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    if (!index->dirty) return TRUE;
+
+    GError *error = NULL;
+    SearchMerge *merge = search_merge_prepare(index);
+    gboolean saved = search_merge_write(merge, &error);
+    if (!saved) {
+        g_warning("Failed to save search index: %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+    search_merge_finish(merge, saved);
+    search_merge_free(merge);
+    return saved;
+}
+
+gint search_hit_compare(gconstpointer a, gconstpointer b) {
+    const SearchHit *hit_a = a, *hit_b = b;
+    return hit_a->score < hit_b->score ? 1 : hit_a->score > hit_b->score ? -1 : 0;
+}
+
+// Splits a query into word groups; quoted text becomes one phrase group
+GPtrArray* search_parse_query(const char *query) {
+    GPtrArray *groups = g_ptr_array_new_with_free_func((GDestroyNotify)g_strfreev);
+    GString *token = g_string_new(NULL);
+    const char *p = query;
+
+    while (*p) {
+        gboolean phrase = *p == '"';
+        if (phrase) p++;
+        const char *end = phrase ? strchr(p, '"') : NULL;
+        if (!end) end = phrase ? p + strlen(p) : p;
+        if (!phrase) {
+            // A bare word runs to the next space or quote
+            while (*end && *end != ' ' && *end != '"') end++;
+        }
+
+        GPtrArray *words = g_ptr_array_new();
+        const char *cursor = p, *token_start, *token_end;
+        while (search_next_token(&cursor, end, token, &token_start, &token_end)) {
+            if (token->len <= SEARCH_MAX_TOKEN_BYTES) {
+                if (!phrase && words->len > 0) {
+                    // "foo-bar" outside quotes is two separate words
+                    g_ptr_array_add(words, NULL);
+                    g_ptr_array_add(groups, g_ptr_array_free(words, FALSE));
+                    words = g_ptr_array_new();
+                }
+                g_ptr_array_add(words, g_strdup(token->str));
+            }
+        }
+        if (words->len > 0) {
+            g_ptr_array_add(words, NULL);
+            g_ptr_array_add(groups, g_ptr_array_free(words, FALSE));
+        } else {
+            g_ptr_array_free(words, TRUE);
+        }
+
+        p = end;
+        if (*p == '"') p++;
+        while (*p == ' ') p++;
+    }
+    g_string_free(token, TRUE);
+    return groups;
+}
+
+gfloat search_bm25(gfloat idf, guint32 tf, guint32 length, gfloat avg_length) {
+    gfloat norm = SEARCH_BM25_K1 * (1.0f - SEARCH_BM25_B + SEARCH_BM25_B * length / avg_length);
+    return idf * (tf * (SEARCH_BM25_K1 + 1.0f)) / (tf + norm);
+}
+
+gfloat search_idf(SearchIndex *index, guint32 doc_freq) {
+    gfloat n = MAX(index->live_docs, 1);
+    gfloat df = MIN((gfloat)doc_freq, n);
+    return logf(1.0f + (n - df + 0.5f) / (df + 0.5f));
+}
+
+// Positions of one posting, decoded from its delta encoding
+void search_read_positions(SearchCursor *cursor, GArray *out) {
+    g_array_set_size(out, 0);
+    const guint8 *p = cursor->positions;
+    guint32 position = 0, delta;
+    for (guint32 i = 0; i < cursor->tf && (p = varint_read(p, cursor->next, &delta)); i++) {
+        position += delta;
+        g_array_append_val(out, position);
+    }
+}
+
+// Ranks live notes containing every group (words or quoted phrases) with BM25.
+// Scores are accumulated term-at-a-time into flat arrays indexed by doc id.
+GArray* search_index_query(SearchIndex *index, GPtrArray *groups, guint limit) {
+    GArray *hits = g_array_new(FALSE, FALSE, sizeof(SearchHit));
+    guint32 total = index->base_count + index->docs->len;
+    if (groups->len == 0 || total == 0 || index->live_docs == 0) return hits;
+
+    gfloat avg_length = MAX((gfloat)index->live_tokens / index->live_docs, 1.0f);
+    gfloat *scores = g_new0(gfloat, total);
+    guint8 *matched = g_new0(guint8, total);   // groups matched so far, all required
+    guint32 *offsets = g_new(guint32, total);  // earliest first occurrence of a group
+    memset(offsets, 0xff, total * sizeof(guint32));
+    GArray *positions = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GHashTable *phrase_starts = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_array_unref);
+
+    for (guint g = 0; g < groups->len && g < G_MAXUINT8; g++) {
+        gchar **words = g_ptr_array_index(groups, g);
+        guint word_count = g_strv_length(words);
+
+        if (word_count == 1) {
+            SearchCursor cursors[2];
+            gfloat idf = search_idf(index, search_term_cursors(index, words[0], &cursors[0], &cursors[1]));
+            for (int c = 0; c < 2; c++) {
+                while (search_cursor_next(&cursors[c])) {
+                    guint32 doc = cursors[c].doc;
+                    if (doc >= total || matched[doc] != g || !search_doc_live(index, doc)) continue;
+                    scores[doc] += search_bm25(idf, cursors[c].tf, search_doc_length(index, doc), avg_length);
+                    offsets[doc] = MIN(offsets[doc], cursors[c].offset);
+                    matched[doc] = g + 1;
+                }
+            }
+            continue;
+        }
+
+        // Phrase: keep the start positions at which every word so far lines up
+        g_hash_table_remove_all(phrase_starts);
+        gfloat idf_sum = 0;
+        for (guint w = 0; w < word_count; w++) {
+            SearchCursor cursors[2];
+            idf_sum += search_idf(index, search_term_cursors(index, words[w], &cursors[0], &cursors[1]));
+            GHashTable *survivors = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_array_unref);
+
+            for (int c = 0; c < 2; c++) {
+                while (search_cursor_next(&cursors[c])) {
+                    guint32 doc = cursors[c].doc;
+                    if (doc >= total || matched[doc] != g || !search_doc_live(index, doc)) continue;
+                    search_read_positions(&cursors[c], positions);
+
+                    GArray *starts = g_array_new(FALSE, FALSE, sizeof(guint32));
+                    if (w == 0) {
+                        g_array_append_vals(starts, positions->data, positions->len);
+                        offsets[doc] = MIN(offsets[doc], cursors[c].offset);
+                    } else {
+                        GArray *previous = g_hash_table_lookup(phrase_starts, GUINT_TO_POINTER(doc));
+                        // Both lists are sorted, so a merge finds start + w in positions
+                        for (guint a = 0, b = 0; previous && a < previous->len && b < positions->len;) {
+                            guint32 want = g_array_index(previous, guint32, a) + w;
+                            guint32 have = g_array_index(positions, guint32, b);
+                            if (want == have) {
+                                g_array_append_val(starts, g_array_index(previous, guint32, a));
+                                a++;
+                                b++;
+                            } else if (want < have) {
+                                a++;
+                            } else {
+                                b++;
+                            }
+                        }
+                    }
+                    if (starts->len > 0) {
+                        g_hash_table_insert(survivors, GUINT_TO_POINTER(doc), starts);
+                    } else {
+                        g_array_unref(starts);
+                    }
+                }
+            }
+            g_hash_table_unref(phrase_starts);
+            phrase_starts = survivors;
+        }
+
+        GHashTableIter iter;
+        gpointer doc_key, value;
+        g_hash_table_iter_init(&iter, phrase_starts);
+        while (g_hash_table_iter_next(&iter, &doc_key, &value)) {
+            guint32 doc = GPOINTER_TO_UINT(doc_key);
+            scores[doc] += search_bm25(idf_sum, ((GArray *)value)->len,
+                                       search_doc_length(index, doc), avg_length);
+            matched[doc] = g + 1;
+        }
+    }
+
+    // Keep the best `limit` with a min-heap over the matching docs
+    guint group_count = MIN(groups->len, G_MAXUINT8);
+    for (guint32 doc = 0; doc < total; doc++) {
+        if (matched[doc] != group_count) continue;
+
+        SearchHit hit = { doc, scores[doc], offsets[doc] };
+        if (hits->len < limit) {
+            g_array_append_val(hits, hit);
+            for (guint i = hits->len - 1; i > 0;) {
+                guint parent = (i - 1) / 2;
+                SearchHit *h = (SearchHit *)hits->data;
+                if (h[parent].score <= h[i].score) break;
+                SearchHit tmp = h[parent]; h[parent] = h[i]; h[i] = tmp;
+                i = parent;
+            }
+        } else if (hit.score > g_array_index(hits, SearchHit, 0).score) {
+            SearchHit *h = (SearchHit *)hits->data;
+            h[0] = hit;
+            for (guint i = 0;;) {
+                guint smallest = i, left = 2 * i + 1, right = left + 1;
+                if (left < hits->len && h[left].score < h[smallest].score) smallest = left;
+                if (right < hits->len && h[right].score < h[smallest].score) smallest = right;
+                if (smallest == i) break;
+                SearchHit tmp = h[smallest]; h[smallest] = h[i]; h[i] = tmp;
+                i = smallest;
+            }
+        }
+    }
+    g_array_sort(hits, search_hit_compare);
+
+    g_hash_table_unref(phrase_starts);
+    g_array_unref(positions);
+    g_free(offsets);
+    g_free(matched);
+    g_free(scores);
+    return hits;
+}
+
+// Escapes text for a double-quoted JSON (and JavaScript) string literal
+void json_append_escaped(GString *out, const char *text) {
+    g_string_append_c(out, '"');
+    for (const char *p = text; *p; p++) {
+        guchar c = *p;
+        switch (c) {
+            case '"':  g_string_append(out, "\\\""); break;
+            case '\\': g_string_append(out, "\\\\"); break;
+            case '\n': g_string_append(out, "\\n"); break;
+            case '\r': g_string_append(out, "\\r"); break;
+            case '\t': g_string_append(out, "\\t"); break;
+            default:
+                if (c < 0x20) {
+                    g_string_append_printf(out, "\\u%04x", c);
+                } else if (c == 0xe2 && (guchar)p[1] == 0x80 &&
+                           ((guchar)p[2] == 0xa8 || (guchar)p[2] == 0xa9)) {
+                    // U+2028/U+2029 are valid JSON but end a line in JavaScript
+                    g_string_append(out, (guchar)p[2] == 0xa8 ? "\\u2028" : "\\u2029");
+                    p += 2;
+                } else {
+                    g_string_append_c(out, c);
+                }
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+gboolean search_group_has_word(GPtrArray *groups, const char *word) {
+    for (guint g = 0; g < groups->len; g++) {
+        gchar **words = g_ptr_array_index(groups, g);
+        if (g_strv_contains((const gchar * const *)words, word)) return TRUE;
+    }
+    return FALSE;
+}
+
+// HTML excerpt around the query word at byte offset in a note, with matches
+// in <mark>. Only a window around the offset is read.
+char* search_build_snippet(const char *path, guint32 offset, GPtrArray *groups) {
+    // At most four bytes per character, plus one for a character cut in half
+    gsize lead = (SEARCH_SNIPPET_CHARS / 3) * 4 + 4;
+    gsize window = lead + SEARCH_SNIPPET_CHARS * 4 + 4;
+    goffset read_start = offset > lead ? offset - lead : 0;
+
+    GFile *file = g_file_new_for_path(path);
+    GFileInputStream *stream = g_file_read(file, NULL, NULL);
+    g_object_unref(file);
+    if (!stream) return g_strdup("");
+    char *buffer = g_malloc(window);
+    gsize length = 0;
+    if (!g_seekable_seek(G_SEEKABLE(stream), read_start, G_SEEK_SET, NULL, NULL) ||
+        !g_input_stream_read_all(G_INPUT_STREAM(stream), buffer, window, &length, NULL, NULL)) {
+        length = 0;
+    }
+    g_object_unref(stream);
+    gboolean at_end = length < window;
+
+    // Drop the halves of characters cut at either edge of the window
+    const char *text = buffer, *end = buffer + length;
+    if (read_start > 0) {
+        while (text < end && ((guchar)*text & 0xc0) == 0x80) text++;
+    }
+    const char *valid_end;
+    g_utf8_validate(text, end - text, &valid_end);
+    end = valid_end;
+
+    // The note may have changed since it was indexed; then start at the top
+    const char *match = buffer + (offset - read_start);
+    const char *window_start = match >= text && match < end ? match : text;
+
+    // Back up a little so the match has some leading context
+    for (int i = 0; i < SEARCH_SNIPPET_CHARS / 3 && window_start > text; i++) {
+        window_start = g_utf8_find_prev_char(text, window_start);
+    }
+    const char *window_end = window_start;
+    for (int i = 0; i < SEARCH_SNIPPET_CHARS && window_end < end; i++) {
+        window_end = g_utf8_find_next_char(window_end, end);
+        if (!window_end) window_end = end;
+    }
+
+    GString *snippet = g_string_new(read_start > 0 || window_start > text ? "…" : "");
+    GString *token = g_string_new(NULL);
+    const char *copied = window_start, *cursor = window_start, *token_start, *token_end;
+    while (search_next_token(&cursor, window_end, token, &token_start, &token_end)) {
+        if (!search_group_has_word(groups, token->str)) continue;
+
+        char *before = g_markup_escape_text(copied, token_start - copied);
+        char *word = g_markup_escape_text(token_start, token_end - token_start);
+        g_string_append_printf(snippet, "%s<mark>%s</mark>", before, word);
+        g_free(before);
+        g_free(word);
+        copied = token_end;
+    }
+    char *rest = g_markup_escape_text(copied, window_end - copied);
+    g_string_append(snippet, rest);
+    g_free(rest);
+    if (window_end < end || !at_end) g_string_append(snippet, "…");
+
+    g_string_free(token, TRUE);
+    g_free(buffer);
+    return g_string_free(snippet, FALSE);
+}
+
+void search_snippets_free(SearchSnippets *snippets) {
+    g_ptr_array_unref(snippets->groups);
+    g_ptr_array_unref(snippets->paths);
+    g_array_unref(snippets->offsets);
+    g_free(snippets);
+}
+
+// Reads the snippets and builds the results JSON off the main thread
+void search_snippets_thread(GTask *task, gpointer source_object, gpointer task_data,
+                            GCancellable *cancellable) {
+    SearchSnippets *snippets = task_data;
+    GString *json = g_string_new("[");
+    for (guint i = 0; i < snippets->paths->len; i++) {
+        const char *path = g_ptr_array_index(snippets->paths, i);
+        char *name = g_path_get_basename(path);
+        char *snippet = search_build_snippet(path, g_array_index(snippets->offsets, guint32, i),
+                                             snippets->groups);
+
+        if (i > 0) g_string_append(json, ",");
+        g_string_append(json, "{\"name\":");
+        json_append_escaped(json, name);
+        g_string_append(json, ",\"path\":");
+        json_append_escaped(json, path);
+        g_string_append(json, ",\"snippet\":");
+        json_append_escaped(json, snippet);
+        g_string_append(json, "}");
+        g_free(name);
+        g_free(snippet);
+    }
+    g_string_append(json, "]");
+    g_task_return_pointer(task, g_string_free(json, FALSE), g_free);
+}
+
+void search_snippets_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    SearchSnippets *snippets = g_task_get_task_data(G_TASK(result));
+    char *json = g_task_propagate_pointer(G_TASK(result), NULL);
+
+    // A newer query has been typed since
+    if (json && snippets->sequence == search_query_sequence) {
+        char *script = g_strdup_printf("updateSearchResults(%s)", json);
+        editor_run_script(script, NULL, NULL);
+        g_free(script);
+    }
+    g_free(json);
+}
+
+// Ranks on the main thread, where the index lives; snippets come from a worker
+void handle_search(WebKitUserContentManager *manager,
+                   WebKitJavascriptResult *js_result,
+                   gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    char *query = jsc_value_to_string(val);
+
+    SearchSnippets *snippets = g_new0(SearchSnippets, 1);
+    snippets->sequence = ++search_query_sequence;
+    snippets->groups = search_parse_query(query);
+    snippets->paths = g_ptr_array_new_with_free_func(g_free);
+    snippets->offsets = g_array_new(FALSE, FALSE, sizeof(guint32));
+    if (search_index) {
+        GArray *hits = search_index_query(search_index, snippets->groups, SEARCH_MAX_RESULTS);
+        for (guint i = 0; i < hits->len; i++) {
+            SearchHit *hit = &g_array_index(hits, SearchHit, i);
+            g_ptr_array_add(snippets->paths, g_strdup(search_doc_path(search_index, hit->doc)));
+            g_array_append_val(snippets->offsets, hit->offset);
+        }
+        g_array_unref(hits);
+    }
+
+    GTask *task = g_task_new(NULL, NULL, search_snippets_done, NULL);
+    g_task_set_task_data(task, snippets, (GDestroyNotify)search_snippets_free);
+    g_task_run_in_thread(task, search_snippets_thread);
+    g_object_unref(task);
+    g_free(query);
+}
+
+// Quick open
+//
+// Paths are copied into one contiguous, lowercased buffer with a 64-bit
+// character mask per path, so a keystroke is a linear pass that rejects most
+// paths with a single AND before any per-character matching.
+
+guint64 quick_open_char_bit(guchar c) {
+    if (c >= 'a' && c <= 'z') return G_GUINT64_CONSTANT(1) << (c - 'a');
+    if (c >= '0' && c <= '9') return G_GUINT64_CONSTANT(1) << (26 + c - '0');
+    // Punctuation and UTF-8 bytes share the remaining bits
+    return G_GUINT64_CONSTANT(1) << (36 + c % 28);
+}
+
+guint64 quick_open_mask(const char *text, gsize length) {
+    guint64 mask = 0;
+    for (gsize i = 0; i < length; i++) {
+        mask |= quick_open_char_bit(text[i]);
+    }
+    return mask;
+}
+
+void quick_open_rebuild() {
+    QuickOpenPaths *paths = &quick_open_paths;
+    if (!paths->text) {
+        paths->text = g_string_new(NULL);
+        paths->entries = g_array_new(FALSE, FALSE, sizeof(QuickOpenEntry));
+        paths->masks = g_array_new(FALSE, FALSE, sizeof(guint64));
+        paths->full_paths = g_ptr_array_new_with_free_func(g_free);
+    }
+    g_string_truncate(paths->text, 0);
+    g_array_set_size(paths->entries, 0);
+    g_array_set_size(paths->masks, 0);
+    g_ptr_array_set_size(paths->full_paths, 0);
+    g_clear_pointer(&quick_open_candidates, g_array_unref);
+    g_clear_pointer(&quick_open_last_query, g_free);
+    quick_open_dirty = FALSE;
+    if (!vault_directory) return;
+
+    gsize root_length = strlen(vault_directory) + 1;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, file_tree_index);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *path = key;
+        gboolean is_dir;
+        gtk_tree_model_get(GTK_TREE_MODEL(tree_store), value, 2, &is_dir, -1);
+        if (is_dir || strlen(path) <= root_length) continue;
+
+        const char *relative = path + root_length;
+        gsize length = strlen(relative);
+        const char *name = strrchr(relative, '/');
+
+        QuickOpenEntry entry;
+        entry.offset = paths->text->len;
+        entry.length = length;
+        entry.name_start = name ? name - relative + 1 : 0;
+        g_array_append_val(paths->entries, entry);
+
+        g_string_append_len(paths->text, relative, length + 1);
+        char *lower = paths->text->str + entry.offset;
+        for (gsize i = 0; i < length; i++) {
+            lower[i] = g_ascii_tolower(lower[i]);
+        }
+        guint64 mask = quick_open_mask(lower, length);
+        g_array_append_val(paths->masks, mask);
+        g_ptr_array_add(paths->full_paths, g_strdup(path));
+    }
+    quick_open_refresh_opened();
+}
+
+// Copy when each path was last opened into its entry, so scoring reads it
+// from there rather than looking the path up for every candidate
+void quick_open_refresh_opened() {
+    QuickOpenPaths *paths = &quick_open_paths;
+    quick_open_recent_changed = FALSE;
+    if (!paths->entries) return;
+    for (guint32 id = 0; id < paths->entries->len; id++) {
+        QuickOpenEntry *entry = &g_array_index(paths->entries, QuickOpenEntry, id);
+        entry->opened = quick_open_recent ?
+            GPOINTER_TO_UINT(g_hash_table_lookup(quick_open_recent, g_ptr_array_index(paths->full_paths, id))) : 0;
+    }
+}
+
+gboolean quick_open_is_boundary(const char *text, guint32 position) {
+    if (position == 0) return TRUE;
+    char previous = text[position - 1];
+    return previous == '/' || previous == ' ' || previous == '-' ||
+           previous == '_' || previous == '.';
+}
+
+// Greedy subsequence match starting at `from`. Returns -1 when some query
+// character is missing; matched byte positions go to `positions` if given.
+gint quick_open_match_from(const char *text, guint32 length, guint32 name_start, guint32 from,
+                           const char *query, guint query_length, guint32 *positions) {
+    gint score = 0;
+    guint32 position = from, previous = G_MAXUINT32, run = 0;
+    for (guint q = 0; q < query_length; q++) {
+        const char *found = memchr(text + position, query[q], length - position);
+        if (!found) return -1;
+        position = found - text;
+
+        score += 16;
+        if (quick_open_is_boundary(text, position)) score += 24;
+        if (position >= name_start) score += 12;
+        if (previous != G_MAXUINT32 && position == previous + 1) {
+            run++;
+            score += 8 * run;
+        } else {
+            run = 0;
+            if (previous != G_MAXUINT32) score -= MIN(position - previous - 1, 16);
+        }
+        if (positions) positions[q] = position;
+        previous = position;
+        position++;
+    }
+    return score;
+}
+
+// Match quality of one path, or G_MININT if it does not contain the query
+gint quick_open_score(guint32 id, const char *query, guint query_length, guint32 *positions) {
+    QuickOpenEntry *entry = &g_array_index(quick_open_paths.entries, QuickOpenEntry, id);
+    const char *text = quick_open_paths.text->str + entry->offset;
+
+    gint score = quick_open_match_from(text, entry->length, entry->name_start, 0,
+                                       query, query_length, positions);
+    if (score < 0) return G_MININT;
+
+    // A greedy match can land in a folder name; prefer one inside the file name
+    if (entry->name_start > 0) {
+        guint32 name_positions[QUICK_OPEN_MAX_QUERY];
+        gint name_score = quick_open_match_from(text, entry->length, entry->name_start,
+                                                entry->name_start, query, query_length,
+                                                positions ? name_positions : NULL);
+        if (name_score >= 0) {
+            name_score += 30;
+            if (name_score > score) {
+                score = name_score;
+                if (positions) memcpy(positions, name_positions, query_length * sizeof(guint32));
+            }
+        }
+    }
+
+    score -= entry->length / 8;
+    if (entry->opened) {
+        score += 200 / (1 + quick_open_clock - entry->opened);
+    }
+    return score;
+}
+
+// Remember when a note was opened so recent notes rank higher
+void quick_open_note_opened(const char *path) {
+    if (!quick_open_recent) {
+        quick_open_recent = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_insert(quick_open_recent, g_strdup(path), GUINT_TO_POINTER(++quick_open_clock));
+    quick_open_recent_changed = TRUE;
+}
+
+gint quick_open_recent_compare(gconstpointer a, gconstpointer b) {
+    guint opened_a = GPOINTER_TO_UINT(g_hash_table_lookup(quick_open_recent, *(const char **)a));
+    guint opened_b = GPOINTER_TO_UINT(g_hash_table_lookup(quick_open_recent, *(const char **)b));
+    return opened_a < opened_b ? -1 : opened_a > opened_b;
+}
+
+// [QuickOpen] recent lists opened notes oldest first, and opened the
+// quick_open_clock of each, so the ranking survives a restart
+void quick_open_recent_read(GKeyFile *keyfile) {
+    gsize count = 0, clocks = 0;
+    char **recent = g_key_file_get_string_list(keyfile, "QuickOpen", "recent", &count, NULL);
+    gint *opened = g_key_file_get_integer_list(keyfile, "QuickOpen", "opened", &clocks, NULL);
+    g_clear_pointer(&quick_open_recent, g_hash_table_unref);
+    quick_open_recent = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    quick_open_clock = 0;
+    for (gsize i = 0; i < count; i++) {
+        // Without matching clocks only the order is kept
+        guint clock = clocks == count && opened[i] > 0 ? (guint)opened[i] : quick_open_clock + 1;
+        g_hash_table_insert(quick_open_recent, g_strdup(recent[i]), GUINT_TO_POINTER(clock));
+        quick_open_clock = MAX(quick_open_clock, clock);
+    }
+    quick_open_recent_changed = TRUE;
+    g_strfreev(recent);
+    g_free(opened);
+}
+
+void quick_open_recent_write(GKeyFile *keyfile) {
+    if (!quick_open_recent || g_hash_table_size(quick_open_recent) == 0) return;
+    GPtrArray *paths = g_hash_table_get_keys_as_ptr_array(quick_open_recent);
+    g_ptr_array_sort(paths, quick_open_recent_compare);
+
+    guint first = paths->len > QUICK_OPEN_RECENT_MAX ? paths->len - QUICK_OPEN_RECENT_MAX : 0;
+    gint *opened = g_new(gint, paths->len - first);
+    for (guint i = first; i < paths->len; i++) {
+        opened[i - first] = GPOINTER_TO_UINT(g_hash_table_lookup(quick_open_recent, paths->pdata[i]));
+    }
+    g_key_file_set_string_list(keyfile, "QuickOpen", "recent",
+                               (const char * const *)paths->pdata + first, paths->len - first);
+    g_key_file_set_integer_list(keyfile, "QuickOpen", "opened", opened, paths->len - first);
+    g_free(opened);
+    g_ptr_array_unref(paths);
+}
+
+char* quick_open_markup(guint32 id, const char *query, guint query_length) {
+    QuickOpenEntry *entry = &g_array_index(quick_open_paths.entries, QuickOpenEntry, id);
+    const char *full_path = g_ptr_array_index(quick_open_paths.full_paths, id);
+    const char *relative = full_path + strlen(full_path) - entry->length;
+
+    guint32 positions[QUICK_OPEN_MAX_QUERY];
+    quick_open_score(id, query, query_length, positions);
+
+    // Bold every character that has a matched byte in it
+    GString *markup = g_string_new(NULL);
+    guint q = 0;
+    const char *p = relative;
+    while (*p) {
+        const char *next = g_utf8_next_char(p);
+        gboolean matched = FALSE;
+        while (q < query_length && positions[q] < (guint32)(next - relative)) {
+            matched = TRUE;
+            q++;
+        }
+        char *escaped = g_markup_escape_text(p, next - p);
+        if (matched) {
+            g_string_append_printf(markup, "<b>%s</b>", escaped);
+        } else {
+            g_string_append(markup, escaped);
+        }
+        g_free(escaped);
+        p = next;
+    }
+    return g_string_free(markup, FALSE);
+}
+
+void quick_open_update() {
+    const char *raw = gtk_entry_get_text(GTK_ENTRY(quick_open_entry));
+    char *query = g_ascii_strdown(raw, MIN(strlen(raw), QUICK_OPEN_MAX_QUERY));
+    guint query_length = strlen(query);
+    guint32 total = quick_open_paths.entries ? quick_open_paths.entries->len : 0;
+
+    // Typing one more character can only narrow the previous matches
+    GArray *previous = NULL;
+    if (quick_open_candidates && quick_open_last_query && query_length > 0 &&
+        g_str_has_prefix(query, quick_open_last_query)) {
+        previous = quick_open_candidates;
+        quick_open_candidates = NULL;
+    }
+    g_clear_pointer(&quick_open_candidates, g_array_unref);
+    quick_open_candidates = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    QuickOpenHit top[QUICK_OPEN_MAX_RESULTS];
+    guint top_count = 0;
+    guint64 query_mask = quick_open_mask(query, query_length);
+    const guint64 *masks = quick_open_paths.masks ? (const guint64 *)quick_open_paths.masks->data : NULL;
+    guint32 count = previous ? previous->len : total;
+
+    for (guint32 i = 0; i < count; i++) {
+        guint32 id = previous ? g_array_index(previous, guint32, i) : i;
+        if ((masks[id] & query_mask) != query_mask) continue;
+
+        gint score = quick_open_score(id, query, query_length, NULL);
+        if (score == G_MININT) continue;
+        g_array_append_val(quick_open_candidates, id);
+
+        // Insertion into a short sorted array beats a heap at this size
+        if (top_count < QUICK_OPEN_MAX_RESULTS || score > top[top_count - 1].score) {
+            guint slot = MIN(top_count, QUICK_OPEN_MAX_RESULTS - 1);
+            while (slot > 0 && top[slot - 1].score < score) {
+                top[slot] = top[slot - 1];
+                slot--;
+            }
+            top[slot].id = id;
+            top[slot].score = score;
+            if (top_count < QUICK_OPEN_MAX_RESULTS) top_count++;
+        }
+    }
+    if (previous) g_array_unref(previous);
+
+    g_free(quick_open_last_query);
+    quick_open_last_query = query;
+
+    gtk_list_store_clear(quick_open_store);
+    for (guint i = 0; i < top_count; i++) {
+        char *markup = quick_open_markup(top[i].id, query, query_length);
+        gtk_list_store_insert_with_values(quick_open_store, NULL, -1,
+                                          0, markup,
+                                          1, g_ptr_array_index(quick_open_paths.full_paths, top[i].id),
+                                          -1);
+        g_free(markup);
+    }
+
+    GtkTreeIter first;
+    if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(quick_open_store), &first)) {
+        gtk_tree_selection_select_iter(gtk_tree_view_get_selection(quick_open_view), &first);
+    }
+}
+
+void quick_open_query_changed(GtkEditable *editable, gpointer data) {
+    quick_open_update();
+}
+
+void quick_open_activate() {
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    if (!gtk_tree_selection_get_selected(gtk_tree_view_get_selection(quick_open_view), &model, &iter)) {
+        return;
+    }
+
+    char *path;
+    gtk_tree_model_get(model, &iter, 1, &path, -1);
+    gtk_widget_hide(quick_open_window);
+    file_tree_select_path(path);
+    g_free(path);
+}
+
+void quick_open_row_activated(GtkTreeView *view, GtkTreePath *path,
+                              GtkTreeViewColumn *column, gpointer data) {
+    quick_open_activate();
+}
+
+void quick_open_entry_activated(GtkEntry *entry, gpointer data) {
+    quick_open_activate();
+}
+
+// Move the selection in the result list without leaving the entry
+void quick_open_move_selection(gint delta) {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(quick_open_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gint n_rows = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(quick_open_store), NULL);
+    if (n_rows == 0) return;
+
+    gint row = 0;
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        GtkTreePath *path = gtk_tree_model_get_path(model, &iter);
+        row = gtk_tree_path_get_indices(path)[0] + delta;
+        gtk_tree_path_free(path);
+    }
+    row = CLAMP(row, 0, n_rows - 1);
+
+    GtkTreePath *path = gtk_tree_path_new_from_indices(row, -1);
+    gtk_tree_selection_select_path(selection, path);
+    gtk_tree_view_scroll_to_cell(quick_open_view, path, NULL, FALSE, 0, 0);
+    gtk_tree_path_free(path);
+}
+
+gboolean quick_open_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    switch (event->keyval) {
+        case GDK_KEY_Escape:
+            gtk_widget_hide(quick_open_window);
+            return TRUE;
+        case GDK_KEY_Up:
+            quick_open_move_selection(-1);
+            return TRUE;
+        case GDK_KEY_Down:
+            quick_open_move_selection(1);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+gboolean quick_open_focus_out(GtkWidget *widget, GdkEventFocus *event, gpointer data) {
+    gtk_widget_hide(quick_open_window);
+    return FALSE;
+}
+
+void quick_open_show() {
+    if (!vault_directory) return;
+
+    if (!quick_open_window) {
+        quick_open_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_window_set_transient_for(GTK_WINDOW(quick_open_window), GTK_WINDOW(window));
+        gtk_window_set_modal(GTK_WINDOW(quick_open_window), TRUE);
+        gtk_window_set_decorated(GTK_WINDOW(quick_open_window), FALSE);
+        gtk_window_set_position(GTK_WINDOW(quick_open_window), GTK_WIN_POS_CENTER_ON_PARENT);
+        gtk_window_set_default_size(GTK_WINDOW(quick_open_window), 600, 400);
+
+        GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+        gtk_container_set_border_width(GTK_CONTAINER(box), 5);
+        gtk_container_add(GTK_CONTAINER(quick_open_window), box);
+
+        quick_open_entry = gtk_search_entry_new();
+        gtk_entry_set_placeholder_text(GTK_ENTRY(quick_open_entry), "Go to note");
+        gtk_box_pack_start(GTK_BOX(box), quick_open_entry, FALSE, FALSE, 0);
+
+        // Columns: markup with matches in bold, full path
+        quick_open_store = gtk_list_store_new(2, G_TYPE_STRING, G_TYPE_STRING);
+        quick_open_view = GTK_TREE_VIEW(gtk_tree_view_new_with_model(GTK_TREE_MODEL(quick_open_store)));
+        gtk_tree_view_set_headers_visible(quick_open_view, FALSE);
+        gtk_tree_view_set_activate_on_single_click(quick_open_view, TRUE);
+        GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+        g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_START, NULL);
+        gtk_tree_view_insert_column_with_attributes(quick_open_view, -1, "Path", renderer,
+                                                    "markup", 0, NULL);
+
+        GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
+                                       GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+        gtk_container_add(GTK_CONTAINER(scroll), GTK_WIDGET(quick_open_view));
+        gtk_box_pack_start(GTK_BOX(box), scroll, TRUE, TRUE, 0);
+
+        g_signal_connect(quick_open_entry, "changed", G_CALLBACK(quick_open_query_changed), NULL);
+        g_signal_connect(quick_open_entry, "activate", G_CALLBACK(quick_open_entry_activated), NULL);
+        g_signal_connect(quick_open_view, "row-activated", G_CALLBACK(quick_open_row_activated), NULL);
+        g_signal_connect(quick_open_window, "key-press-event", G_CALLBACK(quick_open_key_press), NULL);
+        g_signal_connect(quick_open_window, "focus-out-event", G_CALLBACK(quick_open_focus_out), NULL);
+        g_signal_connect(quick_open_window, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+    }
+
+    if (quick_open_dirty) {
+        quick_open_rebuild();
+    } else if (quick_open_recent_changed) {
+        quick_open_refresh_opened();
+    }
+
+    if (gtk_entry_get_text_length(GTK_ENTRY(quick_open_entry)) > 0) {
+        // Clearing the entry runs the update through the changed signal
+        gtk_entry_set_text(GTK_ENTRY(quick_open_entry), "");
+    } else {
+        quick_open_update();
+    }
+    gtk_widget_show_all(quick_open_window);
+    gtk_window_present(GTK_WINDOW(quick_open_window));
+    gtk_widget_grab_focus(quick_open_entry);
+}
+
+gboolean on_window_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    // Runs before the focused widget (usually the web view) sees the key
+    if ((event->state & GDK_CONTROL_MASK) &&
+        (event->keyval == GDK_KEY_p || event->keyval == GDK_KEY_P)) {
+        quick_open_show();
+        return TRUE;
+    }
+    if ((event->state & GDK_CONTROL_MASK) &&
+        (event->keyval == GDK_KEY_w || event->keyval == GDK_KEY_W) && tab_active) {
+        tab_close(tab_active);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Tabs
+//
+// Every open note has a tab. Only the active one is in the globals
+// (current_file_path, editor_mirror, is_content_saved, edit_seq); the rest
+// are parked in their EditorTab. Up to tab_hot_max tabs, within an estimated
+// tab_memory_budget_mb, keep their editor instance in the page so switching
+// back is instant; the least recently used clean ones beyond that go cold.
+// Tabs with unsaved edits are never evicted.
+
+EditorTab* tab_find(const char *path) {
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (g_strcmp0(tab->path, path) == 0) return tab;
+    }
+    return NULL;
+}
+
+// The inactive hot tab whose editor shows document seq
+EditorTab* tab_for_seq(guint seq) {
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab != tab_active && tab->hot && tab->mirror_seq == seq) return tab;
+    }
+    return NULL;
+}
+
+// A new cold tab at the end of the strip
+EditorTab* tab_add(const char *path) {
+    EditorTab *tab = g_new0(EditorTab, 1);
+    tab->id = tab_next_id++;
+    tab->path = g_strdup(path);
+    tab->saved = TRUE;
+
+    GtkWidget *label_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    tab->label = gtk_label_new(NULL);
+    gtk_label_set_ellipsize(GTK_LABEL(tab->label), PANGO_ELLIPSIZE_MIDDLE);
+    gtk_label_set_max_width_chars(GTK_LABEL(tab->label), 24);
+    GtkWidget *close_button = gtk_button_new_from_icon_name("window-close-symbolic",
+                                                           GTK_ICON_SIZE_MENU);
+    gtk_button_set_relief(GTK_BUTTON(close_button), GTK_RELIEF_NONE);
+    gtk_widget_set_focus_on_click(close_button, FALSE);
+    g_signal_connect(close_button, "clicked", G_CALLBACK(tab_close_clicked), tab);
+    gtk_box_pack_start(GTK_BOX(label_box), tab->label, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(label_box), close_button, FALSE, FALSE, 0);
+    gtk_widget_show_all(label_box);
+
+    tab->page = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_widget_show(tab->page);
+    tab_switching = TRUE;
+    gtk_notebook_append_page(GTK_NOTEBOOK(tab_notebook), tab->page, label_box);
+    gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(tab_notebook), tab->page, TRUE);
+    tab_switching = FALSE;
+    gtk_widget_show(tab_notebook);
+
+    g_ptr_array_add(editor_tabs, tab);
+    tab_update_label(tab);
+    return tab;
+}
+
+void tab_open(const char *path) {
+    EditorTab *tab = tab_find(path);
+    if (!tab) tab = tab_add(path);
+    tab_activate(tab);
+}
+
+// Park the active note's state in its tab
+void tab_stash(EditorTab *tab) {
+    // With autosave on, leaving a note saves it as switching always did
+    if (!is_content_saved && autosave_enabled && current_file_path) {
+        save_current_content_to_file(current_file_path);
+    }
+    // A note still being read stays cold, and a large one is mapped again
+    note_load_cancel();
+    large_file_close();
+
+    piece_table_clear(&tab->mirror);
+    tab->mirror = editor_mirror;
+    memset(&editor_mirror, 0, sizeof(editor_mirror));
+    tab->mirror_seq = editor_mirror_seq;
+    tab->mirror_valid = editor_mirror_valid;
+    tab->saved = is_content_saved;
+    tab->edit_seq = edit_seq;
+    if (tab->hot) tab->bytes = tab->mirror.length;
+}
+
+void tab_activate(EditorTab *tab) {
+    if (tab == tab_active) return;
+    if (tab_active) tab_stash(tab_active);
+    tab_active = tab;
+    tab->last_used = ++tab_clock;
+
+    tab_switching = TRUE;
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(tab_notebook),
+                                  gtk_notebook_page_num(GTK_NOTEBOOK(tab_notebook), tab->page));
+    tab_switching = FALSE;
+
+    if (autosave_timeout_id) {
+        g_source_remove(autosave_timeout_id);
+        autosave_timeout_id = 0;
+    }
+    autosave_dirty_since = 0;
+
+    // A clean tab changed on disk meanwhile is read again
+    if (tab->hot && tab->saved && note_file_changed_on_disk(tab->path)) {
+        tab_make_cold(tab);
+    }
+
+    g_free(current_file_path);
+    current_file_path = g_strdup(tab->path);
+    piece_table_clear(&editor_mirror);
+    if (tab->hot) {
+        editor_mirror = tab->mirror;
+        memset(&tab->mirror, 0, sizeof(tab->mirror));
+        editor_mirror_seq = tab->mirror_seq;
+        editor_mirror_valid = tab->mirror_valid;
+        is_content_saved = tab->saved;
+        edit_seq = tab->edit_seq;
+
+        char script[64];
+        g_snprintf(script, sizeof(script), "showTab(%u);", tab->id);
+        editor_run_script(script, NULL, NULL);
+        if (!editor_mirror_valid) editor_mirror_resync();
+        show_editor();
+        preview_schedule();
+    } else {
+        // The editor switches over once the note has been read
+        editor_mirror_seq = 0;
+        editor_mirror_valid = FALSE;
+        is_content_saved = TRUE;
+        note_load_start(tab->path);
+    }
+    update_save_indicator();
+    update_window_title();
+    autosave_schedule();
+    file_tree_select_path(tab->path);
+    backlinks_schedule_refresh();
+    session_schedule_save();
+    tab_enforce_budget();
+}
+
+void tab_close(EditorTab *tab) {
+    // Unsaved edits are handled like leaving a note without tabs
+    if (!tab->saved && tab != tab_active) tab_activate(tab);
+    if (tab == tab_active && !is_content_saved && !check_unsaved_changes()) return;
+
+    if (tab == tab_active) {
+        note_load_cancel();
+        large_file_close();
+        tab_active = NULL;
+        piece_table_clear(&editor_mirror);
+        editor_mirror_seq = 0;
+        editor_mirror_valid = FALSE;
+        g_clear_pointer(&current_file_path, g_free);
+        is_content_saved = TRUE;
+    }
+    if (tab->hot) tab_make_cold(tab);
+
+    tab_switching = TRUE;
+    gtk_notebook_remove_page(GTK_NOTEBOOK(tab_notebook),
+                             gtk_notebook_page_num(GTK_NOTEBOOK(tab_notebook), tab->page));
+    tab_switching = FALSE;
+    g_ptr_array_remove(editor_tabs, tab);
+    session_schedule_save();
+
+    if (tab_active) return;
+
+    // Back to the most recently used tab, or the start page after the last
+    EditorTab *next = NULL;
+    for (guint i = 0; i < editor_tabs->len; i++) {
+        EditorTab *other = g_ptr_array_index(editor_tabs, i);
+        if (!next || other->last_used > next->last_used) next = other;
+    }
+    if (next) {
+        tab_activate(next);
+        return;
+    }
+    gtk_widget_hide(tab_notebook);
+    update_save_indicator();
+    update_window_title();
+    backlinks_schedule_refresh();
+    show_start_page();
+}
+
+// Drop a tab's editor instance; it is read from disk again when shown
+void tab_make_cold(EditorTab *tab) {
+    char script[64];
+    g_snprintf(script, sizeof(script), "closeTab(%u);", tab->id);
+    editor_run_script(script, NULL, NULL);
+    piece_table_clear(&tab->mirror);
+    tab->mirror_seq = 0;
+    tab->hot = FALSE;
+    tab->view_pending = TRUE;
+}
+
+// Save background tabs with unsaved edits from their mirrors. One whose
+// mirror is out of sync is saved once it is shown again.
+void tab_save_stashed() {
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab == tab_active || tab->saved || !tab->hot || !tab->mirror_valid) continue;
+        note_save_start(tab->path, piece_table_to_string(&tab->mirror), tab->edit_seq);
+    }
+}
+
+gboolean tab_stashed_unsaved() {
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab != tab_active && !tab->saved) return TRUE;
+    }
+    return FALSE;
+}
+
+// check_unsaved_changes() for the active tab, except that discarded edits are
+// dropped with its editor so the note is read from disk when shown again
+gboolean tab_check_unsaved() {
+    if (is_content_saved) return TRUE;
+    if (!tab_active || (autosave_enabled && current_file_path)) return check_unsaved_changes();
+
+    switch (unsaved_changes_dialog()) {
+        case GTK_RESPONSE_YES:
+            save_current_content_to_file(current_file_path);
+            return TRUE;
+        case GTK_RESPONSE_NO:
+            tab_make_cold(tab_active);
+            is_content_saved = TRUE;
+            tab_active->saved = TRUE;
+            tab_update_label(tab_active);
+            update_save_indicator();
+            update_window_title();
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+// Save or ask about every tab with unsaved edits before the window closes;
+// FALSE if the user cancelled. Each tab asked about is shown first.
+gboolean tab_check_all_unsaved() {
+    if (!tab_check_unsaved()) return FALSE;
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab == tab_active || tab->saved) continue;
+        if (autosave_enabled && tab->mirror_valid) {
+            note_save_start(tab->path, piece_table_to_string(&tab->mirror), tab->edit_seq);
+            continue;
+        }
+        tab_activate(tab);
+        if (!tab_check_unsaved()) return FALSE;
+    }
+    return TRUE;
+}
+
+// Evict the least recently used clean tabs while over either budget
+void tab_enforce_budget() {
+    guint64 budget = (guint64)tab_memory_budget_mb * 1024 * 1024;
+    for (;;) {
+        guint hot = 0;
+        guint64 estimate = 0;
+        EditorTab *oldest = NULL;
+        for (guint i = 0; i < editor_tabs->len; i++) {
+            EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+            if (!tab->hot) continue;
+            hot++;
+            estimate += TAB_INSTANCE_BYTES + (guint64)tab->bytes * TAB_DOCUMENT_FACTOR;
+            if (tab != tab_active && tab->saved && (!oldest || tab->last_used < oldest->last_used)) {
+                oldest = tab;
+            }
+        }
+        if (!oldest || (hot <= (guint)tab_hot_max && estimate <= budget)) return;
+        tab_make_cold(oldest);
+    }
+}
+
+void tab_update_label(EditorTab *tab) {
+    char *name = g_path_get_basename(tab->path);
+    char *text = g_strdup_printf("%s%s", name, tab->saved ? "" : " *");
+    gtk_label_set_text(GTK_LABEL(tab->label), text);
+    gtk_widget_set_tooltip_text(gtk_widget_get_parent(tab->label), tab->path);
+    g_free(text);
+    g_free(name);
+}
+
+void tab_free(EditorTab *tab) {
+    piece_table_clear(&tab->mirror);
+    g_free(tab->path);
+    g_free(tab);
+}
+
+void tab_switch_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer data) {
+    if (tab_switching) return;
+    for (guint i = 0; i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab->page == page) {
+            tab_activate(tab);
+            return;
+        }
+    }
+}
+
+void tab_close_clicked(GtkButton *button, gpointer data) {
+    tab_close(data);
+}
+
+// Under memory pressure only the active tab keeps its editor
+void tab_low_memory(GMemoryMonitor *monitor, GMemoryMonitorWarningLevel level, gpointer data) {
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab != tab_active && tab->hot && tab->saved) tab_make_cold(tab);
+    }
+}
+
+// Link graph
+//
+// Every note's [[wikilinks]] and relative Markdown links, taken from cmark's
+// AST on worker threads so links in code are ignored. Vertices are note paths
+// and wikilink names ("[[name", casefolded); each keeps the vertices it links
+// to and the notes linking to it, so backlinks are two lookups. A changed note
+// only has its own edges replaced. Tags and front-matter fields are vertices
+// too (see Tags and front matter). The graph is kept under
+// ~/.config/notes-gui/links and, like the search index, only notes whose size
+// or time changed are read again at startup.
+
+// "[[name" for the note at path: its file name without .md, casefolded
+char* link_name_key(const char *name) {
+    char *base = g_path_get_basename(name);
+    if (g_str_has_suffix(base, ".md")) base[strlen(base) - 3] = '\0';
+    char *folded = g_utf8_casefold(base, -1);
+    char *key = g_strconcat("[[", folded, NULL);
+    g_free(folded);
+    g_free(base);
+    return key;
+}
+
+void link_add_target(GPtrArray *targets, GHashTable *seen, char *key) {
+    if (g_hash_table_contains(seen, key)) {
+        g_free(key);
+        return;
+    }
+    g_hash_table_add(seen, key);
+    g_ptr_array_add(targets, key);
+}
+
+// [[target]], [[target|alias]] and [[target#heading]] in a run of text
+void link_scan_wikilinks(const char *text, GPtrArray *targets, GHashTable *seen) {
+    const char *p = text;
+    while ((p = strstr(p, "[["))) {
+        p += 2;
+        const char *end = strstr(p, "]]");
+        if (!end) return;
+        gsize length = strcspn(p, "|#]");
+        char *target = g_strstrip(g_strndup(p, MIN(length, (gsize)(end - p))));
+        if (*target) link_add_target(targets, seen, link_name_key(target));
+        g_free(target);
+        p = end + 2;
+    }
+}
+
+// Absolute path of the note a relative link points to, or NULL for links
+// out of the vault's notes: URLs, anchors, absolute paths and other files
+char* link_resolve_url(const char *dir, const char *url) {
+    if (!url || !*url || *url == '#' || *url == '/') return NULL;
+    char *scheme = g_uri_parse_scheme(url);
+    if (scheme) {
+        g_free(scheme);
+        return NULL;
+    }
+
+    char *relative = g_strndup(url, strcspn(url, "#?"));
+    char *unescaped = g_uri_unescape_string(relative, NULL);
+    const char *name = unescaped ? unescaped : relative;
+    char *base = g_path_get_basename(name);
+    char *with_suffix = strchr(base, '.') ? g_strdup(name) : g_strconcat(name, ".md", NULL);
+    char *path = g_str_has_suffix(with_suffix, ".md") ?
+        g_canonicalize_filename(with_suffix, dir) : NULL;
+    g_free(with_suffix);
+    g_free(base);
+    g_free(unescaped);
+    g_free(relative);
+    return path;
+}
+
+// Link targets, tags and front-matter fields of a note, each once
+GPtrArray* link_extract(const char *path, const char *text, gsize length) {
+    GPtrArray *targets = g_ptr_array_new_with_free_func(g_free);
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    char *dir = g_path_get_dirname(path);
+    GString *run = g_string_new(NULL);
+
+    gsize body = meta_extract_front_matter(text, length, targets, seen);
+    cmark_node *document = cmark_parse_document(text + body, length - body, CMARK_OPT_DEFAULT);
+    cmark_iter *iter = cmark_iter_new(document);
+    cmark_event_type event;
+    while ((event = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
+        cmark_node *node = cmark_iter_get_node(iter);
+        if (cmark_node_get_type(node) == CMARK_NODE_TEXT) {
+            // cmark may split "[[name]]" at the brackets
+            g_string_append(run, cmark_node_get_literal(node));
+            continue;
+        }
+        link_scan_wikilinks(run->str, targets, seen);
+        meta_scan_tags(run->str, targets, seen);
+        g_string_truncate(run, 0);
+        if (event == CMARK_EVENT_ENTER && cmark_node_get_type(node) == CMARK_NODE_LINK) {
+            char *target = link_resolve_url(dir, cmark_node_get_url(node));
+            if (target) link_add_target(targets, seen, target);
+        }
+    }
+    cmark_iter_free(iter);
+    cmark_node_free(document);
+
+    g_string_free(run, TRUE);
+    g_free(dir);
+    g_hash_table_unref(seen);
+    return targets;
+}
+
+guint32 link_graph_vertex(LinkGraph *graph, const char *key) {
+    gpointer id = g_hash_table_lookup(graph->ids, key);
+    if (id) return GPOINTER_TO_UINT(id) - 1;
+
+    LinkVertex *vertex = g_new0(LinkVertex, 1);
+    vertex->key = g_strdup(key);
+    vertex->out = g_array_new(FALSE, FALSE, sizeof(guint32));
+    vertex->in = g_array_new(FALSE, FALSE, sizeof(guint32));
+    g_ptr_array_add(graph->vertices, vertex);
+    g_hash_table_insert(graph->ids, vertex->key, GUINT_TO_POINTER(graph->vertices->len));
+    return graph->vertices->len - 1;
+}
+
+void link_vertex_free(LinkVertex *vertex) {
+    g_array_unref(vertex->out);
+    g_array_unref(vertex->in);
+    g_free(vertex->key);
+    g_free(vertex);
+}
+
+void link_graph_add_edge(LinkGraph *graph, guint32 from, guint32 to) {
+    if (from == to) return;
+    LinkVertex *source = g_ptr_array_index(graph->vertices, from);
+    LinkVertex *target = g_ptr_array_index(graph->vertices, to);
+    g_array_append_val(source->out, to);
+    g_array_append_val(target->in, from);
+}
+
+// Drop a note's outgoing edges and their reverse entries
+void link_graph_clear_note(LinkGraph *graph, guint32 id) {
+    LinkVertex *source = g_ptr_array_index(graph->vertices, id);
+    for (guint i = 0; i < source->out->len; i++) {
+        LinkVertex *target = g_ptr_array_index(graph->vertices, g_array_index(source->out, guint32, i));
+        for (guint j = 0; j < target->in->len; j++) {
+            if (g_array_index(target->in, guint32, j) == id) {
+                g_array_remove_index_fast(target->in, j);
+                break;
+            }
+        }
+    }
+    g_array_set_size(source->out, 0);
+    source->note = FALSE;
+    graph->dirty = TRUE;
+}
+
+void link_graph_open(const char *vault) {
+    if (link_graph && g_strcmp0(link_graph->vault, vault) == 0) return;
+    link_graph_close();
+    if (!vault) return;
+
+    if (!link_pool) {
+        link_results = g_async_queue_new();
+        link_pool = g_thread_pool_new(link_job_run, NULL,
+                                      CLAMP(g_get_num_processors() - 1, 1, 4), FALSE, NULL);
+    }
+
+    LinkGraph *graph = g_new0(LinkGraph, 1);
+    graph->vault = g_strdup(vault);
+    graph->generation = ++link_generation;
+    char *links_dir = g_build_filename(g_get_home_dir(), ".config", "notes-gui", "links", NULL);
+    g_mkdir_with_parents(links_dir, 0755);
+    char *vault_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, vault, -1);
+    char *file_name = g_strconcat(vault_hash, ".links", NULL);
+    graph->file_path = g_build_filename(links_dir, file_name, NULL);
+    g_free(file_name);
+    g_free(vault_hash);
+    g_free(links_dir);
+
+    graph->vertices = g_ptr_array_new_with_free_func((GDestroyNotify)link_vertex_free);
+    graph->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    graph->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    graph->deferred_checks = g_array_new(FALSE, FALSE, sizeof(LinkCheck));
+    g_array_set_clear_func(graph->deferred_checks, link_check_clear);
+    graph->loading = TRUE;
+    link_graph = graph;
+
+    // Read into a graph of its own, swapped in on the main thread
+    LinkGraph *loaded = g_new0(LinkGraph, 1);
+    loaded->file_path = g_strdup(graph->file_path);
+    loaded->generation = graph->generation;
+    loaded->vertices = g_ptr_array_new_with_free_func((GDestroyNotify)link_vertex_free);
+    loaded->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    GTask *task = g_task_new(NULL, NULL, link_graph_load_done, NULL);
+    g_task_set_task_data(task, loaded, (GDestroyNotify)link_graph_free_loaded);
+    g_task_run_in_thread(task, link_graph_load_thread);
+    g_object_unref(task);
+}
+
+void link_graph_load_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    LinkGraph *loaded = task_data;
+    gint64 started = trace_now();
+    if (!link_graph_load(loaded)) {
+        // Rebuilt as the scan reaches each note
+        g_ptr_array_set_size(loaded->vertices, 0);
+        g_hash_table_remove_all(loaded->ids);
+    }
+    trace_span("vault", "link_graph_load", started);
+    g_task_return_boolean(task, TRUE);
+}
+
+void link_graph_load_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    LinkGraph *loaded = g_task_get_task_data(G_TASK(result));
+    LinkGraph *graph = link_graph;
+    // The vault was closed or changed meanwhile
+    if (!graph || graph->generation != loaded->generation) return;
+
+    // Nothing was applied while loading, so the graph is still empty
+    g_ptr_array_unref(graph->vertices);
+    g_hash_table_unref(graph->ids);
+    graph->vertices = g_steal_pointer(&loaded->vertices);
+    graph->ids = g_steal_pointer(&loaded->ids);
+    graph->loading = FALSE;
+
+    for (guint i = 0; i < graph->deferred_checks->len; i++) {
+        LinkCheck *check = &g_array_index(graph->deferred_checks, LinkCheck, i);
+        link_graph_check(check->path, check->mtime, check->size);
+    }
+    g_array_set_size(graph->deferred_checks, 0);
+    if (graph->prune_deferred) {
+        graph->prune_deferred = FALSE;
+        link_graph_prune_unseen();
+    }
+    if (g_async_queue_length(link_results) > 0 &&
+        g_atomic_int_compare_and_exchange(&link_drain_scheduled, 0, 1)) {
+        g_idle_add(link_drain_results, NULL);
+    }
+    backlinks_schedule_refresh();
+    meta_filter_schedule_refresh();
+}
+
+void link_graph_free_loaded(LinkGraph *loaded) {
+    if (loaded->vertices) g_ptr_array_unref(loaded->vertices);
+    if (loaded->ids) g_hash_table_unref(loaded->ids);
+    g_free(loaded->file_path);
+    g_free(loaded);
+}
+
+void link_check_clear(gpointer data) {
+    LinkCheck *check = data;
+    g_free(check->path);
+}
+
+void link_graph_close() {
+    LinkGraph *graph = link_graph;
+    if (!graph) return;
+
+    if (graph->save_id) g_source_remove(graph->save_id);
+    if (graph->dirty) link_graph_save(graph);
+
+    link_graph = NULL;
+    g_ptr_array_unref(graph->vertices);
+    g_hash_table_unref(graph->ids);
+    g_hash_table_unref(graph->pending);
+    g_array_unref(graph->deferred_checks);
+    g_free(graph->vault);
+    g_free(graph->file_path);
+    g_free(graph);
+}
+
+gboolean link_graph_load(LinkGraph *graph) {
+    char *data;
+    gsize length;
+    if (!g_file_get_contents(graph->file_path, &data, &length, NULL)) return FALSE;
+
+    LinkGraphHeader header;
+    gboolean valid = length >= sizeof(header);
+    guint64 notes_end = 0, edges_end = 0;
+    if (valid) {
+        memcpy(&header, data, sizeof(header));
+        notes_end = sizeof(header) + (guint64)header.note_count * sizeof(LinkGraphNote);
+        edges_end = notes_end + (guint64)header.edge_count * sizeof(guint32);
+        valid = memcmp(header.magic, LINK_GRAPH_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == LINK_GRAPH_VERSION && header.strings_size > 0 &&
+                edges_end + header.strings_size == length && data[length - 1] == '\0';
+    }
+
+    const char *strings = data + edges_end;
+    for (guint32 i = 0; valid && i < header.note_count; i++) {
+        LinkGraphNote note;
+        memcpy(&note, data + sizeof(header) + (gsize)i * sizeof(note), sizeof(note));
+        if (note.path >= header.strings_size ||
+            (guint64)note.first_edge + note.edge_count > header.edge_count) {
+            valid = FALSE;
+            break;
+        }
+        guint32 id = link_graph_vertex(graph, strings + note.path);
+        LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+        vertex->note = TRUE;
+        vertex->mtime = note.mtime;
+        vertex->size = note.size;
+        for (guint32 e = 0; e < note.edge_count; e++) {
+            guint32 target;
+            memcpy(&target, data + notes_end + (gsize)(note.first_edge + e) * sizeof(target), sizeof(target));
+            if (target >= header.strings_size) {
+                valid = FALSE;
+                break;
+            }
+            link_graph_add_edge(graph, id, link_graph_vertex(graph, strings + target));
+        }
+    }
+    g_free(data);
+    graph->dirty = FALSE;
+    return valid;
+}
+
+// Header, one LinkGraphNote per indexed note, their targets as string
+// offsets, then the strings
+gboolean link_graph_save(LinkGraph *graph) {
+    GByteArray *notes = g_byte_array_new();
+    GByteArray *edges = g_byte_array_new();
+    GString *strings = g_string_new(NULL);
+    // String offsets by vertex id, written once each
+    guint32 *offsets = g_new(guint32, graph->vertices->len);
+    memset(offsets, 0xff, graph->vertices->len * sizeof(guint32));
+    guint32 note_count = 0, edge_count = 0;
+
+    for (guint32 id = 0; id < graph->vertices->len; id++) {
+        LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+        if (!vertex->note) continue;
+
+        LinkGraphNote note = { 0 };
+        note.mtime = vertex->mtime;
+        note.size = vertex->size;
+        note.first_edge = edge_count;
+        note.edge_count = vertex->out->len;
+        for (guint i = 0; i <= vertex->out->len; i++) {
+            // The note's own path first, then its targets
+            guint32 target = i == 0 ? id : g_array_index(vertex->out, guint32, i - 1);
+            if (offsets[target] == G_MAXUINT32) {
+                offsets[target] = strings->len;
+                LinkVertex *key = g_ptr_array_index(graph->vertices, target);
+                g_string_append_len(strings, key->key, strlen(key->key) + 1);
+            }
+            if (i == 0) {
+                note.path = offsets[target];
+            } else {
+                g_byte_array_append(edges, (const guint8*)&offsets[target], sizeof(guint32));
+                edge_count++;
+            }
+        }
+        g_byte_array_append(notes, (const guint8*)&note, sizeof(note));
+        note_count++;
+    }
+    if (strings->len == 0) g_string_append_c(strings, '\0');
+
+    LinkGraphHeader header = { 0 };
+    memcpy(header.magic, LINK_GRAPH_MAGIC, sizeof(header.magic));
+    header.version = LINK_GRAPH_VERSION;
+    header.note_count = note_count;
+    header.edge_count = edge_count;
+    header.strings_size = strings->len;
+
+    GByteArray *out = g_byte_array_sized_new(sizeof(header) + notes->len + edges->len + strings->len);
+    g_byte_array_append(out, (const guint8*)&header, sizeof(header));
+    g_byte_array_append(out, notes->data, notes->len);
+    g_byte_array_append(out, edges->data, edges->len);
+    g_byte_array_append(out, (const guint8*)strings->str, strings->len);
+
+    GError *error = NULL;
+    gboolean saved = g_file_set_contents(graph->file_path, (const char*)out->data, out->len, &error);
+    if (!saved) {
+        g_warning("Failed to save link graph: %s", error->message);
+        g_error_free(error);
+    } else {
+        graph->dirty = FALSE;
+    }
+    g_byte_array_unref(out);
+    g_byte_array_unref(notes);
+    g_byte_array_unref(edges);
+    g_string_free(strings, TRUE);
+    g_free(offsets);
+    return saved;
+}
+
+void link_graph_schedule_save(LinkGraph *graph) {
+    if (!graph->save_id) {
+        graph->save_id = g_timeout_add_seconds(LINK_GRAPH_SAVE_DELAY_S, link_graph_save_timeout, graph);
+    }
+}
+
+gboolean link_graph_save_timeout(gpointer user_data) {
+    LinkGraph *graph = user_data;
+    if (scan_in_progress || g_hash_table_size(graph->pending) > 0) return G_SOURCE_CONTINUE;
+
+    graph->save_id = 0;
+    link_graph_save(graph);
+    return G_SOURCE_REMOVE;
+}
+
+// Queue a note for link extraction. When text is given it is used as is,
+// otherwise the worker reads the file.
+void link_graph_queue(const char *path, const char *text) {
+    LinkGraph *graph = link_graph;
+    if (!graph) return;
+
+    LinkJob *job = g_new0(LinkJob, 1);
+    job->path = g_strdup(path);
+    job->text = g_strdup(text);
+    job->size_limit = (guint64)large_file_threshold_mb * 1024 * 1024;
+    job->generation = graph->generation;
+    job->sequence = ++graph->sequence;
+    g_hash_table_insert(graph->pending, g_strdup(path), GUINT_TO_POINTER(job->sequence));
+    g_thread_pool_push(link_pool, job, NULL);
+}
+
+// Called for every note the scanner sees; only changed notes are read again
+void link_graph_check(const char *path, gint64 mtime, guint64 size) {
+    LinkGraph *graph = link_graph;
+    if (!graph) return;
+    if (graph->loading) {
+        LinkCheck check = { g_strdup(path), mtime, size };
+        g_array_append_val(graph->deferred_checks, check);
+        return;
+    }
+
+    gpointer id = g_hash_table_lookup(graph->ids, path);
+    LinkVertex *vertex = id ? g_ptr_array_index(graph->vertices, GPOINTER_TO_UINT(id) - 1) : NULL;
+    if (vertex && vertex->note && vertex->mtime == mtime && vertex->size == size) {
+        vertex->seen_generation = scan_generation;
+        return;
+    }
+    link_graph_queue(path, NULL);
+}
+
+void link_graph_remove_path(const char *path) {
+    LinkGraph *graph = link_graph;
+    if (!graph) return;
+    // Its job finds the note gone and clears it once the graph is loaded
+    if (graph->loading) {
+        link_graph_queue(path, NULL);
+        return;
+    }
+
+    g_hash_table_remove(graph->pending, path);
+    gpointer id = g_hash_table_lookup(graph->ids, path);
+    if (id) link_graph_clear_note(graph, GPOINTER_TO_UINT(id) - 1);
+    link_graph_schedule_save(graph);
+    backlinks_schedule_refresh();
+    meta_filter_schedule_refresh();
+}
+
+// Drop notes the finished scan did not find on disk
+void link_graph_prune_unseen() {
+    LinkGraph *graph = link_graph;
+    if (!graph) return;
+    if (graph->loading) {
+        graph->prune_deferred = TRUE;
+        return;
+    }
+
+    for (guint32 id = 0; id < graph->vertices->len; id++) {
+        LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+        if (vertex->note && vertex->seen_generation != scan_generation &&
+            !g_hash_table_contains(graph->pending, vertex->key)) {
+            link_graph_clear_note(graph, id);
+        }
+    }
+    if (graph->dirty) {
+        link_graph_schedule_save(graph);
+        backlinks_schedule_refresh();
+        meta_filter_schedule_refresh();
+    }
+}
+
+void link_job_free(LinkJob *job) {
+    g_free(job->path);
+    g_free(job->text);
+    if (job->targets) g_ptr_array_unref(job->targets);
+    g_free(job);
+}
+
+// Thread pool worker: read one note and extract its links
+void link_job_run(gpointer data, gpointer user_data) {
+    LinkJob *job = data;
+
+    GStatBuf st;
+    char *text = job->text;
+    gsize length = text ? strlen(text) : 0;
+    // A large-file note would be read whole here; it is kept as a note
+    // without outgoing links instead
+    gboolean found = g_stat(job->path, &st) == 0;
+    gboolean large = found && !text && (guint64)st.st_size >= job->size_limit;
+    if (!found ||
+        (!text && !large && !g_file_get_contents(job->path, &text, &length, NULL))) {
+        job->missing = TRUE;
+    } else {
+        job->mtime = st.st_mtime;
+        job->size = st.st_size;
+        job->targets = large ? g_ptr_array_new_with_free_func(g_free) :
+                               link_extract(job->path, text, length);
+    }
+    if (text != job->text) g_free(text);
+    g_clear_pointer(&job->text, g_free);
+
+    g_async_queue_push(link_results, job);
+    if (g_atomic_int_compare_and_exchange(&link_drain_scheduled, 0, 1)) {
+        g_idle_add(link_drain_results, NULL);
+    }
+}
+
+gboolean link_drain_results(gpointer user_data) {
+    gint64 deadline = g_get_monotonic_time() + LINK_FRAME_BUDGET_US;
+
+    // Applied once the saved graph is in; link_graph_load_done drains again
+    if (link_graph && link_graph->loading) {
+        g_atomic_int_set(&link_drain_scheduled, 0);
+        return G_SOURCE_REMOVE;
+    }
+
+    while (g_get_monotonic_time() < deadline) {
+        LinkJob *job = g_async_queue_try_pop(link_results);
+        if (!job) {
+            g_atomic_int_set(&link_drain_scheduled, 0);
+            if (g_async_queue_length(link_results) > 0 &&
+                g_atomic_int_compare_and_exchange(&link_drain_scheduled, 0, 1)) {
+                continue;
+            }
+            return G_SOURCE_REMOVE;
+        }
+        link_graph_apply(job);
+        link_job_free(job);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Replace one note's edges
+void link_graph_apply(LinkJob *job) {
+    LinkGraph *graph = link_graph;
+    if (!graph || job->generation != graph->generation) return;
+
+    // Only the newest job for a path counts; a later save may have overtaken it
+    guint latest = GPOINTER_TO_UINT(g_hash_table_lookup(graph->pending, job->path));
+    if (latest != job->sequence) return;
+    g_hash_table_remove(graph->pending, job->path);
+
+    guint32 id = link_graph_vertex(graph, job->path);
+    link_graph_clear_note(graph, id);
+    link_graph_schedule_save(graph);
+    backlinks_schedule_refresh();
+    meta_filter_schedule_refresh();
+    if (job->missing) return;
+
+    LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+    vertex->note = TRUE;
+    vertex->mtime = job->mtime;
+    vertex->size = job->size;
+    vertex->seen_generation = scan_generation;
+    for (guint i = 0; i < job->targets->len; i++) {
+        link_graph_add_edge(graph, id, link_graph_vertex(graph, g_ptr_array_index(job->targets, i)));
+    }
+}
+
+// Notes linking to path, by its path or by its name, each once
+GPtrArray* link_graph_backlinks(const char *path) {
+    GPtrArray *sources = g_ptr_array_new();
+    LinkGraph *graph = link_graph;
+    if (!graph || !path) return sources;
+
+    char *name_key = link_name_key(path);
+    const char *keys[] = { path, name_key };
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (guint k = 0; k < G_N_ELEMENTS(keys); k++) {
+        gpointer id = g_hash_table_lookup(graph->ids, keys[k]);
+        if (!id) continue;
+        LinkVertex *vertex = g_ptr_array_index(graph->vertices, GPOINTER_TO_UINT(id) - 1);
+        for (guint i = 0; i < vertex->in->len; i++) {
+            LinkVertex *source = g_ptr_array_index(graph->vertices, g_array_index(vertex->in, guint32, i));
+            if (g_hash_table_add(seen, source)) {
+                g_ptr_array_add(sources, source->key);
+            }
+        }
+    }
+    g_hash_table_unref(seen);
+    g_free(name_key);
+    return sources;
+}
+
+void backlinks_schedule_refresh() {
+    if (!backlinks_refresh_id) {
+        backlinks_refresh_id = g_idle_add(backlinks_refresh, NULL);
+    }
+}
+
+gint backlinks_compare(gconstpointer a, gconstpointer b) {
+    return g_utf8_collate(*(const char * const *)a, *(const char * const *)b);
+}
+
+// Fill the backlinks panel for the note being shown
+gboolean backlinks_refresh(gpointer user_data) {
+    backlinks_refresh_id = 0;
+    if (!backlinks_list) return G_SOURCE_REMOVE;
+
+    GList *rows = gtk_container_get_children(GTK_CONTAINER(backlinks_list));
+    for (GList *l = rows; l; l = l->next) {
+        gtk_widget_destroy(l->data);
+    }
+    g_list_free(rows);
+
+    GPtrArray *sources = link_graph_backlinks(current_file_path);
+    g_ptr_array_sort(sources, backlinks_compare);
+    for (guint i = 0; i < sources->len; i++) {
+        const char *source = g_ptr_array_index(sources, i);
+        char *name = g_path_get_basename(source);
+        GtkWidget *label = gtk_label_new(name);
+        gtk_label_set_xalign(GTK_LABEL(label), 0);
+        gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+        gtk_widget_set_tooltip_text(label, source);
+        GtkWidget *row = gtk_list_box_row_new();
+        gtk_container_add(GTK_CONTAINER(row), label);
+        g_object_set_data_full(G_OBJECT(row), "path", g_strdup(source), g_free);
+        gtk_container_add(GTK_CONTAINER(backlinks_list), row);
+        g_free(name);
+    }
+    gtk_widget_show_all(backlinks_list);
+
+    char *title = g_strdup_printf("Backlinks (%u)", sources->len);
+    gtk_expander_set_label(GTK_EXPANDER(backlinks_expander), title);
+    g_free(title);
+    g_ptr_array_unref(sources);
+    return G_SOURCE_REMOVE;
+}
+
+void backlinks_row_activated(GtkListBox *box, GtkListBoxRow *row, gpointer data) {
+    const char *path = g_object_get_data(G_OBJECT(row), "path");
+    if (path) file_tree_select_path(path);
+}
+
+// Tags and front matter
+//
+// A note's front-matter fields and inline #tags are kept in the link graph as
+// vertices named "#field:value" (casefolded; tags and the tags: list are
+// "#tag:name"), so they are extracted by the same workers, persisted in the
+// same file and replaced per note like links. A field's vertex lists the notes
+// carrying it, which is its posting set. Queries combine these sets as bitmaps
+// over vertex ids with AND, OR and NOT.
+
+// "#field:value", or NULL when the value is empty or too long to be a tag
+char* meta_term_key(const char *field, const char *value) {
+    char *field_copy = g_strstrip(g_strdup(field));
+    char *value_copy = g_strstrip(g_strdup(value));
+    char *stripped = value_copy;
+    gsize length = strlen(stripped);
+    if (length >= 2 && (stripped[0] == '"' || stripped[0] == '\'') && stripped[length - 1] == stripped[0]) {
+        stripped[length - 1] = '\0';
+        stripped = g_strstrip(stripped + 1);
+    }
+
+    gboolean tag = g_ascii_strcasecmp(field_copy, "tag") == 0 || g_ascii_strcasecmp(field_copy, "tags") == 0;
+    if (tag && *stripped == '#') stripped++;
+
+    char *key = NULL;
+    if (*field_copy && *stripped && strlen(stripped) <= META_VALUE_MAX_BYTES &&
+        g_utf8_validate(stripped, -1, NULL)) {
+        char *folded_field = g_utf8_casefold(field_copy, -1);
+        char *folded_value = g_utf8_casefold(stripped, -1);
+        key = g_strconcat("#", tag ? "tag" : folded_field, ":", folded_value, NULL);
+        g_free(folded_value);
+        g_free(folded_field);
+    }
+    g_free(value_copy);
+    g_free(field_copy);
+    return key;
+}
+
+void meta_add_term(GPtrArray *targets, GHashTable *seen, const char *field, const char *value) {
+    char *key = meta_term_key(field, value);
+    if (key) link_add_target(targets, seen, key);
+}
+
+// Fields of the YAML front matter opening a note. Only the flat subset notes
+// use is read: "key: value", "key: [a, b]" and "key:" followed by "- item"
+// lines; a tags: value may also list tags separated by commas or spaces.
+// Returns the offset of the body, 0 when the note has no front matter.
+gsize meta_extract_front_matter(const char *text, gsize length, GPtrArray *targets, GHashTable *seen) {
+    if (length < 4 || strncmp(text, "---", 3) != 0 || (text[3] != '\n' && text[3] != '\r')) return 0;
+
+    const char *end = text + length;
+    const char *start = memchr(text, '\n', length);
+    if (!start) return 0;
+    start++;
+
+    // Find the closing line first so a stray "---" rule is not taken for front matter
+    const char *line = start, *close = NULL, *body = NULL;
+    while (line < end && !close) {
+        const char *newline = memchr(line, '\n', end - line);
+        const char *line_end = newline ? newline : end;
+        gsize line_length = line_end - line;
+        while (line_length > 0 && g_ascii_isspace(line[line_length - 1])) line_length--;
+        if (line_length == 3 && (strncmp(line, "---", 3) == 0 || strncmp(line, "...", 3) == 0)) {
+            close = line;
+            body = newline ? newline + 1 : end;
+        }
+        line = newline ? newline + 1 : end;
+    }
+    if (!close) return 0;
+
+    char *list_field = NULL;
+    for (line = start; line < close; ) {
+        const char *newline = memchr(line, '\n', close - line);
+        const char *line_end = newline ? newline : close;
+        char *content = g_strndup(line, line_end - line);
+        gboolean indented = g_ascii_isspace(content[0]);
+        g_strstrip(content);
+        line = newline ? newline + 1 : close;
+
+        if (list_field && content[0] == '-' && (content[1] == '\0' || g_ascii_isspace(content[1]))) {
+            meta_add_term(targets, seen, list_field, content + 1);
+        } else if (!indented && content[0] != '#' && strchr(content, ':')) {
+            g_clear_pointer(&list_field, g_free);
+            char *colon = strchr(content, ':');
+            *colon = '\0';
+            char *field = g_strstrip(content);
+            char *value = g_strstrip(colon + 1);
+            gsize value_length = strlen(value);
+            gboolean tags = g_ascii_strcasecmp(field, "tags") == 0 || g_ascii_strcasecmp(field, "tag") == 0;
+
+            if (!*value) {
+                list_field = g_strdup(field);
+            } else if (value[0] == '[' && value[value_length - 1] == ']') {
+                value[value_length - 1] = '\0';
+                char **items = g_strsplit(value + 1, ",", -1);
+                for (char **item = items; *item; item++) meta_add_term(targets, seen, field, *item);
+                g_strfreev(items);
+            } else if (tags) {
+                char **items = g_strsplit_set(value, ", \t", -1);
+                for (char **item = items; *item; item++) meta_add_term(targets, seen, field, *item);
+                g_strfreev(items);
+            } else {
+                meta_add_term(targets, seen, field, value);
+            }
+        } else if (!indented || content[0] != '-') {
+            g_clear_pointer(&list_field, g_free);
+        }
+        g_free(content);
+    }
+    g_free(list_field);
+    return body - text;
+}
+
+// Inline #tags in a run of text: letters, digits, _, - and / after a space or
+// the start, with at least one character that is not a digit
+void meta_scan_tags(const char *text, GPtrArray *targets, GHashTable *seen) {
+    for (const char *p = text; (p = strchr(p, '#')); ) {
+        gboolean boundary = p == text;
+        if (!boundary) {
+            gunichar previous = g_utf8_get_char(g_utf8_prev_char(p));
+            boundary = g_unichar_isspace(previous) || previous == '(' || previous == ',';
+        }
+        const char *name = ++p;
+        gboolean digits_only = TRUE;
+        while (*p) {
+            gunichar c = g_utf8_get_char(p);
+            if (!g_unichar_isalnum(c) && c != '_' && c != '-' && c != '/') break;
+            if (!g_unichar_isdigit(c)) digits_only = FALSE;
+            p = g_utf8_next_char(p);
+        }
+        if (boundary && p > name && !digits_only) {
+            char *tag = g_strndup(name, p - name);
+            meta_add_term(targets, seen, "tag", tag);
+            g_free(tag);
+        }
+    }
+}
+
+// Next token of a query: "(", ")", an operator or a term, NULL at the end.
+// Double quotes keep spaces and operator names inside a term.
+char* meta_query_token(MetaQuery *query, gboolean *quoted) {
+    const char *p = query->cursor;
+    while (g_ascii_isspace(*p)) p++;
+    *quoted = FALSE;
+    if (!*p) {
+        query->cursor = p;
+        return NULL;
+    }
+    if (*p == '(' || *p == ')') {
+        query->cursor = p + 1;
+        return g_strndup(p, 1);
+    }
+
+    GString *token = g_string_new(NULL);
+    while (*p && !g_ascii_isspace(*p) && *p != '(' && *p != ')') {
+        if (*p == '"') {
+            *quoted = TRUE;
+            const char *close = strchr(p + 1, '"');
+            if (!close) close = p + strlen(p);
+            g_string_append_len(token, p + 1, close - p - 1);
+            p = *close ? close + 1 : close;
+        } else {
+            g_string_append_c(token, *p++);
+        }
+    }
+    query->cursor = p;
+    return g_string_free(token, FALSE);
+}
+
+// Consume the next token if it is the given operator or parenthesis
+gboolean meta_query_accept(MetaQuery *query, const char *keyword) {
+    const char *saved = query->cursor;
+    gboolean quoted;
+    char *token = meta_query_token(query, &quoted);
+    gboolean match = token && !quoted && strcmp(token, keyword) == 0;
+    g_free(token);
+    if (!match) query->cursor = saved;
+    return match;
+}
+
+// Whether an AND chain stops here: at the end, a ")" or an OR
+gboolean meta_query_chain_ends(MetaQuery *query) {
+    const char *saved = query->cursor;
+    gboolean quoted;
+    char *token = meta_query_token(query, &quoted);
+    gboolean ends = !token || (!quoted && (strcmp(token, ")") == 0 || strcmp(token, "OR") == 0));
+    g_free(token);
+    query->cursor = saved;
+    return ends;
+}
+
+// NOT operand | ( expression ) | term
+guint64* meta_query_operand(MetaQuery *query) {
+    if (meta_query_accept(query, "NOT")) {
+        guint64 *result = meta_query_operand(query);
+        for (guint i = 0; i < query->words; i++) result[i] = ~result[i] & query->notes[i];
+        return result;
+    }
+    if (meta_query_accept(query, "(")) {
+        guint64 *result = meta_query_or(query);
+        if (!meta_query_accept(query, ")")) query->failed = TRUE;
+        return result;
+    }
+
+    guint64 *result = g_new0(guint64, query->words);
+    gboolean quoted;
+    char *token = meta_query_token(query, &quoted);
+    if (!token || (!quoted && (strcmp(token, ")") == 0 || strcmp(token, "AND") == 0 ||
+                               strcmp(token, "OR") == 0))) {
+        query->failed = TRUE;
+        g_free(token);
+        return result;
+    }
+
+    // field:value, #tag, or a bare word taken as a tag
+    const char *colon = strchr(token, ':');
+    char *key;
+    if (*token == '#' || !colon) {
+        key = meta_term_key("tag", token);
+    } else {
+        char *field = g_strndup(token, colon - token);
+        key = meta_term_key(field, colon + 1);
+        g_free(field);
+    }
+    gpointer id = key ? g_hash_table_lookup(query->graph->ids, key) : NULL;
+    if (id) {
+        LinkVertex *vertex = g_ptr_array_index(query->graph->vertices, GPOINTER_TO_UINT(id) - 1);
+        for (guint i = 0; i < vertex->in->len; i++) {
+            guint32 note = g_array_index(vertex->in, guint32, i);
+            result[note / 64] |= G_GUINT64_CONSTANT(1) << (note % 64);
+        }
+    }
+    g_free(key);
+    g_free(token);
+    return result;
+}
+
+// operand [AND] operand ...
+guint64* meta_query_and(MetaQuery *query) {
+    guint64 *result = meta_query_operand(query);
+    while (!query->failed) {
+        if (!meta_query_accept(query, "AND") && meta_query_chain_ends(query)) break;
+        guint64 *operand = meta_query_operand(query);
+        for (guint i = 0; i < query->words; i++) result[i] &= operand[i];
+        g_free(operand);
+    }
+    return result;
+}
+
+// and-chain OR and-chain ...
+guint64* meta_query_or(MetaQuery *query) {
+    guint64 *result = meta_query_and(query);
+    while (!query->failed && meta_query_accept(query, "OR")) {
+        guint64 *operand = meta_query_and(query);
+        for (guint i = 0; i < query->words; i++) result[i] |= operand[i];
+        g_free(operand);
+    }
+    return result;
+}
+
+// Notes matching a query such as "tag:a AND NOT status:done", or NULL if it
+// does not parse. The paths belong to the graph; use them before it changes.
+GPtrArray* meta_query_run(const char *text) {
+    LinkGraph *graph = link_graph;
+    GPtrArray *matches = g_ptr_array_new();
+    if (!graph) return matches;
+
+    MetaQuery query = { .cursor = text, .graph = graph };
+    query.words = (graph->vertices->len + 63) / 64;
+    query.notes = g_new0(guint64, MAX(query.words, 1));
+    for (guint32 id = 0; id < graph->vertices->len; id++) {
+        LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+        if (vertex->note) query.notes[id / 64] |= G_GUINT64_CONSTANT(1) << (id % 64);
+    }
+
+    guint64 *result = meta_query_or(&query);
+    if (!query.failed && query.cursor[strspn(query.cursor, " \t\r\n")] != '\0') query.failed = TRUE;
+    if (query.failed) {
+        g_ptr_array_unref(matches);
+        matches = NULL;
+    } else {
+        for (guint i = 0; i < query.words; i++) {
+            for (guint64 word = result[i]; word; word &= word - 1) {
+                guint32 id = i * 64 + g_bit_nth_lsf(word, -1);
+                g_ptr_array_add(matches, ((LinkVertex *)g_ptr_array_index(graph->vertices, id))->key);
+            }
+        }
+    }
+    g_free(result);
+    g_free(query.notes);
+    return matches;
+}
+
+gboolean meta_filter_visible(GtkTreeModel *model, GtkTreeIter *iter, gpointer data) {
+    if (!meta_filter_paths) return FALSE;
+    char *path;
+    gtk_tree_model_get(model, iter, 1, &path, -1);
+    gboolean visible = path && g_hash_table_contains(meta_filter_paths, path);
+    g_free(path);
+    return visible;
+}
+
+// Run the filter query and show the matching notes, with their folders, in
+// place of the file tree; an empty query shows the whole tree again
+void meta_filter_apply() {
+    char *text = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(meta_filter_entry))));
+    GtkStyleContext *style = gtk_widget_get_style_context(meta_filter_entry);
+    if (!*text) {
+        g_free(text);
+        gtk_style_context_remove_class(style, "error");
+        g_clear_pointer(&meta_filter_paths, g_hash_table_unref);
+        gtk_widget_hide(meta_filter_scroll);
+        gtk_widget_show(file_tree_scroll);
+        return;
+    }
+
+    gint64 start = trace_now();
+    GPtrArray *matches = meta_query_run(text);
+    g_free(text);
+    if (!matches) {
+        gtk_style_context_add_class(style, "error");
+        return;
+    }
+    gtk_style_context_remove_class(style, "error");
+    trace_span("meta", "query", start);
+
+    GHashTable *paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (guint i = 0; i < matches->len; i++) {
+        char *path = g_strdup(g_ptr_array_index(matches, i));
+        while (path && !g_hash_table_contains(paths, path)) {
+            g_hash_table_add(paths, path);
+            gboolean top = !vault_directory || !g_str_has_prefix(path, vault_directory) ||
+                           strcmp(path, vault_directory) == 0;
+            path = top ? NULL : g_path_get_dirname(path);
+        }
+        g_free(path);
+    }
+
+    if (meta_filter_paths) g_hash_table_unref(meta_filter_paths);
+    meta_filter_paths = paths;
+    gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(meta_filter_model));
+    gtk_tree_view_expand_all(meta_filter_view);
+
+    char *title = g_strdup_printf(matches->len == 1 ? "%u note" : "%u notes", matches->len);
+    gtk_tree_view_column_set_title(gtk_tree_view_get_column(meta_filter_view, 0), title);
+    g_free(title);
+    g_ptr_array_unref(matches);
+
+    gtk_widget_hide(file_tree_scroll);
+    gtk_widget_show(meta_filter_scroll);
+}
+
+void meta_filter_changed(GtkSearchEntry *entry, gpointer data) {
+    meta_filter_apply();
+}
+
+// Re-run an active filter once the graph has settled for a moment
+void meta_filter_schedule_refresh() {
+    if (!meta_filter_paths || meta_filter_refresh_id) return;
+    meta_filter_refresh_id = g_timeout_add(META_FILTER_REFRESH_MS, meta_filter_refresh_timeout, NULL);
+}
+
+gboolean meta_filter_refresh_timeout(gpointer user_data) {
+    meta_filter_refresh_id = 0;
+    meta_filter_apply();
+    return G_SOURCE_REMOVE;
+}
+
+void meta_filter_selection_changed(GtkTreeSelection *selection, gpointer data) {
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+
+    char *path;
+    gboolean is_dir;
+    gtk_tree_model_get(model, &iter, 1, &path, 2, &is_dir, -1);
+    if (!is_dir) file_tree_select_path(path);
+    g_free(path);
+}
+
+// Link-aware rename
+//
+// Renaming or moving a note or folder rewrites the links that would break:
+// [[wikilinks]] by the old name, relative links to the old path, and the
+// relative links of the moved notes themselves. The link graph names the notes
+// to rewrite, so only those are read. Workers write each rewritten note to a
+// hidden file beside it; only once every one is written is the rename done and
+// the rewritten notes moved over the originals, otherwise the temporary files
+// are dropped and nothing on disk has changed.
+
+// Where path ends up after the rename, NULL when it is not moved
+char* rename_map(const RenameOp *op, const char *path) {
+    if (op->is_dir ? !path_has_prefix(path, op->old_path) : strcmp(path, op->old_path) != 0) return NULL;
+    return g_strconcat(op->new_path, path + strlen(op->old_path), NULL);
+}
+
+// Relative link from a folder to a path, both absolute
+char* rename_relative_path(const char *from_dir, const char *to_path) {
+    char **from = g_strsplit(from_dir, G_DIR_SEPARATOR_S, -1);
+    char **to = g_strsplit(to_path, G_DIR_SEPARATOR_S, -1);
+    guint common = 0;
+    while (from[common] && to[common] && strcmp(from[common], to[common]) == 0) common++;
+
+    GString *relative = g_string_new(NULL);
+    for (guint i = common; from[i]; i++) {
+        if (*from[i]) g_string_append(relative, "../");
+    }
+    for (guint i = common; to[i]; i++) {
+        if (!*to[i]) continue;
+        if (relative->len > 0 && relative->str[relative->len - 1] != '/') g_string_append_c(relative, '/');
+        g_string_append(relative, to[i]);
+    }
+    g_strfreev(from);
+    g_strfreev(to);
+    return g_string_free(relative, FALSE);
+}
+
+// New target for a [[wikilink]] naming the renamed note, or NULL
+char* rename_wikilink_target(const RenameOp *op, const char *target) {
+    if (!op->new_name) return NULL;
+    char *stripped = g_strstrip(g_strdup(target));
+    char *key = link_name_key(stripped);
+    char *renamed = NULL;
+    if (strcmp(key, op->old_key) == 0) {
+        // Keep a folder written before the name, and a written .md
+        const char *slash = strrchr(stripped, '/');
+        gsize prefix = slash ? (gsize)(slash + 1 - stripped) : 0;
+        renamed = g_strdup_printf("%.*s%s%s", (int)prefix, stripped, op->new_name,
+                                  g_str_has_suffix(stripped, ".md") ? ".md" : "");
+    }
+    g_free(key);
+    g_free(stripped);
+    return renamed;
+}
+
+// New destination for a Markdown link in a note moving from dir to new_dir,
+// or NULL when the link still points where it did
+char* rename_link_url(const RenameOp *op, const char *dir, const char *new_dir,
+                      const char *url, gboolean angle) {
+    if (!*url || *url == '#' || *url == '/') return NULL;
+    char *scheme = g_uri_parse_scheme(url);
+    if (scheme) {
+        g_free(scheme);
+        return NULL;
+    }
+
+    gsize path_length = strcspn(url, "#?");
+    char *relative = g_strndup(url, path_length);
+    char *unescaped = angle ? NULL : g_uri_unescape_string(relative, NULL);
+    const char *name = unescaped ? unescaped : relative;
+    // Same rule as link_resolve_url: a link without an extension means a note
+    char *base = g_path_get_basename(name);
+    gboolean bare = !strchr(base, '.');
+    char *with_suffix = bare ? g_strconcat(name, ".md", NULL) : g_strdup(name);
+    char *target = g_canonicalize_filename(with_suffix, dir);
+    char *moved = rename_map(op, target);
+
+    char *result = NULL;
+    if (moved || strcmp(dir, new_dir) != 0) {
+        char *new_relative = rename_relative_path(new_dir, moved ? moved : target);
+        if (bare && g_str_has_suffix(new_relative, ".md")) new_relative[strlen(new_relative) - 3] = '\0';
+        if (strcmp(new_relative, name) != 0) {
+            char *escaped = angle ? g_strdup(new_relative) : g_uri_escape_string(new_relative, "/", TRUE);
+            result = g_strconcat(escaped, url + path_length, NULL);
+            g_free(escaped);
+        }
+        g_free(new_relative);
+    }
+    g_free(moved);
+    g_free(target);
+    g_free(with_suffix);
+    g_free(base);
+    g_free(unescaped);
+    g_free(relative);
+    return result;
+}
+
+// A note's text with its links rewritten for the rename, NULL when none
+// change. Fenced code and code spans are left alone.
+char* rename_rewrite_links(const RenameOp *op, const char *path, const char *text) {
+    char *dir = g_path_get_dirname(path);
+    char *moved = rename_map(op, path);
+    char *new_dir = moved ? g_path_get_dirname(moved) : g_strdup(dir);
+    GString *out = g_string_new(NULL);
+    const char *copied = text;
+    char fence = 0;
+
+    for (const char *line = text; *line; ) {
+        const char *line_end = strchr(line, '\n');
+        if (!line_end) line_end = line + strlen(line);
+        const char *lead = line;
+        while (lead < line_end && lead - line < 3 && *lead == ' ') lead++;
+
+        if (line_end - lead >= 3 && (*lead == '`' || *lead == '~') &&
+            lead[1] == *lead && lead[2] == *lead) {
+            if (!fence) fence = *lead;
+            else if (fence == *lead) fence = 0;
+        } else if (!fence) {
+            for (const char *p = line; p < line_end; ) {
+                if (*p == '`') {
+                    // Skip a code span: the next run of as many backticks
+                    gsize run = strspn(p, "`");
+                    const char *close = p + run;
+                    while (close < line_end) {
+                        close = memchr(close, '`', line_end - close);
+                        if (!close) break;
+                        gsize close_run = strspn(close, "`");
+                        if (close_run == run) break;
+                        close += close_run;
+                    }
+                    p = close && close < line_end ? close + run : p + run;
+                } else if (p[0] == '[' && p[1] == '[') {
+                    const char *close = g_strstr_len(p + 2, line_end - p - 2, "]]");
+                    if (!close) {
+                        p += 2;
+                        continue;
+                    }
+                    const char *target = p + 2;
+                    gsize target_length = MIN(strcspn(target, "|#]"), (gsize)(close - target));
+                    char *original = g_strndup(target, target_length);
+                    char *renamed = rename_wikilink_target(op, original);
+                    if (renamed) {
+                        g_string_append_len(out, copied, target - copied);
+                        g_string_append(out, renamed);
+                        copied = target + target_length;
+                        g_free(renamed);
+                    }
+                    g_free(original);
+                    p = close + 2;
+                } else if (p[0] == ']' && p[1] == '(') {
+                    const char *start = p + 2;
+                    while (start < line_end && (*start == ' ' || *start == '\t')) start++;
+                    gboolean angle = *start == '<';
+                    if (angle) start++;
+                    const char *end = start;
+                    int depth = 0;
+                    while (end < line_end) {
+                        if (angle ? *end == '>' : (*end == ' ' || *end == '\t' || (*end == ')' && depth == 0))) break;
+                        if (*end == '(') depth++;
+                        if (*end == ')') depth--;
+                        end++;
+                    }
+                    char *url = g_strndup(start, end - start);
+                    char *renamed = rename_link_url(op, dir, new_dir, url, angle);
+                    if (renamed) {
+                        g_string_append_len(out, copied, start - copied);
+                        g_string_append(out, renamed);
+                        copied = end;
+                        g_free(renamed);
+                    }
+                    g_free(url);
+                    p = end;
+                } else {
+                    p++;
+                }
+            }
+        }
+        line = *line_end ? line_end + 1 : line_end;
+    }
+
+    char *result = NULL;
+    if (copied != text) {
+        g_string_append(out, copied);
+        result = g_string_free(out, FALSE);
+    } else {
+        g_string_free(out, TRUE);
+    }
+    g_free(new_dir);
+    g_free(moved);
+    g_free(dir);
+    return result;
+}
+
+// Thread pool worker: rewrite one note into a hidden file beside it
+void rename_file_run(gpointer data, gpointer user_data) {
+    RenameFile *file = data;
+
+    char *text;
+    GError *error = NULL;
+    if (!g_file_get_contents(file->path, &text, NULL, &error)) {
+        file->error = g_strdup(error->message);
+        g_error_free(error);
+    } else {
+        char *rewritten = rename_rewrite_links(file->op, file->path, text);
+        if (rewritten) {
+            char *dir = g_path_get_dirname(file->path);
+            char *temp_path = g_build_filename(dir, ".envelope-rename-XXXXXX", NULL);
+            GStatBuf st;
+            int fd = g_mkstemp(temp_path);
+            gboolean ok = fd >= 0 &&
+                          (g_stat(file->path, &st) != 0 || fchmod(fd, st.st_mode & 0777) == 0) &&
+                          history_write_all(fd, rewritten, strlen(rewritten), 0) &&
+                          fsync(fd) == 0;
+            if (!ok) file->error = g_strdup_printf("%s: %s", file->path, g_strerror(errno));
+            if (fd >= 0) close(fd);
+            if (ok) {
+                file->temp_path = temp_path;
+            } else {
+                if (fd >= 0) g_unlink(temp_path);
+                g_free(temp_path);
+            }
+            g_free(dir);
+            g_free(rewritten);
+        }
+        g_free(text);
+    }
+
+    g_async_queue_push(rename_results, file);
+    if (g_atomic_int_compare_and_exchange(&rename_drain_scheduled, 0, 1)) {
+        g_idle_add(rename_drain_results, NULL);
+    }
+}
+
+gboolean rename_drain_results(gpointer user_data) {
+    g_atomic_int_set(&rename_drain_scheduled, 0);
+    RenameOp *op = rename_op;
+    RenameFile *file;
+    while ((file = g_async_queue_try_pop(rename_results))) {
+        op->done++;
+        if (file->error && !op->error) op->error = g_strdup(file->error);
+    }
+
+    char *text = g_strdup_printf("Updating links: %u of %u notes", op->done, op->files->len);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(rename_progress), text);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(rename_progress), (double)op->done / op->files->len);
+    g_free(text);
+
+    if (op->done == op->files->len) rename_finish(op);
+    return G_SOURCE_REMOVE;
+}
+
+void rename_file_free(RenameFile *file) {
+    g_free(file->path);
+    g_free(file->temp_path);
+    g_free(file->error);
+    g_free(file);
+}
+
+void rename_op_free(RenameOp *op) {
+    g_ptr_array_unref(op->files);
+    g_free(op->old_path);
+    g_free(op->new_path);
+    g_free(op->old_key);
+    g_free(op->new_name);
+    g_free(op->error);
+    g_free(op);
+}
+
+// Rename old_path to new_path and rewrite the notes linking to it
+void rename_start(const char *old_path, const char *new_path, gboolean is_dir) {
+    if (rename_op) {
+        show_error_dialog("Another rename is still updating links");
+        return;
+    }
+    // Until every note is in the graph, some of those linking here are not known
+    if (scan_in_progress ||
+        (link_graph && (link_graph->loading || g_hash_table_size(link_graph->pending) > 0))) {
+        show_error_dialog("Links are still being indexed; try renaming again in a moment");
+        return;
+    }
+
+    RenameOp *op = g_new0(RenameOp, 1);
+    op->old_path = g_strdup(old_path);
+    op->new_path = g_strdup(new_path);
+    op->is_dir = is_dir;
+    op->files = g_ptr_array_new_with_free_func((GDestroyNotify)rename_file_free);
+
+    char *old_dir = g_path_get_dirname(old_path);
+    char *new_dir = g_path_get_dirname(new_path);
+    gboolean moved = strcmp(old_dir, new_dir) != 0;
+    g_free(old_dir);
+    g_free(new_dir);
+
+    GHashTable *candidates = g_hash_table_new(g_str_hash, g_str_equal);
+    LinkGraph *graph = link_graph;
+    if (!is_dir) {
+        // [[wikilinks]] follow the name, unless another note keeps the old one
+        op->old_key = link_name_key(old_path);
+        char *new_key = link_name_key(new_path);
+        gboolean renamed = strcmp(op->old_key, new_key) != 0;
+        for (guint32 id = 0; renamed && graph && id < graph->vertices->len; id++) {
+            LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+            if (!vertex->note || strcmp(vertex->key, old_path) == 0) continue;
+            char *key = link_name_key(vertex->key);
+            if (strcmp(key, op->old_key) == 0) renamed = FALSE;
+            g_free(key);
+        }
+        if (renamed) {
+            op->new_name = g_path_get_basename(new_path);
+            if (g_str_has_suffix(op->new_name, ".md")) op->new_name[strlen(op->new_name) - 3] = '\0';
+        }
+        g_free(new_key);
+
+        GPtrArray *sources = link_graph_backlinks(old_path);
+        for (guint i = 0; i < sources->len; i++) g_hash_table_add(candidates, g_ptr_array_index(sources, i));
+        g_ptr_array_unref(sources);
+        if (moved && graph && g_hash_table_contains(graph->ids, old_path)) {
+            g_hash_table_add(candidates, (gpointer)old_path);
+        }
+    } else {
+        // Names do not change, so only relative links to and from the folder's notes
+        for (guint32 id = 0; graph && id < graph->vertices->len; id++) {
+            LinkVertex *vertex = g_ptr_array_index(graph->vertices, id);
+            if (!vertex->note || !path_has_prefix(vertex->key, old_path)) continue;
+            for (guint i = 0; i < vertex->in->len; i++) {
+                LinkVertex *source = g_ptr_array_index(graph->vertices, g_array_index(vertex->in, guint32, i));
+                g_hash_table_add(candidates, source->key);
+            }
+            if (moved) g_hash_table_add(candidates, vertex->key);
+        }
+    }
+
+    // A rewrite would lose unsaved edits, and saving them would undo it
+    GHashTableIter iter;
+    gpointer path;
+    g_hash_table_iter_init(&iter, candidates);
+    while (g_hash_table_iter_next(&iter, &path, NULL)) {
+        EditorTab *tab = tab_find(path);
+        if (tab && (tab == tab_active ? !is_content_saved : !tab->saved)) {
+            char *name = g_path_get_basename(path);
+            char *message = g_strdup_printf("Save \"%s\" before renaming; it links here "
+                                            "and has unsaved changes", name);
+            show_error_dialog(message);
+            g_free(message);
+            g_free(name);
+            g_hash_table_unref(candidates);
+            rename_op_free(op);
+            return;
+        }
+        RenameFile *file = g_new0(RenameFile, 1);
+        file->op = op;
+        file->path = g_strdup(path);
+        g_ptr_array_add(op->files, file);
+    }
+    g_hash_table_unref(candidates);
+
+    rename_op = op;
+    if (op->files->len == 0) {
+        rename_finish(op);
+        return;
+    }
+
+    if (!rename_pool) {
+        rename_results = g_async_queue_new();
+        rename_pool = g_thread_pool_new(rename_file_run, NULL,
+                                        CLAMP(g_get_num_processors(), 1, 8), FALSE, NULL);
+    }
+    op->started = trace_now();
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(rename_progress), 0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(rename_progress), "Updating links…");
+    gtk_widget_show(rename_progress);
+    for (guint i = 0; i < op->files->len; i++) {
+        g_thread_pool_push(rename_pool, g_ptr_array_index(op->files, i), NULL);
+    }
+}
+
+// Every rewrite is written: rename, then move the rewritten notes into place
+void rename_finish(RenameOp *op) {
+    // A note edited in its tab while the rewrites ran would have its next
+    // save write the rewrite over, so nothing is renamed
+    for (guint i = 0; !op->error && i < op->files->len; i++) {
+        RenameFile *file = g_ptr_array_index(op->files, i);
+        EditorTab *tab = file->temp_path ? tab_find(file->path) : NULL;
+        if (tab && (tab == tab_active ? !is_content_saved : !tab->saved)) {
+            char *name = g_path_get_basename(file->path);
+            op->error = g_strdup_printf("\"%s\" was edited while its links were being updated; "
+                                        "save it and rename again", name);
+            g_free(name);
+        }
+    }
+
+    gboolean ok = !op->error;
+    if (ok && g_rename(op->old_path, op->new_path) != 0) {
+        op->error = g_strdup(g_strerror(errno));
+        ok = FALSE;
+    }
+
+    guint failed = 0;
+    GPtrArray *rewritten = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < op->files->len; i++) {
+        RenameFile *file = g_ptr_array_index(op->files, i);
+        if (!file->temp_path) continue;
+        // A rewritten note inside a renamed folder moved with it, beside its temporary file
+        char *temp_path = rename_map(op, file->temp_path);
+        char *target = rename_map(op, file->path);
+        if (!ok) {
+            g_unlink(file->temp_path);
+        } else if (g_rename(temp_path ? temp_path : file->temp_path, target ? target : file->path) == 0) {
+            g_ptr_array_add(rewritten, target ? g_strdup(target) : g_strdup(file->path));
+        } else {
+            g_unlink(temp_path ? temp_path : file->temp_path);
+            failed++;
+        }
+        g_free(temp_path);
+        g_free(target);
+    }
+
+    if (ok) {
+        watch_queue_rename(op->old_path, op->new_path);
+        watch_queue_path(op->old_path);
+        watch_queue_path(op->new_path);
+        watch_flush_now();
+
+        for (guint i = 0; i < rewritten->len; i++) {
+            const char *path = g_ptr_array_index(rewritten, i);
+            search_index_queue(path, NULL);
+            link_graph_queue(path, NULL);
+            // Other tabs are read again when shown; the open note is read now
+            if (tab_active && strcmp(tab_active->path, path) == 0 && is_content_saved) {
+                EditorTab *tab = tab_active;
+                tab_stash(tab);
+                tab_active = NULL;
+                tab_make_cold(tab);
+                tab_activate(tab);
+            }
+        }
+        if (op->started) trace_span("rename", "rewrite_links", op->started);
+    }
+    gtk_widget_hide(rename_progress);
+
+    if (!ok) {
+        char *message = g_strdup_printf("Failed to rename file: %s", op->error);
+        show_error_dialog(message);
+        g_free(message);
+    } else if (failed > 0) {
+        char *message = g_strdup_printf("Renamed, but the links in %u notes could not be updated", failed);
+        show_error_dialog(message);
+        g_free(message);
+    }
+    g_ptr_array_unref(rewritten);
+    rename_op = NULL;
+    rename_op_free(op);
+}
+
+// Large-file mode
+//
+// Notes of large_file_threshold_mb or more skip the editor. Their mapping is
+// kept, a worker builds a sparse line index over it, and the page fetches
+// windows of lines from envelope://app/lines/<seq>/<first>/<count> as it
+// scrolls. Pages of the mapping are given back once read, so memory follows
+// the viewport rather than the size of the note. One window at a time can be
+// edited; saving streams the rest of the note from the mapping around it.
+
+void large_file_open(const char *path, GBytes *bytes, gboolean keep_position) {
+    large_file_close();
+    g_clear_pointer(&editor_document, g_bytes_unref);
+
+    LargeFile *file = g_new0(LargeFile, 1);
+    file->path = g_strdup(path);
+    file->seq = ++editor_document_seq;
+    file->bytes = g_bytes_ref(bytes);
+    large_file = file;
+
+    gsize size;
+    const char *data = g_bytes_get_data(bytes, &size);
+    if (size > 0) madvise((void*)data, size, MADV_RANDOM);
+
+    // Until the index is done the line count is guessed from the start
+    gsize sample = MIN(size, LARGE_FILE_ESTIMATE_BYTES);
+    guint64 sample_lines = 0;
+    for (const char *p = data; p && (p = memchr(p, '\n', data + sample - p)); p++) {
+        sample_lines++;
+    }
+    file->line_count = sample_lines > 0 ? size * sample_lines / sample : 1;
+    large_file_release(data, sample);
+
+    file->checkpoints = g_array_new(FALSE, FALSE, sizeof(guint64));
+    LargeFileIndex *index = g_new0(LargeFileIndex, 1);
+    index->bytes = g_bytes_ref(bytes);
+    index->checkpoints = g_array_ref(file->checkpoints);
+    file->index_cancellable = g_cancellable_new();
+    GTask *task = g_task_new(NULL, file->index_cancellable, large_file_index_done,
+                             GUINT_TO_POINTER(file->seq));
+    g_task_set_task_data(task, index, (GDestroyNotify)large_file_index_free);
+    g_task_run_in_thread(task, large_file_index_thread);
+    g_object_unref(task);
+
+    // Until the editor reports in, handle_editor_initialized() opens it
+    if (!editor_ready) return;
+
+    char script[96];
+    g_snprintf(script, sizeof(script), "openLargeFile(%u, %" G_GUINT64_FORMAT ", false, %s);",
+               file->seq, file->line_count, keep_position ? "true" : "false");
+    editor_run_script(script, NULL, NULL);
+}
+
+// Leave large-file mode. An edited window is saved on the way out, as a
+// large note has no editor instance to keep it in.
+void large_file_close() {
+    if (!large_file) return;
+    if (large_file->editing) large_file_save(large_file, edit_seq);
+    if (large_file->index_cancellable) g_cancellable_cancel(large_file->index_cancellable);
+    large_file_finish_waiting(large_file);
+    g_clear_pointer(&large_file_closed, large_file_free);
+    large_file_closed = g_steal_pointer(&large_file);
+    editor_run_script("closeLargeFile();", NULL, NULL);
+}
+
+void large_file_free(LargeFile *file) {
+    if (file->index_cancellable) {
+        g_cancellable_cancel(file->index_cancellable);
+        g_object_unref(file->index_cancellable);
+    }
+    if (file->checkpoints) g_array_unref(file->checkpoints);
+    g_bytes_unref(file->bytes);
+    g_free(file->edit_text);
+    g_free(file->path);
+    g_free(file);
+}
+
+// Map the note again once its edited window is saved, keeping the view
+// where it was
+void large_file_reopen() {
+    GError *error = NULL;
+    GMappedFile *mapped = g_mapped_file_new(large_file->path, FALSE, &error);
+    large_file->reopen = FALSE;
+    if (!mapped) {
+        g_warning("Failed to map %s: %s", large_file->path, error->message);
+        g_error_free(error);
+        return;
+    }
+    GBytes *bytes = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    // Spliced saves check the note against what was mapped last
+    GStatBuf st;
+    if (g_stat(large_file->path, &st) == 0) {
+        NoteFileState state = { 0 };
+        state.size = st.st_size;
+        state.mtime = stat_mtime_ns(&st);
+        note_file_state_record(large_file->path, &state);
+    }
+
+    char *path = g_strdup(large_file->path);
+    large_file->editing = FALSE;
+    large_file_open(path, bytes, TRUE);
+    g_bytes_unref(bytes);
+    g_free(path);
+}
+
+// Give back the whole pages of a mapped range once read. They come back from
+// the page cache if touched again.
+void large_file_release(const char *data, gsize length) {
+    guintptr page = sysconf(_SC_PAGESIZE);
+    guintptr start = ((guintptr)data + page - 1) & ~(page - 1);
+    guintptr end = ((guintptr)data + length) & ~(page - 1);
+    if (end > start) madvise((void*)start, end - start, MADV_DONTNEED);
+}
+
+// Byte offset where line starts, or the size for lines past the end. FALSE
+// while the scan has not reached the line's checkpoint yet; only the lines
+// after the nearest checkpoint are read here.
+gboolean large_file_line_offset(LargeFile *file, guint64 line, guint64 *offset) {
+    guint64 checkpoint = line / LARGE_FILE_INDEX_STRIDE;
+    g_mutex_lock(&large_file_index_lock);
+    guint len = file->checkpoints->len;
+    gboolean ready = checkpoint < len || (file->indexed && len > 0);
+    if (ready) {
+        checkpoint = MIN(checkpoint, len - 1);
+        *offset = g_array_index(file->checkpoints, guint64, checkpoint);
+    }
+    g_mutex_unlock(&large_file_index_lock);
+    // An empty note has no line starts at all
+    if (!ready && file->indexed) {
+        *offset = 0;
+        return TRUE;
+    }
+    if (!ready) return FALSE;
+
+    *offset = large_file_skip_lines(file, *offset, line - checkpoint * LARGE_FILE_INDEX_STRIDE);
+    return TRUE;
+}
+
+// Offset of the line start the given number of lines after offset
+gsize large_file_skip_lines(LargeFile *file, gsize offset, guint64 lines) {
+    gsize size;
+    const char *data = g_bytes_get_data(file->bytes, &size);
+    gsize scanned = offset;
+    for (guint64 i = 0; i < lines && offset < size; i++) {
+        const char *newline = memchr(data + offset, '\n', size - offset);
+        offset = newline ? (gsize)(newline - data) + 1 : size;
+    }
+    large_file_release(data + scanned, offset - scanned);
+    return offset;
+}
+
+// {"first":N,"lines":[...],"truncated":bool} for count lines from first.
+// Lines are shown with LF endings, and cut at LARGE_FILE_LINE_MAX_BYTES.
+// NULL until the scan has reached first.
+GBytes* large_file_window_json(LargeFile *file, guint64 first, guint count) {
+    gsize size;
+    const char *data = g_bytes_get_data(file->bytes, &size);
+    guint64 start;
+    if (!large_file_line_offset(file, first, &start)) return NULL;
+    gsize offset = start;
+    gboolean truncated = FALSE;
+
+    GString *json = g_string_new(NULL);
+    g_string_append_printf(json, "{\"first\":%" G_GUINT64_FORMAT ",\"lines\":[", first);
+    for (guint i = 0; i < count && offset < size; i++) {
+        const char *newline = memchr(data + offset, '\n', size - offset);
+        gsize end = newline ? (gsize)(newline - data) : size;
+        gsize length = end - offset;
+        if (length > 0 && data[end - 1] == '\r') length--;
+        if (length > LARGE_FILE_LINE_MAX_BYTES) {
+            length = LARGE_FILE_LINE_MAX_BYTES;
+            truncated = TRUE;
+        }
+        char *line = g_utf8_make_valid(data + offset, length);
+        if (i > 0) g_string_append_c(json, ',');
+        json_append_escaped(json, line);
+        g_free(line);
+        offset = newline ? end + 1 : size;
+    }
+    g_string_append_printf(json, "],\"truncated\":%s}", truncated ? "true" : "false");
+    large_file_release(data + start, offset - start);
+
+    gsize length = json->len;
+    return g_bytes_new_take(g_string_free(json, FALSE), length);
+}
+
+// Answer a window fetch, or hold it until the scan gets that far rather than
+// reading the note up to it here
+void large_file_serve_window(LargeFile *file, WebKitURISchemeRequest *request,
+                             guint64 first, guint count) {
+    GBytes *json = large_file_window_json(file, first, count);
+    if (!json) {
+        LargeFileWindow *window = g_new0(LargeFileWindow, 1);
+        window->request = g_object_ref(request);
+        window->first = first;
+        window->count = count;
+        if (!file->waiting) file->waiting = g_ptr_array_new();
+        g_ptr_array_add(file->waiting, window);
+        return;
+    }
+    GInputStream *stream = g_memory_input_stream_new_from_bytes(json);
+    webkit_uri_scheme_request_finish(request, stream, g_bytes_get_size(json), "application/json");
+    g_object_unref(stream);
+    g_bytes_unref(json);
+}
+
+// Serve held fetches once the note is indexed, or fail them if it was left
+void large_file_finish_waiting(LargeFile *file) {
+    if (!file->waiting) return;
+    GPtrArray *waiting = g_steal_pointer(&file->waiting);
+    for (guint i = 0; i < waiting->len; i++) {
+        LargeFileWindow *window = g_ptr_array_index(waiting, i);
+        if (file->indexed) {
+            large_file_serve_window(file, window->request, window->first, window->count);
+        } else {
+            GError *error = g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Note was closed");
+            webkit_uri_scheme_request_finish_error(window->request, error);
+            g_error_free(error);
+        }
+        g_object_unref(window->request);
+        g_free(window);
+    }
+    g_ptr_array_unref(waiting);
+}
+
+// Queue a write of the edited window around the rest of the note as mapped
+void large_file_save(LargeFile *file, guint seq) {
+    if (!file->edit_pending) return;
+    file->edit_pending = FALSE;
+
+    NoteSave *save = g_new0(NoteSave, 1);
+    save->path = g_strdup(file->path);
+    save->edit_seq = seq;
+    save->content = g_strdup(file->edit_text);
+    save->length = strlen(save->content);
+    save->base = g_bytes_ref(file->bytes);
+    save->base_start = file->edit_start;
+    save->base_end = file->edit_end;
+    save->trace_start = trace_now();
+    note_save_queue(save);
+}
+
+// Every LARGE_FILE_INDEX_STRIDE-th line start, read from the mapping a block
+// at a time with each block given back after it is scanned. Each block's
+// checkpoints are published as it is done, so windows near the top are
+// served while the rest of the note is still being read.
+void large_file_index_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    LargeFileIndex *index = task_data;
+    gint64 started = trace_now();
+    gsize size;
+    const char *data = g_bytes_get_data(index->bytes, &size);
+    GArray *checkpoints = g_array_new(FALSE, FALSE, sizeof(guint64));
+    guint64 lines = 0;
+    gsize offset = 0;
+
+    for (gsize block = 0; block < size; block += LARGE_FILE_IO_BYTES) {
+        if (g_task_return_error_if_cancelled(task)) {
+            g_array_unref(checkpoints);
+            return;
+        }
+        if (checkpoints->len > 0) {
+            g_mutex_lock(&large_file_index_lock);
+            g_array_append_vals(index->checkpoints, checkpoints->data, checkpoints->len);
+            g_mutex_unlock(&large_file_index_lock);
+            g_array_set_size(checkpoints, 0);
+        }
+        gsize block_end = MIN(size, block + LARGE_FILE_IO_BYTES);
+        while (offset < block_end) {
+            if (lines % LARGE_FILE_INDEX_STRIDE == 0) {
+                guint64 start = offset;
+                g_array_append_val(checkpoints, start);
+            }
+            lines++;
+            const char *newline = memchr(data + offset, '\n', block_end - offset);
+            // A line running past the block continues in the next one
+            while (!newline && block_end < size) {
+                large_file_release(data + block, block_end - block);
+                block = block_end;
+                block_end = MIN(size, block + LARGE_FILE_IO_BYTES);
+                newline = memchr(data + block, '\n', block_end - block);
+            }
+            offset = newline ? (gsize)(newline - data) + 1 : size;
+        }
+        large_file_release(data + block, block_end - block);
+    }
+
+    g_mutex_lock(&large_file_index_lock);
+    g_array_append_vals(index->checkpoints, checkpoints->data, checkpoints->len);
+    g_mutex_unlock(&large_file_index_lock);
+    g_array_unref(checkpoints);
+    index->line_count = lines;
+    trace_span("note", "large_file_index", started);
+    g_task_return_boolean(task, TRUE);
+}
+
+void large_file_index_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    GTask *task = G_TASK(result);
+    LargeFileIndex *index = g_task_get_task_data(task);
+    GError *error = NULL;
+
+    if (!g_task_propagate_boolean(task, &error)) {
+        g_error_free(error);
+        return;
+    }
+    // The note may have been left or mapped again since
+    if (!large_file || large_file->seq != GPOINTER_TO_UINT(user_data)) return;
+
+    large_file->indexed = TRUE;
+    large_file->line_count = index->line_count;
+    g_clear_object(&large_file->index_cancellable);
+    large_file_finish_waiting(large_file);
+
+    char script[96];
+    g_snprintf(script, sizeof(script), "largeFileIndexed(%u, %" G_GUINT64_FORMAT ");",
+               large_file->seq, large_file->line_count);
+    editor_run_script(script, NULL, NULL);
+}
+
+void large_file_index_free(LargeFileIndex *index) {
+    if (index->checkpoints) g_array_unref(index->checkpoints);
+    g_bytes_unref(index->bytes);
+    g_free(index);
+}
+
+// Copy start..end of the mapping to fd at *offset, giving each block back
+// once written
+gboolean large_file_stream_range(int fd, const char *base, gsize start, gsize end, guint64 *offset) {
+    while (start < end) {
+        gsize length = MIN(end - start, LARGE_FILE_IO_BYTES);
+        if (!history_write_all(fd, base + start, length, *offset)) return FALSE;
+        large_file_release(base + start, length);
+        start += length;
+        *offset += length;
+    }
+    return TRUE;
+}
+
+// The note as mapped, with base_start..base_end replaced by the content. It
+// is written to a temporary file beside the note and renamed over it, synced
+// first as save_durability asks; the note always exists here, so
+// ONLY_EXISTING never lifts the sync.
+gboolean note_save_write_splice(NoteSave *save, GError **error) {
+    gsize size;
+    const char *base = g_bytes_get_data(save->base, &size);
+    char *dir = g_path_get_dirname(save->path);
+    char *temp_path = g_build_filename(dir, ".envelope-save-XXXXXX", NULL);
+    g_free(dir);
+
+    gboolean sync = (save->flags & (G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_DURABLE)) != 0;
+    GStatBuf st;
+    guint64 offset = 0;
+    int fd = g_mkstemp(temp_path);
+    gboolean ok = fd >= 0 &&
+                  (g_stat(save->path, &st) != 0 || fchmod(fd, st.st_mode & 0777) == 0) &&
+                  large_file_stream_range(fd, base, 0, save->base_start, &offset) &&
+                  history_write_all(fd, save->content, save->length, offset);
+    offset += save->length;
+    ok = ok && large_file_stream_range(fd, base, save->base_end, size, &offset) &&
+         (!sync || fsync(fd) == 0);
+    int saved_errno = errno;
+    if (fd >= 0 && close(fd) != 0 && ok) {
+        ok = FALSE;
+        saved_errno = errno;
+    }
+    if (ok && g_rename(temp_path, save->path) != 0) {
+        ok = FALSE;
+        saved_errno = errno;
+    }
+    if (!ok) {
+        if (fd >= 0) g_unlink(temp_path);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "%s: %s", save->path, g_strerror(saved_errno));
+    }
+    g_free(temp_path);
+    return ok;
+}
+
+void handle_large_file_edit(WebKitUserContentManager *manager,
+                            WebKitJavascriptResult *js_result,
+                            gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    JSCValue *seq = jsc_value_object_get_property(val, "seq");
+    JSCValue *first = jsc_value_object_get_property(val, "first");
+    JSCValue *count = jsc_value_object_get_property(val, "count");
+    JSCValue *text = jsc_value_object_get_property(val, "text");
+    guint number = (guint)jsc_value_to_double(seq);
+
+    // Edits made just before the note was left arrive after it was closed
+    LargeFile *file = large_file && large_file->seq == number ? large_file :
+                      large_file_closed && large_file_closed->seq == number ? large_file_closed : NULL;
+    if (file) {
+        gsize size;
+        const char *data = g_bytes_get_data(file->bytes, &size);
+        // The window's byte range is fixed when editing starts; every save
+        // replaces that same range of the same mapping
+        if (!file->editing) {
+            // The window was served, so the scan has reached its first line
+            guint64 start = 0;
+            large_file_line_offset(file, (guint64)jsc_value_to_double(first), &start);
+            file->edit_start = start;
+            file->edit_end = large_file_skip_lines(file, start, (guint64)jsc_value_to_double(count));
+            file->editing = TRUE;
+        }
+        char *content = jsc_value_to_string(text);
+        g_free(file->edit_text);
+        // The page sends lines without the newline that ended the window
+        gboolean newline = file->edit_end > file->edit_start && data[file->edit_end - 1] == '\n';
+        file->edit_text = newline ? g_strconcat(content, "\n", NULL) : g_strdup(content);
+        file->edit_pending = TRUE;
+        g_free(content);
+
+        if (file == large_file) {
+            mark_content_unsaved();
+        } else {
+            EditorTab *tab = tab_find(file->path);
+            if (tab) {
+                tab->edit_seq++;
+                tab->saved = FALSE;
+                tab_update_label(tab);
+            }
+            large_file_save(file, tab ? tab->edit_seq : 0);
+        }
+    }
+
+    g_object_unref(seq);
+    g_object_unref(first);
+    g_object_unref(count);
+    g_object_unref(text);
+}
+
+// The edited window stays in the page and is saved again on the next edit or
+// Done. A note changed on disk can be read again instead, dropping the edit.
+void large_file_save_failed(NoteSave *save, GError *error) {
+    LargeFile *file = large_file && strcmp(large_file->path, save->path) == 0 ? large_file : NULL;
+    if (!file) {
+        char *message = g_strdup_printf("Failed to save file: %s", error->message);
+        show_error_dialog(message);
+        g_free(message);
+        return;
+    }
+    file->reopen = FALSE;
+    file->edit_pending = TRUE;
+
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG)) {
+        char *message = g_strdup_printf("Failed to save file: %s", error->message);
+        show_error_dialog(message);
+        g_free(message);
+    } else {
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(window), GTK_DIALOG_MODAL,
+                                                   GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO,
+                                                   "%s\n\nReload it and discard the edited lines?",
+                                                   error->message);
+        gboolean reload = gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_YES;
+        gtk_widget_destroy(dialog);
+        // The dialog ran the main loop; the note may have been left meanwhile
+        if (reload && file == large_file) {
+            file->edit_pending = FALSE;
+            is_content_saved = TRUE;
+            update_save_indicator();
+            update_window_title();
+            large_file_reopen();
+            return;
+        }
+    }
+    if (file != large_file) return;
+
+    char script[64];
+    g_snprintf(script, sizeof(script), "largeFileSaveFailed(%u);", file->seq);
+    editor_run_script(script, NULL, NULL);
+}
+
+// The page left editing; it shows the note again once it is saved and mapped
+void handle_large_file_done(WebKitUserContentManager *manager,
+                            WebKitJavascriptResult *js_result,
+                            gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    if (!large_file || large_file->seq != (guint)jsc_value_to_double(val)) return;
+    if (!large_file->editing || (is_content_saved && !large_file->edit_pending)) {
+        large_file_reopen();
+        return;
+    }
+    large_file->reopen = TRUE;
+    large_file_save(large_file, edit_seq);
+}
+
+// Tracing
+//
+// Started with --trace=FILE, spans are kept in memory and written out at exit
+// in the Chrome trace-event format (chrome://tracing, Perfetto). Without the
+// flag trace_now() returns 0 and every span call returns straight away.
+
+void trace_start(const char *path) {
+    g_free(trace_path);
+    trace_path = g_strdup(path);
+    if (trace_events) return;
+
+    trace_origin = g_get_monotonic_time();
+    trace_events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+    trace_threads = g_hash_table_new(g_direct_hash, g_direct_equal);
+    trace_message_starts = g_array_new(FALSE, FALSE, sizeof(gint64));
+    // The main thread is always thread 1
+    g_hash_table_insert(trace_threads, g_thread_self(), GUINT_TO_POINTER(1));
+}
+
+gint64 trace_now() {
+    return trace_events ? g_get_monotonic_time() : 0;
+}
+
+// Safe to call from worker threads
+void trace_record(const char *category, const char *name, gint64 start, gint64 duration) {
+    g_mutex_lock(&trace_lock);
+    if (trace_events) {
+        gpointer thread = g_thread_self();
+        guint number = GPOINTER_TO_UINT(g_hash_table_lookup(trace_threads, thread));
+        if (!number) {
+            number = g_hash_table_size(trace_threads) + 1;
+            g_hash_table_insert(trace_threads, thread, GUINT_TO_POINTER(number));
+        }
+        TraceEvent event = { category, name, start - trace_origin, duration, number };
+        g_array_append_val(trace_events, event);
+    }
+    g_mutex_unlock(&trace_lock);
+}
+
+// Span from start (a trace_now() value) until now. A start of 0 means the
+// operation began before tracing could see it and is not recorded.
+void trace_span(const char *category, const char *name, gint64 start) {
+    if (!trace_events || start == 0) return;
+    gint64 now = g_get_monotonic_time();
+    trace_record(category, name, start, now - start);
+}
+
+void trace_mark(const char *category, const char *name) {
+    if (!trace_events) return;
+    trace_record(category, name, g_get_monotonic_time(), -1);
+}
+
+void trace_finish() {
+    if (!trace_events) return;
+
+    g_mutex_lock(&trace_lock);
+    GArray *events = trace_events;
+    trace_events = NULL;
+    g_mutex_unlock(&trace_lock);
+
+    GString *json = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    g_string_append(json, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                          "\"args\":{\"name\":\"notes-gui\"}},\n");
+    g_string_append(json, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                          "\"args\":{\"name\":\"main\"}}");
+    for (guint i = 0; i < events->len; i++) {
+        TraceEvent *event = &g_array_index(events, TraceEvent, i);
+        g_string_append(json, ",\n{\"name\":");
+        json_append_escaped(json, event->name);
+        g_string_append(json, ",\"cat\":");
+        json_append_escaped(json, event->category);
+        if (event->duration < 0) {
+            g_string_append_printf(json, ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%" G_GINT64_FORMAT,
+                                   event->start);
+        } else {
+            g_string_append_printf(json, ",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT
+                                   ",\"dur\":%" G_GINT64_FORMAT,
+                                   event->start, event->duration);
+        }
+        g_string_append_printf(json, ",\"pid\":1,\"tid\":%u}", event->thread);
+    }
+    g_string_append(json, "\n]}\n");
+
+    GError *error = NULL;
+    if (!g_file_set_contents(trace_path, json->str, json->len, &error)) {
+        g_warning("Failed to write trace: %s", error->message);
+        g_error_free(error);
+    }
+
+    g_string_free(json, TRUE);
+    g_array_unref(events);
+    g_array_unref(trace_message_starts);
+    trace_message_starts = NULL;
+    g_clear_pointer(&trace_threads, g_hash_table_unref);
+    g_clear_pointer(&trace_path, g_free);
+}
+
+// Span name for a script: the function it calls, e.g. "loadDocument"
+const char* trace_script_name(const char *script) {
+    gsize length = strcspn(script, "(;");
+    char *name = g_strndup(script, MIN(length, 64));
+    const char *interned = g_intern_string(name);
+    g_free(name);
+    return interned;
+}
+
+// Every call into the editor page goes through here, so --trace can time the
+// round trip of each one
+void editor_run_script(const char *script, GAsyncReadyCallback callback, gpointer user_data) {
+    if (!trace_events) {
+        webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
+            script, -1, NULL, NULL, NULL, callback, user_data);
+        return;
+    }
+
+    TraceScript *call = g_new0(TraceScript, 1);
+    call->name = trace_script_name(script);
+    call->start = g_get_monotonic_time();
+    call->callback = callback;
+    call->user_data = user_data;
+    webkit_web_view_evaluate_javascript(WEBKIT_WEB_VIEW(web_view),
+        script, -1, NULL, NULL, NULL, editor_run_script_done, call);
+}
+
+void editor_run_script_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    TraceScript *call = user_data;
+    trace_span("js", call->name, call->start);
+
+    if (call->callback) {
+        call->callback(source_object, result, call->user_data);
+    } else {
+        JSCValue *value = webkit_web_view_evaluate_javascript_finish(WEBKIT_WEB_VIEW(source_object),
+                                                                     result, NULL);
+        if (value) g_object_unref(value);
+    }
+    g_free(call);
+}
+
+// Handlers can run nested main loops (dialogs), so start times are a stack
+void trace_message_begin(WebKitUserContentManager *manager,
+                         WebKitJavascriptResult *js_result,
+                         gpointer user_data) {
+    if (!trace_events) return;
+    gint64 now = g_get_monotonic_time();
+    g_array_append_val(trace_message_starts, now);
+}
+
+void trace_message_end(WebKitUserContentManager *manager,
+                       WebKitJavascriptResult *js_result,
+                       gpointer user_data) {
+    if (!trace_events || trace_message_starts->len == 0) return;
+    gint64 start = g_array_index(trace_message_starts, gint64, trace_message_starts->len - 1);
+    g_array_set_size(trace_message_starts, trace_message_starts->len - 1);
+
+    // The detail is the handler name the page posted to
+    GSignalInvocationHint *hint = g_signal_get_invocation_hint(manager);
+    const char *name = hint && hint->detail ? g_quark_to_string(hint->detail) : "script-message";
+    trace_span("message", name, start);
+}
+
+// Session
+//
+// The open tabs, each tab's cursor and scroll positions, the preview's scroll
+// position and the file tree's expanded folders and scroll position are kept
+// in a small binary snapshot, written a moment after they change and when the
+// window closes. The page reports the editor positions, so they are known
+// here even after the web view is gone. At startup the snapshot replaces
+// last_file: the tabs come back cold except the active one, which is loaded
+// with its view applied in the same step as its text.
+
+guint32 session_add_string(GString *strings, const char *text) {
+    guint32 offset = strings->len;
+    g_string_append_len(strings, text, strlen(text) + 1);
+    return offset;
+}
+
+void session_collect_expanded(GtkTreeView *view, GtkTreePath *tree_path, gpointer data) {
+    GtkTreeIter iter;
+    if (!gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter, tree_path)) return;
+    char *path;
+    gtk_tree_model_get(GTK_TREE_MODEL(tree_store), &iter, 1, &path, -1);
+    if (path) g_hash_table_add(data, path);
+}
+
+// Snapshot layout: SessionHeader, SessionTab records in tab order, guint32
+// string offsets of the expanded folders, then NUL-terminated strings
+gboolean session_write() {
+    // Nothing to record until the saved session has been put back
+    if (!session_file_path || session_restore) return FALSE;
+
+    GString *strings = g_string_new(NULL);
+    SessionHeader header = { 0 };
+    memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.version = SESSION_VERSION;
+    header.active = G_MAXUINT32;
+    header.vault = session_add_string(strings, vault_directory ? vault_directory : "");
+    header.tree_anchor = G_MAXUINT32;
+
+    GArray *tabs = g_array_new(FALSE, TRUE, sizeof(SessionTab));
+    gint pages = tab_notebook ? gtk_notebook_get_n_pages(GTK_NOTEBOOK(tab_notebook)) : 0;
+    for (gint n = 0; n < pages; n++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(tab_notebook), n);
+        for (guint i = 0; i < editor_tabs->len; i++) {
+            EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+            if (tab->page != page) continue;
+            SessionTab record = { 0 };
+            record.path = session_add_string(strings, tab->path);
+            record.view = tab->view;
+            if (tab == tab_active) header.active = tabs->len;
+            g_array_append_val(tabs, record);
+        }
+    }
+
+    // Folders still waiting for their rows keep their state too
+    GHashTable *expanded = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (tree_view && gtk_widget_get_realized(GTK_WIDGET(tree_view))) {
+        gtk_tree_view_map_expanded_rows(tree_view, session_collect_expanded, expanded);
+        GtkTreePath *start;
+        if (gtk_tree_view_get_visible_range(tree_view, &start, NULL)) {
+            GtkTreeIter iter;
+            char *anchor = NULL;
+            if (gtk_tree_model_get_iter(GTK_TREE_MODEL(tree_store), &iter, start)) {
+                gtk_tree_model_get(GTK_TREE_MODEL(tree_store), &iter, 1, &anchor, -1);
+            }
+            if (anchor) header.tree_anchor = session_add_string(strings, anchor);
+            g_free(anchor);
+            gtk_tree_path_free(start);
+        }
+    }
+    if (session_expand_pending) {
+        GHashTableIter iter;
+        gpointer path;
+        g_hash_table_iter_init(&iter, session_expand_pending);
+        while (g_hash_table_iter_next(&iter, &path, NULL)) {
+            g_hash_table_add(expanded, g_strdup(path));
+        }
+    }
+    if (header.tree_anchor == G_MAXUINT32 && session_tree_anchor) {
+        header.tree_anchor = session_add_string(strings, session_tree_anchor);
+    }
+
+    GArray *folders = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GHashTableIter iter;
+    gpointer path;
+    g_hash_table_iter_init(&iter, expanded);
+    while (g_hash_table_iter_next(&iter, &path, NULL)) {
+        guint32 offset = session_add_string(strings, path);
+        g_array_append_val(folders, offset);
+    }
+    g_hash_table_unref(expanded);
+
+    header.tab_count = tabs->len;
+    header.expanded_count = folders->len;
+    header.strings_size = strings->len;
+
+    GByteArray *data = g_byte_array_new();
+    g_byte_array_append(data, (const guint8 *)&header, sizeof(header));
+    g_byte_array_append(data, (const guint8 *)tabs->data, tabs->len * sizeof(SessionTab));
+    g_byte_array_append(data, (const guint8 *)folders->data, folders->len * sizeof(guint32));
+    g_byte_array_append(data, (const guint8 *)strings->str, strings->len);
+
+    GError *error = NULL;
+    gboolean ok = g_file_set_contents(session_file_path, (const char *)data->data, data->len, &error);
+    if (!ok) {
+        g_warning("Failed to save session: %s", error->message);
+        g_error_free(error);
+    }
+    g_byte_array_unref(data);
+    g_array_unref(folders);
+    g_array_unref(tabs);
+    g_string_free(strings, TRUE);
+    return ok;
+}
+
+// Read the snapshot of the last session in this vault into session_restore,
+// session_expand_pending and session_tree_anchor
+gboolean session_read() {
+    if (!session_file_path || !vault_directory) return FALSE;
+
+    char *data;
+    gsize length;
+    if (!g_file_get_contents(session_file_path, &data, &length, NULL)) return FALSE;
+
+    SessionHeader header = { 0 };
+    gboolean valid = length >= sizeof(header);
+    guint64 strings_start = 0;
+    if (valid) {
+        memcpy(&header, data, sizeof(header));
+        strings_start = sizeof(header) + (guint64)header.tab_count * sizeof(SessionTab) +
+                        (guint64)header.expanded_count * sizeof(guint32);
+        valid = memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == SESSION_VERSION && header.strings_size > 0 &&
+                strings_start + header.strings_size == length && data[length - 1] == '\0' &&
+                header.vault < header.strings_size &&
+                (header.tree_anchor == G_MAXUINT32 || header.tree_anchor < header.strings_size);
+    }
+    const char *strings = data + strings_start;
+    valid = valid && strcmp(strings + header.vault, vault_directory) == 0;
+
+    const SessionTab *records = (const SessionTab *)(data + sizeof(header));
+    const guint32 *folders = (const guint32 *)(data + sizeof(header) + header.tab_count * sizeof(SessionTab));
+    for (guint32 i = 0; valid && i < header.tab_count; i++) {
+        valid = records[i].path < header.strings_size;
+    }
+    for (guint32 i = 0; valid && i < header.expanded_count; i++) {
+        valid = folders[i] < header.strings_size;
+    }
+    if (!valid) {
+        g_free(data);
+        return FALSE;
+    }
+
+    SessionRestore *restore = g_new0(SessionRestore, 1);
+    restore->paths = g_ptr_array_new_with_free_func(g_free);
+    restore->views = g_array_new(FALSE, FALSE, sizeof(SessionView));
+    restore->active = header.active;
+    for (guint32 i = 0; i < header.tab_count; i++) {
+        SessionView view;
+        memcpy(&view, &records[i].view, sizeof(view));
+        g_ptr_array_add(restore->paths, g_strdup(strings + records[i].path));
+        g_array_append_val(restore->views, view);
+    }
+    session_restore_free(session_restore);
+    session_restore = restore;
+
+    g_clear_pointer(&session_expand_pending, g_hash_table_unref);
+    session_expand_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (guint32 i = 0; i < header.expanded_count; i++) {
+        g_hash_table_add(session_expand_pending, g_strdup(strings + folders[i]));
+    }
+    g_free(session_tree_anchor);
+    session_tree_anchor = header.tree_anchor == G_MAXUINT32 ? NULL :
+                          g_strdup(strings + header.tree_anchor);
+
+    g_free(data);
+    return TRUE;
+}
+
+void session_restore_free(SessionRestore *restore) {
+    if (!restore) return;
+    g_ptr_array_unref(restore->paths);
+    g_array_unref(restore->views);
+    g_free(restore);
+}
+
+// Reopen the saved tabs. Only the active one is read now; the rest stay cold
+// until shown, each with its view waiting for it.
+void session_restore_tabs() {
+    SessionRestore *restore = session_restore;
+    if (!restore) return;
+    session_restore = NULL;
+
+    EditorTab *active = NULL;
+    for (guint i = 0; i < restore->paths->len; i++) {
+        const char *path = g_ptr_array_index(restore->paths, i);
+        if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) continue;
+        EditorTab *tab = tab_find(path);
+        if (!tab) tab = tab_add(path);
+        tab->view = g_array_index(restore->views, SessionView, i);
+        tab->view_pending = TRUE;
+        if (i == restore->active || !active) active = tab;
+    }
+    session_restore_free(restore);
+
+    if (active) {
+        tab_activate(active);
+    } else if (startup_waiting_for_note) {
+        startup_waiting_for_note = FALSE;
+        startup_check_ready();
+    }
+}
+
+// A folder's saved expansion is applied once its first child is in the tree,
+// since rows without children cannot be expanded
+void session_expand_parent(GtkTreeIter *parent, const char *child_path) {
+    char *dir = g_path_get_dirname(child_path);
+    if (g_hash_table_remove(session_expand_pending, dir)) {
+        GtkTreePath *tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree_store), parent);
+        gtk_tree_view_expand_row(tree_view, tree_path, FALSE);
+        gtk_tree_path_free(tree_path);
+    }
+    g_free(dir);
+}
+
+// The vault scan finished: folders not found are forgotten, and the tree
+// goes back to where it was scrolled
+void session_scan_done() {
+    g_clear_pointer(&session_expand_pending, g_hash_table_unref);
+    if (!session_tree_anchor) return;
+
+    GtkTreeIter iter;
+    if (file_tree_find_path(session_tree_anchor, &iter)) {
+        GtkTreePath *tree_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree_store), &iter);
+        gtk_tree_view_scroll_to_cell(tree_view, tree_path, NULL, TRUE, 0.0, 0.0);
+        gtk_tree_path_free(tree_path);
+    }
+    g_clear_pointer(&session_tree_anchor, g_free);
+}
+
+void session_schedule_save() {
+    if (!session_save_id && session_file_path) {
+        session_save_id = g_timeout_add_seconds(SESSION_SAVE_DELAY_S, session_save_timeout, NULL);
+    }
+}
+
+gboolean session_save_timeout(gpointer user_data) {
+    session_save_id = 0;
+    session_write();
+    return G_SOURCE_REMOVE;
+}
+
+void session_tree_changed(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *tree_path, gpointer data) {
+    session_schedule_save();
+}
+
+void session_tree_scrolled(GtkAdjustment *adjustment, gpointer data) {
+    session_schedule_save();
+}
+
+// Written while the widgets still exist; the tree is gone after the main loop
+gboolean session_window_delete(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    // Returning TRUE keeps the window open
+    if (!tab_check_all_unsaved()) return TRUE;
+    // Snapshots asked of the page must arrive before it is destroyed
+    while (save_snapshots_pending > 0) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    if (session_save_id) {
+        g_source_remove(session_save_id);
+        session_save_id = 0;
+    }
+    session_write();
+    return FALSE;
+}
+
+// The page reports a tab's cursor and scroll positions shortly after they change
+void handle_view_state(WebKitUserContentManager *manager,
+                       WebKitJavascriptResult *js_result,
+                       gpointer user_data) {
+    JSCValue *val = webkit_javascript_result_get_js_value(js_result);
+    const char *names[] = { "id", "anchorLine", "anchorCh", "headLine", "headCh", "scrollTop", "previewTop" };
+    double values[G_N_ELEMENTS(names)];
+    for (guint i = 0; i < G_N_ELEMENTS(names); i++) {
+        JSCValue *property = jsc_value_object_get_property(val, names[i]);
+        values[i] = jsc_value_is_number(property) ? jsc_value_to_double(property) : 0;
+        g_object_unref(property);
+    }
+
+    for (guint i = 0; editor_tabs && i < editor_tabs->len; i++) {
+        EditorTab *tab = g_ptr_array_index(editor_tabs, i);
+        if (tab->id != (guint)values[0]) continue;
+        tab->view.anchor_line = (guint32)MAX(values[1], 0);
+        tab->view.anchor_ch = (guint32)MAX(values[2], 0);
+        tab->view.head_line = (guint32)MAX(values[3], 0);
+        tab->view.head_ch = (guint32)MAX(values[4], 0);
+        tab->view.scroll_top = (gint32)CLAMP(values[5], 0, G_MAXINT32);
+        tab->view.preview_top = (gint32)CLAMP(values[6], 0, G_MAXINT32);
+        session_schedule_save();
+        break;
+    }
+}
+
+// Startup
+//
+// Only what the first frame needs runs before the main loop: the window, the
+// config and the web view. The web process is prewarmed first thing so it
+// boots in parallel. Reading the last note and scanning the vault wait for the
+// first paint.
+
+void startup_milestone(const char *name) {
+    trace_mark("startup", name);
+    if (startup_measure) {
+        g_print("%-24s %8.1f ms\n", name, (g_get_monotonic_time() - startup_origin) / 1000.0);
+    }
+}
+
+gboolean startup_first_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    g_signal_handlers_disconnect_by_func(widget, startup_first_draw, data);
+    startup_painted = TRUE;
+    startup_milestone("first paint");
+    g_idle_add(startup_deferred, NULL);
+    return FALSE;
+}
+
+gboolean startup_deferred(gpointer user_data) {
+    gint64 started = trace_now();
+    // The note comes first, it is what the user is waiting for
+    if (session_restore) {
+        session_restore_tabs();
+    } else if (startup_last_file) {
+        tab_open(startup_last_file);
+        g_clear_pointer(&startup_last_file, g_free);
+    }
+    if (vault_directory) {
+        refresh_file_tree();
+    }
+    trace_span("startup", "startup_deferred", started);
+    return G_SOURCE_REMOVE;
+}
+
+// The editor is ready once it is initialized and showing the last note, if any
+void startup_check_ready() {
+    if (startup_done || !editor_ready || startup_waiting_for_note) return;
+    startup_done = TRUE;
+    startup_milestone("editor ready");
+    if (startup_measure) {
+        g_idle_add(startup_measure_quit, NULL);
+    }
+}
+
+gboolean startup_measure_quit(gpointer user_data) {
+    gtk_main_quit();
+    return G_SOURCE_REMOVE;
+}
+
+// Add function to get the resource file paths
+char* get_resource_path(const char* filename) {
+    char *exe_path = realpath("/proc/self/exe", NULL);
+    if (!exe_path) return NULL;
+    
+    char *exe_dir = g_path_get_dirname(exe_path);
+    free(exe_path);
+    
+    char *resources_dir = g_build_filename(exe_dir, "resources", NULL);
+    char *file_path = g_build_filename(resources_dir, filename, NULL);
+    
+    g_free(resources_dir);
+    g_free(exe_dir);
+    
+    return file_path;
+}
+
+
+char* get_asset_path(const char* filename) {
+    // Resolved once; the executable does not move while running
+    static char *assets_dir = NULL;
+    static gboolean resolved = FALSE;
+    if (!resolved) {
+        resolved = TRUE;
+        char *exe_path = realpath("/proc/self/exe", NULL);
+        if (!exe_path) {
+            g_warning("Failed to get executable path");
+            return NULL;
+        }
+        char *exe_dir = g_path_get_dirname(exe_path);
+        free(exe_path);
+        assets_dir = g_build_filename(exe_dir, "assets", NULL);
+        g_free(exe_dir);
+
+        if (!g_file_test(assets_dir, G_FILE_TEST_EXISTS)) {
+            g_warning("Assets directory does not exist: %s", assets_dir);
+            g_clear_pointer(&assets_dir, g_free);
+        }
+    }
+    if (!assets_dir) return NULL;
+    
+    return g_build_filename(assets_dir, filename, NULL);
+}
+
+// Assets come from the GResource bundle linked into the binary (see
+// assets/envelope.gresource.xml) and fall back to the assets directory next
+// to the executable. Either way each one is read once.
+GBytes* asset_lookup(const char *name) {
+    if (!asset_cache) {
+        asset_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify)g_bytes_unref);
+    }
+
+    GBytes *bytes;
+    if (g_hash_table_lookup_extended(asset_cache, name, NULL, (gpointer *)&bytes)) {
+        return bytes ? g_bytes_ref(bytes) : NULL;
+    }
+
+    char *resource_path = g_strconcat("/org/envelope/assets/", name, NULL);
+    bytes = g_resources_lookup_data(resource_path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+    g_free(resource_path);
+
+    if (!bytes) {
+        char *path = get_asset_path(name);
+        char *contents = NULL;
+        gsize length = 0;
+        if (path && g_file_get_contents(path, &contents, &length, NULL)) {
+            bytes = g_bytes_new_take(contents, length);
+        }
+        g_free(path);
+    }
+
+    // Misses are cached too, so an absent vendor file is only probed once
+    g_hash_table_insert(asset_cache, g_strdup(name), bytes);
+    return bytes ? g_bytes_ref(bytes) : NULL;
+}
+
+gboolean asset_available(const char *name) {
+    GBytes *bytes = asset_lookup(name);
+    if (!bytes) return FALSE;
+    g_bytes_unref(bytes);
+    return TRUE;
+}
+
+const char* asset_content_type(const char *name) {
+    if (g_str_has_suffix(name, ".js")) return "application/javascript; charset=utf-8";
+    if (g_str_has_suffix(name, ".css")) return "text/css; charset=utf-8";
+    if (g_str_has_suffix(name, ".html")) return "text/html; charset=utf-8";
+    if (g_str_has_suffix(name, ".svg")) return "image/svg+xml";
+    if (g_str_has_suffix(name, ".woff2")) return "font/woff2";
+    return "application/octet-stream";
+}
+
+// Benchmarks
+//
+// --bench[=key=value,...] builds a synthetic vault in a temporary directory
+// and times the core without GTK: the vault scan cold and from the cache,
+// note open and save, the recent notes listing and reading the config.
+// HOME points into the temporary directory, so caches and settings written
+// along the way never touch the user's. One JSON object per line on stdout.
+
+gdouble bench_gaussian(GRand *rand) {
+    // Box-Muller
+    gdouble u = g_rand_double_range(rand, 1e-12, 1.0);
+    gdouble v = g_rand_double(rand);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * G_PI * v);
+}
+
+// Note sizes are log-normal around the mean; spread 0 makes them all equal
+char* bench_note_text(GRand *rand, guint number, const BenchOptions *options) {
+    static const char *words[] = {
+        "envelope", "note", "vault", "markdown", "idea", "draft", "meeting", "todo",
+        "reference", "project", "link", "summary", "review", "plan", "daily", "archive",
+    };
+    gdouble factor = exp(options->spread * bench_gaussian(rand) - options->spread * options->spread / 2);
+    gsize target = CLAMP((gsize)(options->size * factor), 32, 16 * 1024 * 1024);
+
+    GString *text = g_string_sized_new(target + 64);
+    g_string_append_printf(text, "# Note %u\n\n", number);
+    while (text->len < target) {
+        for (int i = 0; i < 12 && text->len < target; i++) {
+            if (i > 0) g_string_append_c(text, ' ');
+            g_string_append(text, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+        }
+        g_string_append(text, g_rand_int_range(rand, 0, 4) == 0 ? "\n\n" : ".\n");
+    }
+    return g_string_free(text, FALSE);
+}
+
+// Folders `depth` levels deep with `fanout` subfolders each; notes are
+// spread evenly over the root and every folder
+GPtrArray* bench_generate_vault(const char *vault, const BenchOptions *options) {
+    GRand *rand = g_rand_new_with_seed(options->seed);
+    GPtrArray *folders = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(folders, g_strdup(vault));
+    g_mkdir_with_parents(vault, 0755);
+
+    guint level_start = 0;
+    for (guint level = 0; level < options->depth; level++) {
+        guint level_end = folders->len;
+        for (guint i = level_start; i < level_end; i++) {
+            for (guint j = 0; j < options->fanout; j++) {
+                char name[32];
+                g_snprintf(name, sizeof(name), "folder-%u", j);
+                char *path = g_build_filename(g_ptr_array_index(folders, i), name, NULL);
+                g_mkdir(path, 0755);
+                g_ptr_array_add(folders, path);
+            }
+        }
+        level_start = level_end;
+    }
+
+    GPtrArray *notes = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < options->notes; i++) {
+        char name[32];
+        g_snprintf(name, sizeof(name), "note-%07u.md", i);
+        char *path = g_build_filename(g_ptr_array_index(folders, i % folders->len), name, NULL);
+        char *text = bench_note_text(rand, i, options);
+        if (!g_file_set_contents(path, text, -1, NULL)) {
+            g_printerr("Failed to write %s\n", path);
+        }
+        g_free(text);
+        g_ptr_array_add(notes, path);
+    }
+
+    g_ptr_array_unref(folders);
+    g_rand_free(rand);
+    return notes;
+}
+
+void bench_remove_tree(const char *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const char *name;
+        while ((name = g_dir_read_name(dir))) {
+            char *child = g_build_filename(path, name, NULL);
+            bench_remove_tree(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+        g_rmdir(path);
+    } else {
+        g_unlink(path);
+    }
+}
+
+gint bench_compare_us(gconstpointer a, gconstpointer b) {
+    gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// One result line. Latencies are microseconds per operation; throughput is
+// items per second over all operations, where one operation may cover many
+// items (a scan covers every row).
+void bench_report(const char *name, GArray *latencies, guint64 items, const char *extra) {
+    g_array_sort(latencies, bench_compare_us);
+    gint64 total = 0;
+    for (guint i = 0; i < latencies->len; i++) total += g_array_index(latencies, gint64, i);
+    guint n = latencies->len;
+    gint64 p50 = n ? g_array_index(latencies, gint64, (n - 1) / 2) : 0;
+    gint64 p99 = n ? g_array_index(latencies, gint64, (guint)((n - 1) * 0.99)) : 0;
+    gint64 max = n ? g_array_index(latencies, gint64, n - 1) : 0;
+
+    char throughput[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_formatd(throughput, sizeof(throughput), "%.1f",
+                    total > 0 ? items * (gdouble)G_USEC_PER_SEC / total : 0.0);
+    g_print("{\"benchmark\":\"%s\",\"ops\":%u,\"items\":%" G_GUINT64_FORMAT ","
+            "\"p50_us\":%" G_GINT64_FORMAT ",\"p99_us\":%" G_GINT64_FORMAT ","
+            "\"max_us\":%" G_GINT64_FORMAT ",\"throughput_per_s\":%s%s}\n",
+            name, n, items, p50, p99, max, throughput, extra ? extra : "");
+}
+
+// Full scan of the vault, consuming the scanner's batches here instead of
+// in the tree. Returns the number of rows found on disk.
+guint bench_scan(const char *vault, gint64 *first_rows_us) {
+    scan_generation++;
+    if (!scan_queue) {
+        scan_queue = g_async_queue_new_full((GDestroyNotify)scan_batch_free);
+    }
+    g_clear_object(&scan_cancellable);
+    scan_cancellable = g_cancellable_new();
+
+    gint64 started = g_get_monotonic_time();
+    *first_rows_us = -1;
+    scan_start(vault, FALSE);
+
+    guint rows = 0;
+    gboolean done = FALSE;
+    while (!done) {
+        ScanBatch *batch = g_async_queue_pop(scan_queue);
+        if (*first_rows_us < 0 && batch->entries->len > 0) {
+            *first_rows_us = g_get_monotonic_time() - started;
+        }
+        if (!batch->cached) rows += batch->entries->len;
+        done = batch->done;
+        scan_batch_free(batch);
+    }
+    return rows;
+}
+
+void bench_scans(const char *vault, const BenchOptions *options, gboolean warm) {
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    GArray *first_rows = g_array_new(FALSE, FALSE, sizeof(gint64));
+    guint64 items = 0;
+    for (guint run = 0; run < options->runs; run++) {
+        // A cold scan has no cache to start from; each scan writes a new one
+        if (!warm && vault_meta_path) g_unlink(vault_meta_path);
+        vault_meta_open(vault);
+
+        gint64 first_rows_us;
+        gint64 started = g_get_monotonic_time();
+        items += bench_scan(vault, &first_rows_us);
+        gint64 elapsed = g_get_monotonic_time() - started;
+        g_array_append_val(latencies, elapsed);
+        g_array_append_val(first_rows, first_rows_us);
+    }
+
+    g_array_sort(first_rows, bench_compare_us);
+    char *extra = g_strdup_printf(",\"first_rows_p50_us\":%" G_GINT64_FORMAT,
+                                  g_array_index(first_rows, gint64, (first_rows->len - 1) / 2));
+    bench_report(warm ? "scan_warm" : "scan_cold", latencies, items, extra);
+    g_free(extra);
+    g_array_unref(latencies);
+    g_array_unref(first_rows);
+}
+
+void bench_open(GPtrArray *sample) {
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    guint64 bytes = 0;
+    for (guint i = 0; i < sample->len; i++) {
+        NoteLoad *load = g_new0(NoteLoad, 1);
+        load->path = g_strdup(g_ptr_array_index(sample, i));
+
+        gint64 started = g_get_monotonic_time();
+        GTask *task = g_task_new(NULL, NULL, NULL, NULL);
+        g_task_set_task_data(task, load, (GDestroyNotify)note_load_free);
+        g_task_run_in_thread_sync(task, note_load_thread);
+        GBytes *text = g_task_propagate_pointer(task, NULL);
+        gint64 elapsed = g_get_monotonic_time() - started;
+
+        if (text) {
+            bytes += g_bytes_get_size(text);
+            g_bytes_unref(text);
+        }
+        g_object_unref(task);
+        g_array_append_val(latencies, elapsed);
+    }
+    char *extra = g_strdup_printf(",\"bytes\":%" G_GUINT64_FORMAT, bytes);
+    bench_report("open", latencies, sample->len, extra);
+    g_free(extra);
+    g_array_unref(latencies);
+}
+
+void bench_save(GPtrArray *sample) {
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    for (guint i = 0; i < sample->len; i++) {
+        const char *path = g_ptr_array_index(sample, i);
+        char *text = NULL;
+        if (!g_file_get_contents(path, &text, NULL, NULL)) continue;
+
+        // Changed content, so the write is never skipped
+        NoteSave *save = g_new0(NoteSave, 1);
+        save->path = g_strdup(path);
+        save->content = g_strdup_printf("%s\nEdited in run %u.\n", text, i);
+        save->length = strlen(save->content);
+        save->flags = save_durability_flags();
+        g_free(text);
+
+        gint64 started = g_get_monotonic_time();
+        GTask *task = g_task_new(NULL, NULL, NULL, NULL);
+        g_task_set_task_data(task, save, (GDestroyNotify)note_save_free);
+        g_task_run_in_thread_sync(task, note_save_thread);
+        gboolean ok = g_task_propagate_boolean(task, NULL);
+        gint64 elapsed = g_get_monotonic_time() - started;
+        g_object_unref(task);
+        if (ok) g_array_append_val(latencies, elapsed);
+    }
+    char *extra = g_strdup_printf(",\"durability\":\"%s\"",
+                                  save_durability ? save_durability : "consistent");
+    bench_report("save", latencies, latencies->len, extra);
+    g_free(extra);
+    g_array_unref(latencies);
+}
+
+void bench_listing(GPtrArray *sample, guint iterations) {
+    for (guint i = 0; i < sample->len; i++) {
+        recent_touch(g_ptr_array_index(sample, i), RECENT_OPEN_WEIGHT);
+    }
+
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    for (guint i = 0; i < iterations; i++) {
+        gint64 started = g_get_monotonic_time();
+        char *json = recent_files_json(vault_directory, RECENT_FILES_MAX);
+        gint64 elapsed = g_get_monotonic_time() - started;
+        g_free(json);
+        g_array_append_val(latencies, elapsed);
+    }
+    bench_report("recent_listing", latencies, iterations, NULL);
+    g_array_unref(latencies);
+}
+
+void bench_config(guint iterations) {
+    save_config();
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    for (guint i = 0; i < iterations; i++) {
+        char *last_file = NULL;
+        gint64 started = g_get_monotonic_time();
+        config_read(&last_file);
+        gint64 elapsed = g_get_monotonic_time() - started;
+        g_free(last_file);
+        g_array_append_val(latencies, elapsed);
+    }
+    bench_report("config_read", latencies, iterations, NULL);
+    g_array_unref(latencies);
+}
+
+gboolean bench_parse_options(const char *spec, BenchOptions *options) {
+    options->notes = 10000;
+    options->size = 2048;
+    options->spread = 1.0;
+    options->depth = 2;
+    options->fanout = 8;
+    options->samples = 1000;
+    options->runs = 3;
+    options->seed = 1;
+    options->keep = FALSE;
+
+    char **pairs = g_strsplit(spec, ",", -1);
+    gboolean ok = TRUE;
+    for (char **pair = pairs; *pair && ok; pair++) {
+        if (!**pair) continue;
+        char *value = strchr(*pair, '=');
+        if (value) *value++ = '\0';
+        guint64 number = value ? g_ascii_strtoull(value, NULL, 10) : 0;
+
+        if (strcmp(*pair, "notes") == 0 && value) options->notes = CLAMP(number, 1, 10000000);
+        else if (strcmp(*pair, "size") == 0 && value) options->size = MAX(number, 1);
+        else if (strcmp(*pair, "spread") == 0 && value) options->spread = g_ascii_strtod(value, NULL);
+        else if (strcmp(*pair, "depth") == 0 && value) options->depth = MIN(number, 8);
+        else if (strcmp(*pair, "fanout") == 0 && value) options->fanout = CLAMP(number, 1, 1000);
+        else if (strcmp(*pair, "samples") == 0 && value) options->samples = MAX(number, 1);
+        else if (strcmp(*pair, "runs") == 0 && value) options->runs = MAX(number, 1);
+        else if (strcmp(*pair, "seed") == 0 && value) options->seed = number;
+        else if (strcmp(*pair, "keep") == 0) options->keep = TRUE;
+        else ok = FALSE;
+    }
+    g_strfreev(pairs);
+    return ok;
+}
+
+int bench_run(const char *spec) {
+    BenchOptions options;
+    if (!bench_parse_options(spec, &options)) {
+        g_printerr("Usage: --bench[=notes=N,size=BYTES,spread=SIGMA,depth=D,fanout=F,"
+                   "samples=N,runs=N,seed=N,keep]\n");
+        return 2;
+    }
+
+    GError *error = NULL;
+    char *root = g_dir_make_tmp("envelope-bench-XXXXXX", &error);
+    if (!root) {
+        g_printerr("Failed to create a bench directory: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    char *home = g_build_filename(root, "home", NULL);
+    char *vault = g_build_filename(root, "vault", NULL);
+    g_mkdir_with_parents(home, 0755);
+    g_setenv("HOME", home, TRUE);
+
+    char *config_dir = g_build_filename(home, ".config", "notes-gui", NULL);
+    g_mkdir_with_parents(config_dir, 0755);
+    config_file_path = g_build_filename(config_dir, "user.conf", NULL);
+    g_free(config_dir);
+    g_free(vault_directory);
+    vault_directory = g_strdup(vault);
+
+    gint64 started = g_get_monotonic_time();
+    GPtrArray *notes = bench_generate_vault(vault, &options);
+    g_print("{\"benchmark\":\"generate\",\"notes\":%u,\"size\":%u,\"depth\":%u,\"fanout\":%u,"
+            "\"seed\":%u,\"elapsed_us\":%" G_GINT64_FORMAT "}\n",
+            options.notes, options.size, options.depth, options.fanout, options.seed,
+            g_get_monotonic_time() - started);
+
+    // The same random notes are opened, saved and ranked
+    GRand *rand = g_rand_new_with_seed(options.seed + 1);
+    GPtrArray *sample = g_ptr_array_new();
+    for (guint i = 0; i < options.samples; i++) {
+        g_ptr_array_add(sample, g_ptr_array_index(notes, g_rand_int_range(rand, 0, notes->len)));
+    }
+    g_rand_free(rand);
+
+    bench_scans(vault, &options, FALSE);
+    bench_scans(vault, &options, TRUE);
+    bench_open(sample);
+    bench_save(sample);
+    bench_listing(sample, options.samples);
+    bench_config(options.samples);
+
+    if (scan_cancellable) g_cancellable_cancel(scan_cancellable);
+    if (!options.keep) {
+        bench_remove_tree(root);
+    } else {
+        g_printerr("Bench files kept in %s\n", root);
+    }
+    g_ptr_array_unref(sample);
+    g_ptr_array_unref(notes);
+    g_free(vault);
+    g_free(home);
+    g_free(root);
+    return 0;
+}
+
+// Recent notes
+//
+// A small frecency list of notes across vaults: each open or save adds a
+// weight to the note's score, and scores halve every RECENT_HALF_LIFE_S.
+// Only the best RECENT_MAX_TRACKED notes are kept.
+
+void recent_note_free(RecentNote *note) {
+    g_free(note->path);
+    g_free(note);
+}
+
+gdouble recent_score(const RecentNote *note, gint64 now) {
+    return note->score * exp2(-(gdouble)(now - note->time) / RECENT_HALF_LIFE_S);
+}
+
+void recent_load() {
+    recent_notes = g_ptr_array_new_with_free_func((GDestroyNotify)recent_note_free);
+    recent_file_path = g_build_filename(g_get_home_dir(), ".config", "notes-gui", "recent", NULL);
+
+    char *contents = NULL;
+    if (!g_file_get_contents(recent_file_path, &contents, NULL, NULL)) return;
+
+    // One "score<TAB>time<TAB>path" line per note
+    char **lines = g_strsplit(contents, "\n", -1);
+    for (char **line = lines; *line && recent_notes->len < RECENT_MAX_TRACKED; line++) {
+        char **fields = g_strsplit(*line, "\t", 3);
+        if (g_strv_length(fields) == 3 && *fields[2]) {
+            RecentNote *note = g_new0(RecentNote, 1);
+            note->score = g_ascii_strtod(fields[0], NULL);
+            note->time = g_ascii_strtoll(fields[1], NULL, 10);
+            note->path = g_strdup(fields[2]);
+            g_ptr_array_add(recent_notes, note);
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+}
+
+gboolean recent_save(gpointer user_data) {
+    recent_save_id = 0;
+    if (!recent_notes) return G_SOURCE_REMOVE;
+
+    GString *out = g_string_new(NULL);
+    char number[G_ASCII_DTOSTR_BUF_SIZE];
+    for (guint i = 0; i < recent_notes->len; i++) {
+        RecentNote *note = g_ptr_array_index(recent_notes, i);
+        g_string_append_printf(out, "%s\t%" G_GINT64_FORMAT "\t%s\n",
+                               g_ascii_dtostr(number, sizeof(number), note->score),
+                               note->time, note->path);
+    }
+
+    GError *error = NULL;
+    if (!g_file_set_contents(recent_file_path, out->str, out->len, &error)) {
+        g_warning("Failed to save recent notes: %s", error->message);
+        g_error_free(error);
+    }
+    g_string_free(out, TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+// Write pending changes now, for exit
+void recent_flush() {
+    if (!recent_save_id) return;
+    g_source_remove(recent_save_id);
+    recent_save(NULL);
+}
+
+void recent_schedule_save() {
+    if (!recent_save_id) {
+        recent_save_id = g_timeout_add_seconds(RECENT_SAVE_DELAY_S, recent_save, NULL);
+    }
+}
+
+// Count an open or save of path
+void recent_touch(const char *path, gdouble weight) {
+    if (!recent_notes) recent_load();
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+    RecentNote *note = NULL;
+    for (guint i = 0; i < recent_notes->len && !note; i++) {
+        RecentNote *candidate = g_ptr_array_index(recent_notes, i);
+        if (strcmp(candidate->path, path) == 0) note = candidate;
+    }
+
+    if (!note) {
+        // Full: make room by dropping the lowest score
+        if (recent_notes->len >= RECENT_MAX_TRACKED) {
+            guint lowest = 0;
+            for (guint i = 1; i < recent_notes->len; i++) {
+                if (recent_score(g_ptr_array_index(recent_notes, i), now) <
+                    recent_score(g_ptr_array_index(recent_notes, lowest), now)) {
+                    lowest = i;
+                }
+            }
+            g_ptr_array_remove_index_fast(recent_notes, lowest);
+        }
+        note = g_new0(RecentNote, 1);
+        note->path = g_strdup(path);
+        note->time = now;
+        g_ptr_array_add(recent_notes, note);
+    }
+
+    note->score = recent_score(note, now) + weight;
+    note->time = now;
+    recent_schedule_save();
+}
+
+// Follow a renamed note, or every note under a renamed folder
+void recent_rename(const char *old_path, const char *new_path) {
+    if (!recent_notes) recent_load();
+    gboolean changed = FALSE;
+    for (guint i = 0; i < recent_notes->len; i++) {
+        RecentNote *note = g_ptr_array_index(recent_notes, i);
+        if (!path_has_prefix(note->path, old_path)) continue;
+        char *renamed = g_strconcat(new_path, note->path + strlen(old_path), NULL);
+        g_free(note->path);
+        note->path = renamed;
+        changed = TRUE;
+    }
+    if (changed) recent_schedule_save();
+}
+
+gint recent_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    gint64 now = *(gint64 *)user_data;
+    gdouble score_a = recent_score(*(RecentNote * const *)a, now);
+    gdouble score_b = recent_score(*(RecentNote * const *)b, now);
+    return score_a < score_b ? 1 : score_a > score_b ? -1 : 0;
+}
+
+// Best ranked notes of vault as a JSON array for the start page. Costs the
+// same whatever the vault's size: only tracked notes are looked at.
+char* recent_files_json(const char *vault, guint limit) {
+    if (!recent_notes) recent_load();
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    GPtrArray *ranked = g_ptr_array_sized_new(recent_notes->len);
+    for (guint i = 0; vault && i < recent_notes->len; i++) {
+        RecentNote *note = g_ptr_array_index(recent_notes, i);
+        if (path_has_prefix(note->path, vault)) g_ptr_array_add(ranked, note);
+    }
+    g_ptr_array_sort_with_data(ranked, recent_compare, &now);
+
+    GString *json = g_string_new("[");
+    guint count = 0;
+    for (guint i = 0; i < ranked->len && count < limit; i++) {
+        RecentNote *note = g_ptr_array_index(ranked, i);
+        // Deleted notes stay tracked until they score too low to be kept
+        if (!g_file_test(note->path, G_FILE_TEST_IS_REGULAR)) continue;
+
+        char *name = g_path_get_basename(note->path);
+        if (count++ > 0) g_string_append_c(json, ',');
+        g_string_append(json, "{\"name\":");
+        json_append_escaped(json, name);
+        g_string_append(json, ",\"path\":");
+        json_append_escaped(json, note->path);
+        g_string_append_c(json, '}');
+        g_free(name);
+    }
+    g_string_append(json, "]");
+    g_ptr_array_unref(ranked);
+    return g_string_free(json, FALSE);
+}
+
+// Vault metadata cache
+//
+// One file per vault under ~/.config/notes-gui/meta with every row of the
+// file tree in scan order, so a warm start fills the tree straight from the
+// mapping while the scanner checks it against disk.
+
+const VaultMetaHeader* vault_meta_validate(GMappedFile *mapped) {
+    const char *data = g_mapped_file_get_contents(mapped);
+    guint64 length = g_mapped_file_get_length(mapped);
+    const VaultMetaHeader *header = (const VaultMetaHeader *)data;
+    if (length < sizeof(VaultMetaHeader) ||
+        memcmp(header->magic, VAULT_META_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VAULT_META_VERSION ||
+        sizeof(VaultMetaHeader) + (guint64)header->entry_count * sizeof(VaultMetaEntry) +
+            header->strings_size != length ||
+        header->strings_size == 0) {
+        return NULL;
+    }
+
+    // Offsets must land inside the string table, which ends in a NUL
+    const VaultMetaEntry *entries = vault_meta_entries(header);
+    const char *strings = vault_meta_strings(header);
+    if (strings[header->strings_size - 1] != '\0') return NULL;
+    for (guint32 i = 0; i < header->entry_count; i++) {
+        const VaultMetaEntry *entry = &entries[i];
+        if (entry->path >= header->strings_size || entry->name >= header->strings_size ||
+            entry->sort_key >= header->strings_size || entry->title >= header->strings_size ||
+            entry->parent >= (gint32)i || entry->parent < -1 ||
+            (entry->parent >= 0 && !entries[entry->parent].is_dir)) {
+            return NULL;
+        }
+    }
+    return header;
+}
+
+const VaultMetaEntry* vault_meta_entries(const VaultMetaHeader *header) {
+    return (const VaultMetaEntry *)(header + 1);
+}
+
+const char* vault_meta_strings(const VaultMetaHeader *header) {
+    return (const char *)(vault_meta_entries(header) + header->entry_count);
+}
+
+// Map the cache of vault, if there is a usable one
+void vault_meta_open(const char *vault) {
+    g_clear_pointer(&vault_meta, g_mapped_file_unref);
+    g_clear_pointer(&vault_meta_path, g_free);
+    if (!vault) return;
+
+    char *meta_dir = g_build_filename(g_get_home_dir(), ".config", "notes-gui", "meta", NULL);
+    g_mkdir_with_parents(meta_dir, 0755);
+    char *vault_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, vault, -1);
+    char *file_name = g_strconcat(vault_hash, ".meta", NULL);
+    vault_meta_path = g_build_filename(meta_dir, file_name, NULL);
+    g_free(file_name);
+    g_free(vault_hash);
+    g_free(meta_dir);
+
+    GMappedFile *mapped = g_mapped_file_new(vault_meta_path, FALSE, NULL);
+    if (mapped && vault_meta_validate(mapped)) {
+        vault_meta = mapped;
+    } else if (mapped) {
+        g_warning("Ignoring damaged vault cache %s", vault_meta_path);
+        g_mapped_file_unref(mapped);
+    }
+}
+
+// First heading of a note, looked for in its first few KiB past any front matter
+char* vault_meta_read_title(const char *path) {
+    int fd = g_open(path, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    char buffer[VAULT_META_TITLE_BYTES + 1];
+    gssize length = read(fd, buffer, VAULT_META_TITLE_BYTES);
+    close(fd);
+    if (length <= 0) return NULL;
+    buffer[length] = '\0';
+
+    char *line = buffer;
+    gboolean in_front_matter = g_str_has_prefix(buffer, "---\n");
+    if (in_front_matter) line += 4;
+    while (*line) {
+        char *end = strchr(line, '\n');
+        // A cut-off last line may be a cut-off heading
+        if (!end) break;
+        *end = '\0';
+        if (in_front_matter) {
+            if (strcmp(line, "---") == 0 || strcmp(line, "...") == 0) in_front_matter = FALSE;
+        } else {
+            int level = 0;
+            while (line[level] == '#' && level < 6) level++;
+            if (level > 0 && (line[level] == ' ' || line[level] == '\t')) {
+                char *title = g_strstrip(g_strdup(line + level));
+                // Closing sequence of an ATX heading
+                char *closing = title + strlen(title);
+                while (closing > title && closing[-1] == '#') closing--;
+                if (closing == title || closing[-1] == ' ' || closing[-1] == '\t') *closing = '\0';
+                g_strchomp(title);
+                char *valid = g_utf8_make_valid(title, -1);
+                g_free(title);
+                if (*valid) return valid;
+                g_free(valid);
+                return NULL;
+            }
+        }
+        line = end + 1;
+    }
+    return NULL;
+}
+
+guint32 vault_meta_builder_string(VaultMetaBuilder *builder, const char *text) {
+    if (!text || !*text) return 0;
+    guint32 offset = builder->strings->len;
+    g_byte_array_append(builder->strings, (const guint8 *)text, strlen(text) + 1);
+    return offset;
+}
+
+VaultMetaBuilder* vault_meta_builder_new(const char *vault) {
+    VaultMetaBuilder *builder = g_new0(VaultMetaBuilder, 1);
+    builder->vault_length = strlen(vault);
+    builder->entries = g_array_new(FALSE, FALSE, sizeof(VaultMetaEntry));
+    builder->strings = g_byte_array_new();
+    // Offset 0 is the empty string
+    g_byte_array_append(builder->strings, (const guint8 *)"", 1);
+    builder->folders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    return builder;
+}
+
+void vault_meta_builder_add(VaultMetaBuilder *builder, ScanEntry *entry, const char *title) {
+    VaultMetaEntry meta = { 0 };
+    meta.mtime = entry->mtime;
+    meta.size = entry->size;
+    meta.parent = entry->parent ?
+        GPOINTER_TO_INT(g_hash_table_lookup(builder->folders, entry->parent)) - 1 : -1;
+    meta.is_dir = entry->is_dir;
+    meta.path = vault_meta_builder_string(builder, entry->path + builder->vault_length + 1);
+    meta.name = vault_meta_builder_string(builder, entry->name);
+    meta.sort_key = vault_meta_builder_string(builder, entry->sort_key);
+    meta.title = vault_meta_builder_string(builder, title);
+    if (entry->is_dir) {
+        g_hash_table_insert(builder->folders, g_strdup(entry->path),
+                            GINT_TO_POINTER(builder->entries->len + 1));
+    }
+    g_array_append_val(builder->entries, meta);
+}
+
+gboolean vault_meta_builder_write(VaultMetaBuilder *builder, const char *path) {
+    VaultMetaHeader header = { 0 };
+    memcpy(header.magic, VAULT_META_MAGIC, sizeof(header.magic));
+    header.version = VAULT_META_VERSION;
+    header.entry_count = builder->entries->len;
+    header.strings_size = builder->strings->len;
+
+    GByteArray *out = g_byte_array_sized_new(sizeof(header) +
+                                             builder->entries->len * sizeof(VaultMetaEntry) +
+                                             builder->strings->len);
+    g_byte_array_append(out, (const guint8 *)&header, sizeof(header));
+    g_byte_array_append(out, (const guint8 *)builder->entries->data,
+                        builder->entries->len * sizeof(VaultMetaEntry));
+    g_byte_array_append(out, builder->strings->data, builder->strings->len);
+
+    GError *error = NULL;
+    gboolean ok = g_file_set_contents(path, (const char *)out->data, out->len, &error);
+    if (!ok) {
+        g_warning("Failed to write vault cache: %s", error->message);
+        g_error_free(error);
+    }
+    g_byte_array_unref(out);
+    return ok;
+}
+
+void vault_meta_builder_free(VaultMetaBuilder *builder) {
+    g_array_unref(builder->entries);
+    g_byte_array_unref(builder->strings);
+    g_hash_table_unref(builder->folders);
+    g_free(builder);
+}
+
+// Hand every cached row to the UI as if the scanner had found it
+void scan_emit_cached(ScanJob *job, const VaultMetaHeader *cache) {
+    gint64 started = trace_now();
+    const VaultMetaEntry *entries = vault_meta_entries(cache);
+    const char *strings = vault_meta_strings(cache);
+    // Full paths of folders, by entry index, for their children's parent
+    char **folders = g_new0(char *, cache->entry_count);
+
+    // The first rows go out alone so the top of the tree shows at once
+    guint limit = 64;
+    ScanBatch *batch = scan_batch_new(job);
+    batch->cached = TRUE;
+    for (guint32 i = 0; i < cache->entry_count; i++) {
+        const VaultMetaEntry *meta = &entries[i];
+        ScanEntry *entry = g_new0(ScanEntry, 1);
+        entry->name = g_strdup(strings + meta->name);
+        entry->path = g_build_filename(job->root, strings + meta->path, NULL);
+        entry->parent = meta->parent >= 0 ? g_strdup(folders[meta->parent]) : NULL;
+        entry->sort_key = g_strdup(strings + meta->sort_key);
+        entry->is_dir = meta->is_dir;
+        entry->mtime = meta->mtime;
+        entry->size = meta->size;
+        if (entry->is_dir) folders[i] = g_strdup(entry->path);
+        g_ptr_array_add(batch->entries, entry);
+
+        if (batch->entries->len >= limit) {
+            scan_flush_batch(batch);
+            batch = scan_batch_new(job);
+            batch->cached = TRUE;
+            limit = SCAN_BATCH_SIZE;
+        }
+    }
+    scan_flush_batch(batch);
+
+    for (guint32 i = 0; i < cache->entry_count; i++) g_free(folders[i]);
+    g_free(folders);
+    trace_span("vault", "vault_cache_emit", started);
+}
+
+// Version history
+//
+// Every save of a note in the vault becomes a version in a per-vault store
+// under ~/.config/notes-gui/history. Content is cut into chunks where a
+// rolling hash says so, so an edit only changes the chunks around it; chunks
+// are stored once by hash, deflated, in an append-only pack. Versions go to
+// an append-only log: every HISTORY_KEYFRAME_INTERVAL-th version of a note
+// lists all of its chunks, the others only what changed since the previous
+// one. Collection rewrites both files without the versions retention drops.
+
+// Gear table for the rolling hash, from a fixed seed so chunk boundaries
+// are the same on every run
+void history_init_gear() {
+    guint64 state = 0;
+    for (int i = 0; i < 256; i++) {
+        // splitmix64
+        guint64 z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        history_gear[i] = z ^ (z >> 31);
+    }
+}
+
+// Length of the chunk starting at data. The top bits of the gear hash
+// depend on the last 64 bytes, so boundaries move with the content.
+gsize history_chunk_length(const guint8 *data, gsize length) {
+    if (length <= HISTORY_CHUNK_MIN) return length;
+    gsize limit = MIN(length, HISTORY_CHUNK_MAX);
+    guint64 hash = 0;
+    for (gsize i = HISTORY_CHUNK_MIN; i < limit; i++) {
+        hash = (hash << 1) + history_gear[data[i]];
+        if ((hash >> (64 - HISTORY_CHUNK_BITS)) == 0) return i + 1;
+    }
+    return limit;
+}
+
+void history_id_compute(const void *data, gsize length, HistoryId *id) {
+    guint8 digest[32];
+    gsize digest_length = sizeof(digest);
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, data, length);
+    g_checksum_get_digest(checksum, digest, &digest_length);
+    g_checksum_free(checksum);
+    memcpy(id->bytes, digest, HISTORY_ID_BYTES);
+}
+
+guint history_id_hash(gconstpointer key) {
+    guint hash;
+    memcpy(&hash, key, sizeof(hash));
+    return hash;
+}
+
+gboolean history_id_equal(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, HISTORY_ID_BYTES) == 0;
+}
+
+void history_version_free(HistoryVersion *version) {
+    if (version->ids) g_array_unref(version->ids);
+    g_free(version);
+}
+
+gboolean history_write_all(int fd, const void *data, gsize length, guint64 offset) {
+    const guint8 *p = data;
+    while (length > 0) {
+        gssize written = pwrite(fd, p, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        p += written;
+        offset += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+gboolean history_read_exact(int fd, void *data, gsize length, guint64 offset) {
+    guint8 *p = data;
+    while (length > 0) {
+        gssize got = pread(fd, p, length, offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return FALSE;
+        p += got;
+        offset += got;
+        length -= got;
+    }
+    return TRUE;
+}
+
+// Deflate a chunk. FALSE when that would not make it smaller.
+gboolean history_compress(const guint8 *data, gsize length, guint8 **out, gsize *out_length) {
+    GConverter *converter = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+    guint8 *buffer = g_malloc(length);
+    gsize read = 0, written = 0;
+    GConverterResult result = g_converter_convert(converter, data, length, buffer, length,
+                                                  G_CONVERTER_INPUT_AT_END, &read, &written, NULL);
+    g_object_unref(converter);
+    if (result != G_CONVERTER_FINISHED || written >= length) {
+        g_free(buffer);
+        return FALSE;
+    }
+    *out = buffer;
+    *out_length = written;
+    return TRUE;
+}
+
+gboolean history_decompress(const guint8 *data, gsize length, guint8 *out, gsize out_length) {
+    GConverter *converter = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+    // Room to spare, so the end of the stream is seen without running out
+    guint8 *buffer = g_malloc(out_length + 64);
+    gsize read = 0, written = 0;
+    GConverterResult result = g_converter_convert(converter, data, length, buffer, out_length + 64,
+                                                  G_CONVERTER_INPUT_AT_END, &read, &written, NULL);
+    g_object_unref(converter);
+    gboolean ok = result == G_CONVERTER_FINISHED && written == out_length;
+    if (ok) memcpy(out, buffer, out_length);
+    g_free(buffer);
+    return ok;
+}
+
+// Version `index` of a note with its chunk list filled in from the nearest
+// keyframe before it. NULL if the log is inconsistent.
+GArray* history_manifest(GPtrArray *versions, guint index) {
+    guint start = index;
+    while (start > 0 && !((HistoryVersion *)g_ptr_array_index(versions, start))->keyframe) start--;
+    HistoryVersion *keyframe = g_ptr_array_index(versions, start);
+    if (!keyframe->keyframe) return NULL;
+
+    GArray *manifest = g_array_copy(keyframe->ids);
+    for (guint i = start + 1; i <= index && manifest; i++) {
+        GArray *next = history_apply_delta(manifest, g_ptr_array_index(versions, i));
+        g_array_unref(manifest);
+        manifest = next;
+    }
+    return manifest;
+}
+
+GArray* history_apply_delta(GArray *previous, HistoryVersion *version) {
+    if (version->keyframe) return g_array_copy(version->ids);
+    if (version->prefix + version->suffix > previous->len) return NULL;
+
+    GArray *manifest = g_array_sized_new(FALSE, FALSE, sizeof(HistoryId),
+                                         version->prefix + version->ids->len + version->suffix);
+    g_array_append_vals(manifest, previous->data, version->prefix);
+    g_array_append_vals(manifest, version->ids->data, version->ids->len);
+    g_array_append_vals(manifest, &g_array_index(previous, HistoryId, previous->len - version->suffix),
+                        version->suffix);
+    return manifest;
+}
+
+// Fill in version as a keyframe or as the change from previous to manifest
+void history_encode_delta(HistoryVersion *version, guint index, GArray *previous, GArray *manifest) {
+    if (index % HISTORY_KEYFRAME_INTERVAL == 0 || !previous) {
+        version->keyframe = TRUE;
+        version->ids = g_array_copy(manifest);
+        return;
+    }
+
+    guint prefix = 0;
+    while (prefix < previous->len && prefix < manifest->len &&
+           history_id_equal(&g_array_index(previous, HistoryId, prefix),
+                            &g_array_index(manifest, HistoryId, prefix))) {
+        prefix++;
+    }
+    guint suffix = 0;
+    while (suffix < previous->len - prefix && suffix < manifest->len - prefix &&
+           history_id_equal(&g_array_index(previous, HistoryId, previous->len - 1 - suffix),
+                            &g_array_index(manifest, HistoryId, manifest->len - 1 - suffix))) {
+        suffix++;
+    }
+
+    version->prefix = prefix;
+    version->suffix = suffix;
+    version->ids = g_array_sized_new(FALSE, FALSE, sizeof(HistoryId), manifest->len - prefix - suffix);
+    g_array_append_vals(version->ids, &g_array_index(manifest, HistoryId, prefix),
+                        manifest->len - prefix - suffix);
+}
+
+void history_encode_version(GByteArray *out, const char *relative, HistoryVersion *version) {
+    HistoryLogRecord record = { 0 };
+    record.path_length = strlen(relative);
+    record.count = version->ids->len;
+    record.record_length = sizeof(record) + record.path_length + record.count * sizeof(HistoryId);
+    record.time = version->time;
+    record.size = version->size;
+    record.content = version->content;
+    record.prefix = version->prefix;
+    record.suffix = version->suffix;
+    record.keyframe = version->keyframe;
+    g_byte_array_append(out, (const guint8 *)&record, sizeof(record));
+    g_byte_array_append(out, (const guint8 *)relative, record.path_length);
+    g_byte_array_append(out, (const guint8 *)version->ids->data, record.count * sizeof(HistoryId));
+}
+
+GPtrArray* history_note_versions(HistoryStore *store, const char *relative, gboolean create) {
+    GPtrArray *versions = g_hash_table_lookup(store->notes, relative);
+    if (!versions && create) {
+        versions = g_ptr_array_new_with_free_func((GDestroyNotify)history_version_free);
+        g_hash_table_insert(store->notes, g_strdup(relative), versions);
+    }
+    return versions;
+}
+
+// Read the pack's chunk table and the version log. A record cut short by a
+// crash is dropped from the end of either file.
+gboolean history_load(HistoryStore *store) {
+    store->chunks = g_hash_table_new_full(history_id_hash, history_id_equal, NULL, g_free);
+    store->notes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)g_ptr_array_unref);
+
+    store->pack_fd = g_open(store->pack_path, O_RDWR | O_CREAT, 0644);
+    if (store->pack_fd < 0) {
+        g_warning("Failed to open %s: %s", store->pack_path, g_strerror(errno));
+        return FALSE;
+    }
+    GStatBuf st;
+    guint64 pack_length = g_stat(store->pack_path, &st) == 0 ? (guint64)st.st_size : 0;
+    char magic[8];
+    if (pack_length < sizeof(magic)) {
+        if (!history_write_all(store->pack_fd, HISTORY_PACK_MAGIC, sizeof(magic), 0)) return FALSE;
+        pack_length = sizeof(magic);
+    } else if (!history_read_exact(store->pack_fd, magic, sizeof(magic), 0) ||
+               memcmp(magic, HISTORY_PACK_MAGIC, sizeof(magic)) != 0) {
+        g_warning("%s is not a version history pack, history is disabled", store->pack_path);
+        return FALSE;
+    }
+
+    guint64 offset = sizeof(magic);
+    HistoryPackRecord record;
+    while (offset + sizeof(record) <= pack_length &&
+           history_read_exact(store->pack_fd, &record, sizeof(record), offset) &&
+           offset + sizeof(record) + record.stored_length <= pack_length) {
+        HistoryChunk *chunk = g_new0(HistoryChunk, 1);
+        chunk->id = record.id;
+        chunk->offset = offset + sizeof(record);
+        chunk->length = record.length;
+        chunk->stored_length = record.stored_length;
+        chunk->compressed = record.compressed;
+        g_hash_table_replace(store->chunks, &chunk->id, chunk);
+        offset += sizeof(record) + record.stored_length;
+    }
+    if (offset < pack_length && ftruncate(store->pack_fd, offset) != 0) {
+        g_warning("Failed to trim %s: %s", store->pack_path, g_strerror(errno));
+    }
+    store->pack_size = offset;
+
+    char *log = NULL;
+    gsize log_length = 0;
+    if (!g_file_get_contents(store->log_path, &log, &log_length, NULL) || log_length < sizeof(magic)) {
+        g_free(log);
+        if (!g_file_set_contents(store->log_path, HISTORY_LOG_MAGIC, sizeof(magic), NULL)) return FALSE;
+        log = g_strdup(HISTORY_LOG_MAGIC);
+        log_length = sizeof(magic);
+    } else if (memcmp(log, HISTORY_LOG_MAGIC, sizeof(magic)) != 0) {
+        g_warning("%s is not a version history log, history is disabled", store->log_path);
+        g_free(log);
+        return FALSE;
+    }
+
+    gsize position = sizeof(magic);
+    HistoryLogRecord header;
+    while (position + sizeof(header) <= log_length) {
+        memcpy(&header, log + position, sizeof(header));
+        if (header.record_length != sizeof(header) + header.path_length +
+                                    (guint64)header.count * sizeof(HistoryId) ||
+            position + header.record_length > log_length) {
             break;
         }
-        g_free(path);
-        valid = gtk_tree_model_iter_next(model, &iter);
+        const char *path = log + position + sizeof(header);
+        char *relative = g_strndup(path, header.path_length);
+
+        HistoryVersion *version = g_new0(HistoryVersion, 1);
+        version->time = header.time;
+        version->size = header.size;
+        version->content = header.content;
+        version->keyframe = header.keyframe;
+        version->prefix = header.prefix;
+        version->suffix = header.suffix;
+        version->ids = g_array_sized_new(FALSE, FALSE, sizeof(HistoryId), header.count);
+        g_array_append_vals(version->ids, path + header.path_length, header.count);
+        g_ptr_array_add(history_note_versions(store, relative, TRUE), version);
+        g_free(relative);
+        position += header.record_length;
     }
-    
-    g_free(filepath);
+    if (position < log_length && truncate(store->log_path, position) != 0) {
+        g_warning("Failed to trim %s: %s", store->log_path, g_strerror(errno));
+    }
+    g_free(log);
+
+    store->log_fd = g_open(store->log_path, O_WRONLY, 0644);
+    store->log_size = position;
+    return store->log_fd >= 0;
 }
 
-// Add function to get the resource file paths
-char* get_resource_path(const char* filename) {
-    char *exe_path = realpath("/proc/self/exe", NULL);
-    if (!exe_path) return NULL;
-    
-    char *exe_dir = g_path_get_dirname(exe_path);
-    free(exe_path);
-    
-    char *resources_dir = g_build_filename(exe_dir, "resources", NULL);
-    char *file_path = g_build_filename(resources_dir, filename, NULL);
-    
-    g_free(resources_dir);
-    g_free(exe_dir);
-    
-    return file_path;
+void history_unload(HistoryStore *store) {
+    if (store->pack_fd >= 0) close(store->pack_fd);
+    if (store->log_fd >= 0) close(store->log_fd);
+    store->pack_fd = -1;
+    store->log_fd = -1;
+    g_clear_pointer(&store->chunks, g_hash_table_unref);
+    g_clear_pointer(&store->notes, g_hash_table_unref);
 }
 
+void history_store_free(HistoryStore *store) {
+    history_unload(store);
+    g_free(store->vault);
+    g_free(store->pack_path);
+    g_free(store->log_path);
+    g_free(store);
+}
 
-char* get_asset_path(const char* filename) {
-    char *exe_path = realpath("/proc/self/exe", NULL);
-    if (!exe_path) {
-        g_warning("Failed to get executable path");
+// Create and load the store of vault, on the history thread
+HistoryStore* history_store_open(const char *vault) {
+    char *vault_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, vault, -1);
+    char *dir = g_build_filename(g_get_home_dir(), ".config", "notes-gui", "history",
+                                 vault_hash, NULL);
+    g_mkdir_with_parents(dir, 0755);
+
+    HistoryStore *store = g_new0(HistoryStore, 1);
+    store->vault = g_strdup(vault);
+    store->pack_path = g_build_filename(dir, "chunks.pack", NULL);
+    store->log_path = g_build_filename(dir, "versions.log", NULL);
+    store->pack_fd = -1;
+    store->log_fd = -1;
+    g_free(dir);
+    g_free(vault_hash);
+
+    if (!history_load(store)) {
+        history_store_free(store);
         return NULL;
     }
-    
-    char *exe_dir = g_path_get_dirname(exe_path);
-    free(exe_path);
-    
-    char *assets_dir = g_build_filename(exe_dir, "assets", NULL);
-    char *file_path = g_build_filename(assets_dir, filename, NULL);
-    
-    if (!g_file_test(assets_dir, G_FILE_TEST_EXISTS)) {
-        g_warning("Assets directory does not exist: %s", assets_dir);
-        g_free(assets_dir);
-        g_free(exe_dir);
-        g_free(file_path);
+    return store;
+}
+
+// Queue the switch to vault's history; the store is read on the history thread
+void history_open(const char *vault) {
+    if (g_strcmp0(history_vault, vault) == 0) return;
+    g_free(history_vault);
+    history_vault = g_strdup(vault);
+
+    if (!history_pool && vault) {
+        history_init_gear();
+        // A single thread, so loading, appends and collections run in order
+        history_pool = g_thread_pool_new(history_job_run, NULL, 1, FALSE, NULL);
+    }
+    if (history_pool) {
+        HistoryJob *job = g_new0(HistoryJob, 1);
+        job->open = TRUE;
+        job->vault = g_strdup(vault);
+        g_thread_pool_push(history_pool, job, NULL);
+    }
+
+    if (history_collect_id) {
+        g_source_remove(history_collect_id);
+        history_collect_id = 0;
+    }
+    if (vault) {
+        history_collect_id = g_timeout_add_seconds(HISTORY_COLLECT_DELAY_S,
+                                                   history_collect_timeout, NULL);
+    }
+}
+
+void history_close() {
+    // Versions still queued are written first, then the store is dropped
+    history_open(NULL);
+    if (history_pool) {
+        g_thread_pool_free(history_pool, FALSE, TRUE);
+        history_pool = NULL;
+    }
+}
+
+// Add a version of path unless it matches the latest one. TRUE when enough
+// versions were added since the last collection to run another.
+gboolean history_append(HistoryStore *store, const char *path, const char *content, gsize length) {
+    if (!path_has_prefix(path, store->vault) || strlen(path) <= strlen(store->vault)) return FALSE;
+    const char *relative = path + strlen(store->vault) + 1;
+
+    HistoryId content_id;
+    history_id_compute(content, length, &content_id);
+    GPtrArray *versions = history_note_versions(store, relative, FALSE);
+    if (versions && versions->len > 0) {
+        HistoryVersion *latest = g_ptr_array_index(versions, versions->len - 1);
+        if (history_id_equal(&latest->content, &content_id)) return FALSE;
+    }
+
+    // New chunks go to the pack in one write before the version refers to them
+    GArray *manifest = g_array_new(FALSE, FALSE, sizeof(HistoryId));
+    GPtrArray *added = g_ptr_array_new();
+    GByteArray *pack = g_byte_array_new();
+    for (gsize offset = 0; offset < length; ) {
+        const guint8 *data = (const guint8 *)content + offset;
+        gsize chunk_length = history_chunk_length(data, length - offset);
+        offset += chunk_length;
+
+        HistoryId id;
+        history_id_compute(data, chunk_length, &id);
+        g_array_append_val(manifest, id);
+        if (g_hash_table_contains(store->chunks, &id)) continue;
+
+        guint8 *compressed = NULL;
+        gsize stored_length = chunk_length;
+        gboolean is_compressed = history_compress(data, chunk_length, &compressed, &stored_length);
+
+        HistoryPackRecord record = { 0 };
+        record.id = id;
+        record.length = chunk_length;
+        record.stored_length = stored_length;
+        record.compressed = is_compressed;
+
+        HistoryChunk *chunk = g_new0(HistoryChunk, 1);
+        chunk->id = id;
+        chunk->offset = store->pack_size + pack->len + sizeof(record);
+        chunk->length = chunk_length;
+        chunk->stored_length = stored_length;
+        chunk->compressed = is_compressed;
+        g_hash_table_insert(store->chunks, &chunk->id, chunk);
+        g_ptr_array_add(added, chunk);
+
+        g_byte_array_append(pack, (const guint8 *)&record, sizeof(record));
+        g_byte_array_append(pack, is_compressed ? compressed : data, stored_length);
+        g_free(compressed);
+    }
+
+    gboolean ok = history_write_all(store->pack_fd, pack->data, pack->len, store->pack_size);
+    if (ok) {
+        store->pack_size += pack->len;
+    } else {
+        for (guint i = 0; i < added->len; i++) {
+            g_hash_table_remove(store->chunks, &((HistoryChunk *)g_ptr_array_index(added, i))->id);
+        }
+    }
+    g_byte_array_unref(pack);
+    g_ptr_array_unref(added);
+
+    if (ok) {
+        HistoryVersion *version = g_new0(HistoryVersion, 1);
+        version->time = g_get_real_time() / G_USEC_PER_SEC;
+        version->size = length;
+        version->content = content_id;
+
+        guint index = versions ? versions->len : 0;
+        GArray *previous = index > 0 && index % HISTORY_KEYFRAME_INTERVAL != 0 ?
+            history_manifest(versions, index - 1) : NULL;
+        history_encode_delta(version, index, previous, manifest);
+        if (previous) g_array_unref(previous);
+
+        GByteArray *record = g_byte_array_new();
+        history_encode_version(record, relative, version);
+        ok = history_write_all(store->log_fd, record->data, record->len, store->log_size);
+        if (ok) {
+            store->log_size += record->len;
+            g_ptr_array_add(history_note_versions(store, relative, TRUE), version);
+            store->appends++;
+        } else {
+            history_version_free(version);
+        }
+        g_byte_array_unref(record);
+    }
+    if (!ok) {
+        g_warning("Failed to record a version of %s: %s", path, g_strerror(errno));
+    }
+
+    g_array_unref(manifest);
+    return ok && store->appends >= HISTORY_COLLECT_EVERY;
+}
+
+// Content of the newest version of a note whose content hash is `content`
+GBytes* history_read(HistoryStore *store, const char *relative, const HistoryId *content,
+                     GError **error) {
+    GPtrArray *versions = history_note_versions(store, relative, FALSE);
+    guint index = versions ? versions->len : 0;
+    while (index > 0 &&
+           !history_id_equal(&((HistoryVersion *)g_ptr_array_index(versions, index - 1))->content,
+                             content)) {
+        index--;
+    }
+    if (index == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "This version is no longer kept");
         return NULL;
     }
-    
-    g_free(assets_dir);
-    g_free(exe_dir);
-    
-    return file_path;
+
+    HistoryVersion *version = g_ptr_array_index(versions, index - 1);
+    GArray *manifest = history_manifest(versions, index - 1);
+    if (!manifest) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "The version log is damaged");
+        return NULL;
+    }
+
+    GByteArray *out = g_byte_array_sized_new(version->size);
+    guint8 *stored = NULL;
+    gboolean ok = TRUE;
+    for (guint i = 0; ok && i < manifest->len; i++) {
+        HistoryChunk *chunk = g_hash_table_lookup(store->chunks, &g_array_index(manifest, HistoryId, i));
+        if (!chunk) {
+            ok = FALSE;
+            break;
+        }
+        stored = g_realloc(stored, chunk->stored_length);
+        guint position = out->len;
+        g_byte_array_set_size(out, position + chunk->length);
+        ok = history_read_exact(store->pack_fd, stored, chunk->stored_length, chunk->offset);
+        if (ok && chunk->compressed) {
+            ok = history_decompress(stored, chunk->stored_length, out->data + position, chunk->length);
+        } else if (ok) {
+            memcpy(out->data + position, stored, chunk->length);
+        }
+    }
+    g_free(stored);
+    g_array_unref(manifest);
+
+    if (!ok || out->len != version->size) {
+        g_byte_array_unref(out);
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Chunks of this version are missing");
+        return NULL;
+    }
+    return g_byte_array_free_to_bytes(out);
 }
 
-char* get_file_contents(const char* path) {
-    char *contents = NULL;
+// Drop versions outside the retention policy and chunks nothing refers to
+// anymore. Every note keeps its newest keep_versions versions and anything
+// younger than keep_days.
+void history_collect(HistoryStore *store, gint keep_days, gint keep_versions) {
+    gint64 started = trace_now();
+    gint64 cutoff = g_get_real_time() / G_USEC_PER_SEC - (gint64)keep_days * 24 * 60 * 60;
+    store->appends = 0;
+
+    GHashTable *live = g_hash_table_new_full(history_id_hash, history_id_equal, g_free, NULL);
+    GByteArray *log = g_byte_array_new();
+    g_byte_array_append(log, (const guint8 *)HISTORY_LOG_MAGIC, 8);
+    guint dropped = 0;
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, store->notes);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GPtrArray *versions = value;
+        GArray *manifest = NULL;
+        GArray *kept_manifest = NULL;
+        guint kept = 0;
+        for (guint i = 0; i < versions->len; i++) {
+            HistoryVersion *version = g_ptr_array_index(versions, i);
+            GArray *next = manifest || version->keyframe ? history_apply_delta(manifest, version) : NULL;
+            if (manifest) g_array_unref(manifest);
+            manifest = next;
+
+            // A version that cannot be rebuilt (its keyframe or a delta
+            // before it is damaged) is kept as it is, with its chunks; the
+            // next readable one starts over with a keyframe
+            if (!manifest) {
+                g_warning("Version history of %s: version %u is unreadable, keeping it",
+                          (const char *)key, i);
+                history_encode_version(log, key, version);
+                for (guint j = 0; j < version->ids->len; j++) {
+                    HistoryId *id = &g_array_index(version->ids, HistoryId, j);
+                    if (!g_hash_table_contains(live, id)) {
+                        g_hash_table_add(live, g_memdup2(id, sizeof(HistoryId)));
+                    }
+                }
+                g_clear_pointer(&kept_manifest, g_array_unref);
+                kept++;
+                continue;
+            }
+
+            if (i + keep_versions < versions->len && version->time < cutoff) {
+                dropped++;
+                continue;
+            }
+
+            // Kept versions are numbered again, so keyframes move with them
+            HistoryVersion copy = *version;
+            copy.keyframe = FALSE;
+            copy.prefix = copy.suffix = 0;
+            copy.ids = NULL;
+            history_encode_delta(&copy, kept++, kept_manifest, manifest);
+            history_encode_version(log, key, &copy);
+            g_array_unref(copy.ids);
+
+            for (guint j = 0; j < manifest->len; j++) {
+                HistoryId *id = &g_array_index(manifest, HistoryId, j);
+                if (!g_hash_table_contains(live, id)) {
+                    g_hash_table_add(live, g_memdup2(id, sizeof(HistoryId)));
+                }
+            }
+            if (kept_manifest) g_array_unref(kept_manifest);
+            kept_manifest = g_array_ref(manifest);
+        }
+        if (manifest) g_array_unref(manifest);
+        if (kept_manifest) g_array_unref(kept_manifest);
+    }
+
+    if (dropped == 0 && g_hash_table_size(live) == g_hash_table_size(store->chunks)) {
+        g_hash_table_unref(live);
+        g_byte_array_unref(log);
+        return;
+    }
+
+    // Write both files next to the old ones and move them over. The pack
+    // goes first: a log without its pack loses versions, the other way
+    // round only keeps dead chunks until the next collection.
+    char *pack_tmp = g_strconcat(store->pack_path, ".tmp", NULL);
+    char *log_tmp = g_strconcat(store->log_path, ".tmp", NULL);
+    int fd = g_open(pack_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    gboolean ok = fd >= 0 && history_write_all(fd, HISTORY_PACK_MAGIC, 8, 0);
+    guint64 offset = 8;
+    guint8 *stored = NULL;
+
+    g_hash_table_iter_init(&iter, store->chunks);
+    while (ok && g_hash_table_iter_next(&iter, &key, &value)) {
+        HistoryChunk *chunk = value;
+        if (!g_hash_table_contains(live, &chunk->id)) continue;
+
+        HistoryPackRecord record = { 0 };
+        record.id = chunk->id;
+        record.length = chunk->length;
+        record.stored_length = chunk->stored_length;
+        record.compressed = chunk->compressed;
+        stored = g_realloc(stored, chunk->stored_length);
+        ok = history_read_exact(store->pack_fd, stored, chunk->stored_length, chunk->offset) &&
+             history_write_all(fd, &record, sizeof(record), offset) &&
+             history_write_all(fd, stored, chunk->stored_length, offset + sizeof(record));
+        offset += sizeof(record) + chunk->stored_length;
+    }
+    g_free(stored);
+    if (fd >= 0) {
+        if (ok) ok = fsync(fd) == 0;
+        close(fd);
+    }
+
     GError *error = NULL;
-    
-    if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
-        g_warning("File does not exist: %s", path);
-        return NULL;
+    if (ok) ok = g_file_set_contents(log_tmp, (const char *)log->data, log->len, &error);
+    if (ok) ok = g_rename(pack_tmp, store->pack_path) == 0 && g_rename(log_tmp, store->log_path) == 0;
+
+    if (ok) {
+        guint chunks = g_hash_table_size(store->chunks);
+        history_unload(store);
+        if (!history_load(store)) {
+            g_warning("Failed to reopen version history after compaction");
+        }
+        trace_span("history", "collect", started);
+        g_debug("Version history: dropped %u versions and %u chunks",
+                  dropped, chunks - g_hash_table_size(live));
+    } else {
+        g_warning("Failed to compact version history: %s",
+                  error ? error->message : g_strerror(errno));
+        g_clear_error(&error);
+        g_unlink(pack_tmp);
+        g_unlink(log_tmp);
     }
-    
-    if (g_file_get_contents(path, &contents, NULL, &error)) {
-        return contents;
+
+    g_free(pack_tmp);
+    g_free(log_tmp);
+    g_hash_table_unref(live);
+    g_byte_array_unref(log);
+}
+
+void history_job_free(HistoryJob *job) {
+    g_free(job->path);
+    g_free(job->content);
+    g_free(job->vault);
+    g_free(job);
+}
+
+void history_job_run(gpointer data, gpointer user_data) {
+    HistoryJob *job = data;
+    gint64 started = trace_now();
+
+    // Loaded before taking the lock; the new store is private until swapped in
+    if (job->open) {
+        HistoryStore *store = job->vault ? history_store_open(job->vault) : NULL;
+        g_mutex_lock(&history_lock);
+        HistoryStore *old = history;
+        history = store;
+        g_mutex_unlock(&history_lock);
+        if (old) history_store_free(old);
+        if (store) trace_span("history", "history_load", started);
+        history_job_free(job);
+        return;
+    }
+
+    g_mutex_lock(&history_lock);
+    if (history) {
+        gboolean collect = !job->path ||
+            history_append(history, job->path, job->content, job->length);
+        if (job->path) trace_span("history", "history_append", started);
+        if (collect) history_collect(history, job->keep_days, job->keep_versions);
+    }
+    g_mutex_unlock(&history_lock);
+    history_job_free(job);
+}
+
+// Record a saved note (content is taken over) on the history thread
+void history_queue_append(const char *path, char *content, gsize length) {
+    if (!history_pool) {
+        g_free(content);
+        return;
+    }
+    HistoryJob *job = g_new0(HistoryJob, 1);
+    job->path = g_strdup(path);
+    job->content = content;
+    job->length = length;
+    job->keep_days = history_keep_days;
+    job->keep_versions = history_keep_versions;
+    g_thread_pool_push(history_pool, job, NULL);
+}
+
+gboolean history_collect_timeout(gpointer user_data) {
+    history_collect_id = 0;
+    HistoryJob *job = g_new0(HistoryJob, 1);
+    job->keep_days = history_keep_days;
+    job->keep_versions = history_keep_versions;
+    g_thread_pool_push(history_pool, job, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+void history_read_free(HistoryRead *read) {
+    g_free(read->vault);
+    g_free(read->relative);
+    g_free(read);
+}
+
+void history_read_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    HistoryRead *read = task_data;
+    GError *error = NULL;
+    GBytes *bytes = NULL;
+    g_mutex_lock(&history_lock);
+    if (history && g_strcmp0(history->vault, read->vault) == 0) {
+        bytes = history_read(history, read->relative, &read->content, &error);
+    } else {
+        g_set_error(&error, G_IO_ERROR, G_IO_ERROR_CLOSED, "The vault was closed");
+    }
+    g_mutex_unlock(&history_lock);
+
+    if (bytes) {
+        g_task_return_pointer(task, bytes, (GDestroyNotify)g_bytes_unref);
     } else {
-        g_warning("Failed to read file %s: %s", path, error->message);
+        g_task_return_error(task, error);
+    }
+}
+
+void history_read_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    GTask *task = G_TASK(result);
+    HistoryRead *read = g_task_get_task_data(task);
+    GError *error = NULL;
+    GBytes *bytes = g_task_propagate_pointer(task, &error);
+
+    // Cancelled when the browser closed or another version was picked
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
         g_error_free(error);
-        return NULL;
+        if (bytes) g_bytes_unref(bytes);
+        return;
+    }
+
+    HistoryBrowser *browser = user_data;
+    if (read->request != browser->request) {
+        g_clear_error(&error);
+        if (bytes) g_bytes_unref(bytes);
+        return;
+    }
+
+    g_clear_pointer(&browser->selected, g_bytes_unref);
+    if (bytes) {
+        gsize size;
+        const char *data = g_bytes_get_data(bytes, &size);
+        gtk_text_buffer_set_text(browser->buffer, data ? data : "", size);
+        browser->selected = bytes;
+    } else {
+        gtk_text_buffer_set_text(browser->buffer, error->message, -1);
+        g_error_free(error);
+    }
+    gtk_widget_set_sensitive(browser->restore_button, browser->selected != NULL);
+}
+
+void history_version_selected(GtkTreeSelection *selection, gpointer user_data) {
+    HistoryBrowser *browser = user_data;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+
+    g_cancellable_cancel(browser->cancellable);
+    g_clear_object(&browser->cancellable);
+    g_clear_pointer(&browser->selected, g_bytes_unref);
+    gtk_widget_set_sensitive(browser->restore_button, FALSE);
+    browser->request++;
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+
+    guint index;
+    gtk_tree_model_get(model, &iter, 2, &index, -1);
+    HistoryRead *read = g_new0(HistoryRead, 1);
+    read->vault = g_strdup(browser->vault);
+    read->relative = g_strdup(browser->relative);
+    read->content = g_array_index(browser->contents, HistoryId, index);
+    read->request = browser->request;
+
+    browser->cancellable = g_cancellable_new();
+    GTask *task = g_task_new(NULL, browser->cancellable, history_read_done, browser);
+    g_task_set_task_data(task, read, (GDestroyNotify)history_read_free);
+    g_task_run_in_thread(task, history_read_thread);
+    g_object_unref(task);
+}
+
+void history_list_free(HistoryList *list) {
+    g_free(list->vault);
+    g_free(list->relative);
+    g_free(list->path);
+    if (list->versions) g_array_unref(list->versions);
+    g_free(list);
+}
+
+// Waits here, off the main thread, while a collection holds the store
+void history_list_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    HistoryList *list = task_data;
+    list->versions = g_array_new(FALSE, FALSE, sizeof(HistoryListed));
+    g_mutex_lock(&history_lock);
+    GPtrArray *versions = history && g_strcmp0(history->vault, list->vault) == 0 ?
+        history_note_versions(history, list->relative, FALSE) : NULL;
+    // Newest first
+    for (guint i = versions ? versions->len : 0; i > 0; i--) {
+        HistoryVersion *version = g_ptr_array_index(versions, i - 1);
+        HistoryListed listed = { version->time, version->size, version->content };
+        g_array_append_val(list->versions, listed);
+    }
+    g_mutex_unlock(&history_lock);
+    g_task_return_boolean(task, TRUE);
+}
+
+void history_list_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    HistoryList *list = g_task_get_task_data(G_TASK(result));
+    // The vault was switched while the versions were being listed
+    if (g_strcmp0(list->vault, vault_directory) != 0) return;
+    history_browser_run(list);
+}
+
+// Show the saved versions of the note selected in the file tree
+void history_show(GtkWidget *menuitem, gpointer userdata) {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+
+    char *filepath;
+    gboolean is_dir;
+    gtk_tree_model_get(model, &iter, 1, &filepath, 2, &is_dir, -1);
+    if (is_dir || !vault_directory || !path_has_prefix(filepath, vault_directory)) {
+        g_free(filepath);
+        return;
+    }
+
+    HistoryList *list = g_new0(HistoryList, 1);
+    list->vault = g_strdup(vault_directory);
+    list->relative = g_strdup(filepath + strlen(vault_directory) + 1);
+    list->path = filepath;
+    GTask *task = g_task_new(NULL, NULL, history_list_done, NULL);
+    g_task_set_task_data(task, list, (GDestroyNotify)history_list_free);
+    g_task_run_in_thread(task, history_list_thread);
+    g_object_unref(task);
+}
+
+void history_browser_run(HistoryList *list) {
+    HistoryBrowser browser = { 0 };
+    browser.vault = g_strdup(list->vault);
+    browser.relative = g_strdup(list->relative);
+    browser.contents = g_array_new(FALSE, FALSE, sizeof(HistoryId));
+    browser.store = gtk_list_store_new(3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT);
+
+    for (guint i = 0; i < list->versions->len; i++) {
+        HistoryListed *version = &g_array_index(list->versions, HistoryListed, i);
+        GDateTime *time = g_date_time_new_from_unix_local(version->time);
+        char *time_text = g_date_time_format(time, "%Y-%m-%d %H:%M:%S");
+        char *size_text = g_format_size(version->size);
+        GtkTreeIter row;
+        gtk_list_store_append(browser.store, &row);
+        gtk_list_store_set(browser.store, &row, 0, time_text, 1, size_text,
+                           2, browser.contents->len, -1);
+        g_array_append_val(browser.contents, version->content);
+        g_free(time_text);
+        g_free(size_text);
+        g_date_time_unref(time);
     }
+
+    char *filename = g_path_get_basename(list->path);
+    char *title = g_strdup_printf("History of %s", filename);
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(title, GTK_WINDOW(window), GTK_DIALOG_MODAL,
+                                                    "_Close", GTK_RESPONSE_CLOSE, NULL);
+    browser.restore_button = gtk_dialog_add_button(GTK_DIALOG(dialog), "_Restore",
+                                                   GTK_RESPONSE_ACCEPT);
+    gtk_widget_set_sensitive(browser.restore_button, FALSE);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 800, 500);
+    g_free(title);
+    g_free(filename);
+
+    GtkWidget *paned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+    GtkWidget *list_scroll = gtk_scrolled_window_new(NULL, NULL);
+    browser.view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(browser.store));
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+    gtk_tree_view_append_column(GTK_TREE_VIEW(browser.view),
+        gtk_tree_view_column_new_with_attributes("Saved", renderer, "text", 0, NULL));
+    gtk_tree_view_append_column(GTK_TREE_VIEW(browser.view),
+        gtk_tree_view_column_new_with_attributes("Size", renderer, "text", 1, NULL));
+    gtk_container_add(GTK_CONTAINER(list_scroll), browser.view);
+    gtk_widget_set_size_request(list_scroll, 260, -1);
+
+    GtkWidget *text_scroll = gtk_scrolled_window_new(NULL, NULL);
+    GtkWidget *text_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(text_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(text_view), TRUE);
+    gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(text_view), GTK_WRAP_WORD_CHAR);
+    browser.buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view));
+    gtk_container_add(GTK_CONTAINER(text_scroll), text_view);
+
+    gtk_paned_pack1(GTK_PANED(paned), list_scroll, FALSE, FALSE);
+    gtk_paned_pack2(GTK_PANED(paned), text_scroll, TRUE, FALSE);
+    gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), paned, TRUE, TRUE, 0);
+    if (browser.contents->len == 0) {
+        gtk_text_buffer_set_text(browser.buffer, "No versions of this note were recorded yet.", -1);
+    }
+
+    GtkTreeSelection *version_selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(browser.view));
+    g_signal_connect(version_selection, "changed", G_CALLBACK(history_version_selected), &browser);
+    gtk_widget_show_all(dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && browser.selected) {
+        history_restore(list->path, browser.selected);
+    }
+
+    g_signal_handlers_disconnect_by_data(version_selection, &browser);
+    if (browser.cancellable) {
+        g_cancellable_cancel(browser.cancellable);
+        g_object_unref(browser.cancellable);
+    }
+    gtk_widget_destroy(dialog);
+    g_clear_pointer(&browser.selected, g_bytes_unref);
+    g_object_unref(browser.store);
+    g_array_unref(browser.contents);
+    g_free(browser.relative);
+    g_free(browser.vault);
+}
+
+// Write an old version back to the note. The restore is saved like any
+// edit, so it becomes the newest version and can itself be undone.
+void history_restore(const char *path, GBytes *bytes) {
+    gsize size;
+    const char *data = g_bytes_get_data(bytes, &size);
+    EditorTab *tab = tab_find(path);
+    if (g_strcmp0(path, current_file_path) == 0) {
+        editor_load_document(bytes);
+        mark_content_unsaved();
+    } else if (tab && tab->hot && tab->saved) {
+        tab_make_cold(tab);
+    }
+    note_save_start(path, g_strndup(data ? data : "", size), edit_seq);
 }
 
 void apply_gtk_css() {
@@ -1326,15 +10477,17 @@ void setup_css_provider(void) {
     }
 
     css_provider = gtk_css_provider_new();
-    char *css_path = get_asset_path("main.css");
-    if (css_path) {
-        gtk_css_provider_load_from_path(css_provider, css_path, NULL);
+    GBytes *css = asset_lookup("main.css");
+    if (css) {
+        gsize length;
+        const char *data = g_bytes_get_data(css, &length);
+        gtk_css_provider_load_from_data(css_provider, data, length, NULL);
         GdkScreen *screen = gdk_screen_get_default();
         gtk_style_context_add_provider_for_screen(
             screen,
             GTK_STYLE_PROVIDER(css_provider),
             GTK_STYLE_PROVIDER_PRIORITY_APPLICATION
         );
-        g_free(css_path);
+        g_bytes_unref(css);
     }
 }